@@ -0,0 +1,250 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Heap Benchmark
+ *
+ * Runs src/kheap.c on the host over a stub page allocator and reports
+ * the cost of allocating and freeing from each size class, next to the
+ * host's malloc, and how much of the memory the heap takes from the
+ * page allocator is in use under random allocation and freeing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "kheap.h"
+#include "kmem.h"
+
+#define BENCH_ARENA_PAGES   32768   // Pages the stub page allocator hands out (128MB)
+#define BENCH_OBJECTS       20000   // Objects allocated at once per size class
+#define BENCH_SLOTS         20000   // Objects live at once in the churn test
+#define BENCH_CHURN_OPS     1000000 // Allocations and frees in the churn test
+
+#ifndef MAP_32BIT
+#define MAP_32BIT 0
+#endif
+
+// Stub page allocator
+// Pages come from one arena mapped below 4GB, so they survive the
+// kernel's unsigned int address arithmetic. Single pages are reused
+// through a free stack; runs of pages are only ever taken from the end.
+unsigned char *bench_arena;
+int bench_arena_next;
+void *bench_free_pages[BENCH_ARENA_PAGES];
+int bench_free_count;
+int bench_pages_used;
+int bench_pages_peak;
+
+// Objects for the benchmarks and the sizes they were requested with
+void *bench_objs[BENCH_OBJECTS > BENCH_SLOTS ? BENCH_OBJECTS : BENCH_SLOTS];
+int bench_sizes[BENCH_SLOTS];
+
+// State of the random number generator
+unsigned int bench_seed = 0x159159;
+
+/**
+ * Allocates pages from the arena
+ * @param count - number of pages
+ * @return pointer to the first page, NULL if the arena is used up
+ */
+void *kmem_page_alloc(int count) {
+    void *page;
+
+    if(count == 1 && bench_free_count > 0) {
+        page = bench_free_pages[--bench_free_count];
+    }
+    else if(bench_arena_next + count <= BENCH_ARENA_PAGES) {
+        page = bench_arena + bench_arena_next * KMEM_PAGE_SIZE;
+        bench_arena_next += count;
+    }
+    else {
+        return NULL;
+    }
+
+    bench_pages_used += count;
+    if(bench_pages_used > bench_pages_peak) {
+        bench_pages_peak = bench_pages_used;
+    }
+
+    return page;
+}
+
+/**
+ * Returns pages to the arena
+ * @param addr - pointer to the first page
+ * @param count - number of pages
+ */
+void kmem_page_free(void *addr, int count) {
+    for(int i = 0; i < count; i++) {
+        bench_free_pages[bench_free_count++] = (unsigned char *)addr + i * KMEM_PAGE_SIZE;
+    }
+
+    bench_pages_used -= count;
+}
+
+/**
+ * Returns a pseudo-random number
+ * @return next number of a xorshift sequence
+ */
+unsigned int bench_rand(void) {
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+}
+
+/**
+ * Reads a monotonic clock
+ * @return time in nanoseconds
+ */
+double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Times allocating and then freeing many objects of one size
+ * @param size - object size in bytes
+ * @param heap - 1 to use kmalloc/kfree, 0 to use malloc/free
+ * @param alloc_ns - where to store the time per allocation
+ * @param free_ns - where to store the time per free
+ */
+void bench_size(int size, int heap, double *alloc_ns, double *free_ns) {
+    double start = bench_now();
+
+    for(int i = 0; i < BENCH_OBJECTS; i++) {
+        bench_objs[i] = heap ? kmalloc(size) : malloc(size);
+        if(!bench_objs[i]) {
+            fprintf(stderr, "out of memory at %d objects of %d bytes\n", i, size);
+            exit(1);
+        }
+
+        // Touch the object so neither allocator gets away with lazy pages.
+        *(char *)bench_objs[i] = 1;
+    }
+    *alloc_ns = (bench_now() - start) / BENCH_OBJECTS;
+
+    start = bench_now();
+    for(int i = 0; i < BENCH_OBJECTS; i++) {
+        if(heap) {
+            kfree(bench_objs[i]);
+        }
+        else {
+            free(bench_objs[i]);
+        }
+    }
+    *free_ns = (bench_now() - start) / BENCH_OBJECTS;
+}
+
+/**
+ * Allocates and frees objects of random sizes at random
+ * Each operation picks a slot, freeing its object if it has one and
+ * allocating one of 1 to 1024 bytes otherwise.
+ * @param heap - 1 to use kmalloc/kfree, 0 to use malloc/free
+ * @param live_peak - where to store the most bytes requested at once, may be NULL
+ * @return time per operation in nanoseconds
+ */
+double bench_churn(int heap, long *live_peak) {
+    long live = 0;
+    double start;
+    int slot;
+
+    memset(bench_objs, 0, sizeof(bench_objs));
+    bench_seed = 0x159159;
+    if(live_peak) {
+        *live_peak = 0;
+    }
+
+    start = bench_now();
+    for(int i = 0; i < BENCH_CHURN_OPS; i++) {
+        slot = bench_rand() % BENCH_SLOTS;
+
+        if(bench_objs[slot]) {
+            if(heap) {
+                kfree(bench_objs[slot]);
+            }
+            else {
+                free(bench_objs[slot]);
+            }
+            bench_objs[slot] = NULL;
+            live -= bench_sizes[slot];
+            continue;
+        }
+
+        bench_sizes[slot] = 1 + bench_rand() % 1024;
+        bench_objs[slot] = heap ? kmalloc(bench_sizes[slot]) : malloc(bench_sizes[slot]);
+        if(!bench_objs[slot]) {
+            fprintf(stderr, "out of memory after %d operations\n", i);
+            exit(1);
+        }
+
+        live += bench_sizes[slot];
+        if(live_peak && live > *live_peak) {
+            *live_peak = live;
+        }
+    }
+    start = (bench_now() - start) / BENCH_CHURN_OPS;
+
+    for(int i = 0; i < BENCH_SLOTS; i++) {
+        if(heap) {
+            kfree(bench_objs[i]);
+        }
+        else {
+            free(bench_objs[i]);
+        }
+    }
+
+    return start;
+}
+
+int main(void) {
+    double kheap_alloc, kheap_free, malloc_alloc, malloc_free;
+    double kheap_op, malloc_op;
+    long live_peak;
+
+    bench_arena = mmap(NULL, (size_t)BENCH_ARENA_PAGES * KMEM_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if(bench_arena == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    kheap_init();
+
+    printf("Allocating then freeing %d objects (ns per operation)\n", BENCH_OBJECTS);
+    printf("%6s  %12s  %12s  %12s  %12s\n", "Size", "kmalloc", "kfree", "malloc", "free");
+
+    for(int shift = KHEAP_MIN_SHIFT; shift <= KHEAP_MAX_SHIFT; shift++) {
+        bench_size(1 << shift, 1, &kheap_alloc, &kheap_free);
+        bench_size(1 << shift, 0, &malloc_alloc, &malloc_free);
+        printf("%6d  %12.1f  %12.1f  %12.1f  %12.1f\n",
+               1 << shift, kheap_alloc, kheap_free, malloc_alloc, malloc_free);
+    }
+
+    bench_pages_peak = bench_pages_used;
+    kheap_op = bench_churn(1, &live_peak);
+    malloc_op = bench_churn(0, NULL);
+
+    printf("\nRandom allocation and freeing, 1-1024 bytes, %d slots, %d operations\n",
+           BENCH_SLOTS, BENCH_CHURN_OPS);
+    printf("  ns per operation:   kheap %.1f, malloc %.1f\n", kheap_op, malloc_op);
+    printf("  Peak bytes live:    %ld\n", live_peak);
+    printf("  Peak pages held:    %d (%ld bytes, %.1f%% in use)\n", bench_pages_peak,
+           (long)bench_pages_peak * KMEM_PAGE_SIZE,
+           100.0 * live_peak / ((double)bench_pages_peak * KMEM_PAGE_SIZE));
+    printf("  Pages held after:   %d\n", bench_pages_used);
+
+    printf("\n%-16s  %5s  %6s  %8s  %10s  %10s\n", "Cache", "Size", "Slabs", "Peak", "Allocs", "Frees");
+    for(kheap_cache_t *cache = kheap_caches(); cache; cache = cache->next) {
+        printf("%-16s  %5d  %6d  %8d  %10u  %10u\n", cache->name, cache->size, cache->slabs,
+               cache->peak, cache->allocs, cache->frees);
+    }
+
+    return 0;
+}
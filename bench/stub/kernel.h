@@ -0,0 +1,22 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Functions and Helpers for host builds
+ * Errors and warnings go to stderr; everything else is dropped.
+ */
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define kernel_log_error(...)   (fprintf(stderr, "error: " __VA_ARGS__), fputc('\n', stderr))
+#define kernel_log_warn(...)    (fprintf(stderr, "warn: " __VA_ARGS__), fputc('\n', stderr))
+#define kernel_log_info(...)    ((void)0)
+#define kernel_log_debug(...)   ((void)0)
+#define kernel_log_trace(...)   ((void)0)
+#define kernel_panic(...)       (fprintf(stderr, "panic: " __VA_ARGS__), fputc('\n', stderr), abort())
+
+#endif
@@ -0,0 +1,8 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Host build of <spede/stddef.h>
+ */
+#include <stddef.h>
@@ -8,6 +8,9 @@
 #ifndef BIT_UTIL_H
 #define BIT_UTIL_H
 
+// Number of 32-bit words needed to hold the given number of bits
+#define BITMAP_WORDS(bits)  (((bits) + 31) / 32)
+
 /**
  * Counts the number of bits that are set
  * @param value - the integer value to count bits in
@@ -44,4 +47,65 @@ int bit_clear(int value, int bit);
  */
 int bit_toggle(int value, int bit);
 
+/**
+ * Finds the lowest bit that is set in the given integer value
+ * @param value - the integer value to search
+ * @return the lowest set bit (numbered from 1), 0 if no bits are set
+ */
+int bit_find_first(int value);
+
+/**
+ * Finds the highest bit that is set in the given integer value
+ * @param value - the integer value to search
+ * @return the highest set bit (numbered from 1), 0 if no bits are set
+ */
+int bit_find_last(int value);
+
+/**
+ * Finds the lowest bit above the given bit that is set in the integer value
+ * @param value - the integer value to search
+ * @param bit - bit to search after (numbered from 1), 0 to search from the start
+ * @return the next set bit (numbered from 1), 0 if no higher bits are set
+ */
+int bit_find_next(int value, int bit);
+
+/**
+ * Checks if the given bit is set in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to check (numbered from 1)
+ * @return 1 if set, 0 if not set
+ */
+int bitmap_test(unsigned int *map, int bit);
+
+/**
+ * Sets the specified bit in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to set (numbered from 1)
+ */
+void bitmap_set(unsigned int *map, int bit);
+
+/**
+ * Clears the specified bit in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to clear (numbered from 1)
+ */
+void bitmap_clear(unsigned int *map, int bit);
+
+/**
+ * Finds the lowest bit that is set in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param words - number of words in the bitmap
+ * @return the lowest set bit (numbered from 1), 0 if no bits are set
+ */
+int bitmap_find_first(unsigned int *map, int words);
+
+/**
+ * Finds the lowest bit above the given bit that is set in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param words - number of words in the bitmap
+ * @param bit - bit to search after (numbered from 1), 0 to search from the start
+ * @return the next set bit (numbered from 1), 0 if no higher bits are set
+ */
+int bitmap_find_next(unsigned int *map, int words, int bit);
+
 #endif
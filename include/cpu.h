@@ -0,0 +1,89 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Multiprocessor Definitions
+ */
+#ifndef CPU_H
+#define CPU_H
+
+#define CPU_TRAMPOLINE_ADDR 0x8000  // Real mode entry point of the application processors
+
+#ifndef ASSEMBLER
+#include <spede/machine/asmacros.h>
+#include "kproc.h"
+
+// Per-CPU data
+// CPUs are identified by their local APIC id; processors with an id of
+// CPU_MAX or above are left halted.
+typedef struct cpu_t {
+    int id;                         // CPU id (local APIC id)
+    int bsp;                        // Bootstrap processor
+    int started;                    // CPU is running processes
+    proc_t *current;                // Process running on the CPU
+    proc_t *idle_proc;              // Idle task of the CPU
+    unsigned long long exit_tsc;    // TSC when the kernel context was last exited
+    unsigned long long lock_cycles; // Time spent waiting for the kernel lock
+} cpu_t;
+
+/**
+ * Returns the id of the current CPU
+ * @return local APIC id, 0 if there is no local APIC
+ */
+int cpu_id(void);
+
+/**
+ * Returns the per-CPU data of the current CPU
+ * @return pointer to the CPU entry
+ */
+cpu_t *cpu_get(void);
+
+/**
+ * Returns the per-CPU data of the given CPU
+ * @param id - CPU id
+ * @return pointer to the CPU entry, NULL if the id is invalid
+ */
+cpu_t *cpu_entry(int id);
+
+/**
+ * Returns the highest priority interrupt in service on this CPU's local APIC
+ * @return interrupt vector, -1 if none or there is no local APIC
+ */
+int cpu_lapic_in_service(void);
+
+/**
+ * Indicates if every started CPU is running its idle task
+ * @return 1 if all CPUs are idle, 0 otherwise
+ */
+int cpu_all_idle(void);
+
+/**
+ * Initializes the local APIC of the bootstrap processor
+ * Must be called after the TSC is calibrated.
+ */
+void cpu_init(void);
+
+/**
+ * Starts the application processors
+ * Each processor creates its own idle task and starts scheduling.
+ */
+void cpu_start(void);
+
+/**
+ * Application processor entry point
+ * Called by the startup trampoline on the CPU's kernel stack.
+ * @param id - CPU id
+ */
+void cpu_ap_main(int id);
+
+__BEGIN_DECLS
+
+extern char cpu_trampoline_start[];
+extern char cpu_trampoline_gdtr[];
+extern char cpu_trampoline_idtr[];
+extern char cpu_trampoline_end[];
+
+__END_DECLS
+#endif
+#endif
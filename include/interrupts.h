@@ -14,6 +14,8 @@
 #define IRQ_TIMER    0x20       // PIC IRQ 0 (Timer)
 #define IRQ_KEYBOARD 0x21       // PIC IRQ 1 (Keyboard)
 #define IRQ_SYSCALL  0x80       // System call IRQ
+#define IRQ_APIC_TIMER    0x30  // Local APIC timer
+#define IRQ_APIC_SPURIOUS 0xef  // Local APIC spurious interrupt
 
 
 #ifndef ASSEMBLER
@@ -65,6 +67,12 @@ void pic_irq_disable(int irq);
  */
 int pic_irq_enabled(int irq);
 
+/**
+ * Returns the highest priority IRQ in service on the PIC
+ * @return IRQ number (0x20 - 0x2f), -1 if none
+ */
+int pic_irq_in_service(void);
+
 /**
  * Dismisses the specified IRQ in the PIC
  * @param irq - IRQ number
@@ -77,6 +85,8 @@ __BEGIN_DECLS
 extern void isr_entry_timer();
 extern void isr_entry_keyboard();
 extern void isr_entry_syscall();
+extern void isr_entry_apic_timer();
+extern void isr_entry_apic_spurious();
 
 __END_DECLS
 #endif
@@ -8,13 +8,19 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
-#define KSTACK_SIZE 16384   // Kernel Stack Size
+#define KSTACK_SIZE 16384   // Kernel Stack Size (per CPU)
+
+#ifndef CPU_MAX
+#define CPU_MAX     4       // Maximum number of CPUs to support
+#endif
 #define KCODE_SEG   0x08    // Kernel Code Segment
 #define KDATA_SEG   0x10    // Kernel Data Segment
 
 #ifndef ASSEMBLER
 #include <spede/machine/asmacros.h>
 #include "kproc.h"
+#include "cpu.h"
+#include "spinlock.h"
 
 #ifndef OS_NAME
 #define OS_NAME "MyOS"
@@ -31,8 +37,11 @@ typedef enum log_level {
     KERNEL_LOG_LEVEL_ALL    // Log everything!
 } log_level_t;
 
-// Global pointer to the current active process entry
-extern proc_t *active_proc;
+// Pointer to the process entry running on the current CPU
+#define active_proc (cpu_get()->current)
+
+// Serializes the kernel context between CPUs
+extern spinlock_t kernel_lock;
 
 /**
  * Kernel initialization
@@ -0,0 +1,83 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Heap
+ */
+#ifndef KHEAP_H
+#define KHEAP_H
+
+#define KHEAP_NAME_LEN      16      // Maximum length of a cache name
+#define KHEAP_MIN_SHIFT     4       // Smallest kmalloc size class (16 bytes)
+#define KHEAP_MAX_SHIFT     10      // Largest kmalloc size class (1024 bytes)
+
+struct kheap_slab_t;
+
+// Cache of equally sized objects
+// Objects are carved out of single-page slabs. Slabs with free objects
+// are kept on a list so allocating and freeing never search.
+typedef struct kheap_cache_t {
+    char name[KHEAP_NAME_LEN];  // Cache name
+    int size;                   // Size of each object
+    int per_slab;               // Objects that fit in a slab
+    struct kheap_slab_t *partial; // Slabs with free objects
+    struct kheap_cache_t *next; // Next cache in the list of all caches
+
+    int slabs;                  // Slabs allocated
+    int in_use;                 // Objects allocated
+    int peak;                   // Most objects ever allocated at once
+    unsigned int allocs;        // Number of allocations
+    unsigned int frees;         // Number of frees
+} kheap_cache_t;
+
+/**
+ * Initializes the kernel heap and the kmalloc size classes
+ */
+void kheap_init(void);
+
+/**
+ * Initializes a cache of equally sized objects
+ * @param cache - pointer to the cache
+ * @param name - cache name
+ * @param size - object size in bytes
+ * @return 0 on success, -1 on error
+ */
+int kheap_cache_init(kheap_cache_t *cache, char *name, int size);
+
+/**
+ * Allocates an object from a cache
+ * @param cache - pointer to the cache
+ * @return pointer to the object, NULL if out of memory
+ */
+void *kheap_cache_alloc(kheap_cache_t *cache);
+
+/**
+ * Returns an object to its cache
+ * @param cache - pointer to the cache
+ * @param obj - pointer to the object
+ */
+void kheap_cache_free(kheap_cache_t *cache, void *obj);
+
+/**
+ * Returns the list of all caches, for reporting statistics
+ * @return pointer to the first cache
+ */
+kheap_cache_t *kheap_caches(void);
+
+/**
+ * Allocates kernel memory
+ * Requests up to 1024 bytes come from the power-of-two size class
+ * caches; larger requests get whole pages.
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if out of memory
+ */
+void *kmalloc(int size);
+
+/**
+ * Frees memory allocated by kmalloc or kheap_cache_alloc
+ * @param ptr - pointer to the memory, may be NULL
+ */
+void kfree(void *ptr);
+
+#endif
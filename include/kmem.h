@@ -0,0 +1,82 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Memory Allocator
+ */
+#ifndef KMEM_H
+#define KMEM_H
+
+#define KMEM_PAGE_SIZE  4096        // Allocation unit
+
+#ifndef KMEM_MAX_ORDER
+#define KMEM_MAX_ORDER  10          // Largest block is 2^10 pages (4MB)
+#endif
+
+#ifndef KMEM_REGIONS_MAX
+#define KMEM_REGIONS_MAX 16         // Maximum usable regions in the memory map
+#endif
+
+// Region of usable physical memory
+typedef struct kmem_region_t {
+    unsigned int base;          // Physical address of the region
+    unsigned int length;        // Length of the region in bytes
+} kmem_region_t;
+
+/**
+ * Adds a region of usable memory to the memory map
+ * Must be called before kmem_init; regions are clipped to the memory
+ * after the kernel image and below KPAGING_KERNEL_TOP.
+ * @param base - physical address of the region
+ * @param length - length of the region in bytes
+ * @return 0 on success, -1 if the map is full
+ */
+int kmem_region_add(unsigned int base, unsigned int length);
+
+/**
+ * Initializes the kernel memory allocator
+ * Builds the memory map (probing the firmware if nothing was added) and
+ * hands every usable page after the kernel image to the page allocator.
+ */
+void kmem_init(void);
+
+/**
+ * Allocates contiguous pages of kernel memory
+ * @param count - number of pages
+ * @return pointer to the first page, NULL if not enough memory is free
+ */
+void *kmem_page_alloc(int count);
+
+/**
+ * Frees pages allocated by kmem_page_alloc
+ * A single page shared with kmem_page_share loses one reference and is
+ * only freed with the last.
+ * @param addr - pointer to the first page
+ * @param count - number of pages
+ */
+void kmem_page_free(void *addr, int count);
+
+/**
+ * Adds a reference to an allocated page
+ * The page is then only freed once kmem_page_free has been called for
+ * every reference.
+ * @param addr - pointer to the page
+ * @return 0 on success, -1 on error
+ */
+int kmem_page_share(void *addr);
+
+/**
+ * Indicates if a page has more than one reference
+ * @param addr - pointer to the page
+ * @return 1 if the page is shared, 0 otherwise
+ */
+int kmem_page_shared(void *addr);
+
+/**
+ * Returns the number of pages that are free
+ * @return number of free pages
+ */
+int kmem_pages_free(void);
+
+#endif
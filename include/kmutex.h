@@ -55,4 +55,20 @@ int kmutex_lock(int id);
  * @return -1 on error, otherwise the current lock count
  */
 int kmutex_unlock(int id);
+
+/**
+ * Removes a process that is going away from every mutex
+ * The process leaves the wait queue it is in, so its owner stops
+ * inheriting from it, and any mutex it holds passes to the next waiter.
+ * @param proc - pointer to the process entry
+ */
+void kmutex_forget(proc_t *proc);
+
+/**
+ * Turns priority inheritance on or off
+ * An owner already running at an inherited priority keeps it until it
+ * next unlocks.
+ * @param inherit - 1 to have owners inherit their waiters' priority, 0 not to
+ */
+void kmutex_set_inherit(int inherit);
 #endif
@@ -0,0 +1,141 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Paging
+ */
+#ifndef KPAGING_H
+#define KPAGING_H
+
+#define KPAGING_KERNEL_TOP  0x80000000  // Memory below this is identity mapped for the kernel
+#define KPAGING_TABLE_SPAN  0x400000    // Address space covered by one page table (4MB)
+
+// Page directory/table entry flags
+#define KPAGING_PRESENT     0x001       // Page is mapped
+#define KPAGING_WRITE       0x002       // Page is writable
+#define KPAGING_PWT         0x008       // Write-through caching
+#define KPAGING_PCD         0x010       // Caching disabled
+#define KPAGING_LARGE       0x080       // Directory entry maps a 4MB page
+#define KPAGING_GLOBAL      0x100       // Kept in the TLB across address space switches
+#define KPAGING_COW         0x200       // Read-only until written, then copied (software bit)
+
+#define KPAGING_FRAME_MASK  0xfffff000  // Page frame address bits of an entry
+
+#ifndef ASSEMBLER
+#include <spede/machine/asmacros.h>
+
+// Copy-on-write counters
+typedef struct kpaging_stats_t {
+    int shared;                 // Pages shared copy-on-write
+    int copied;                 // Shared pages copied when written
+} kpaging_stats_t;
+
+/**
+ * Initializes paging on the bootstrap processor
+ * Identity maps the kernel with global 4MB pages, routes page faults to
+ * a task with its own stack and turns paging on. Must be called after
+ * the local APIC has been found.
+ */
+void kpaging_init(void);
+
+/**
+ * Turns paging on for an application processor
+ * Loads the kernel page directory and the CPU's own page fault task.
+ */
+void kpaging_cpu_init(void);
+
+/**
+ * Maps a page of memory
+ * The page table covering the address is allocated if needed.
+ * @param vaddr - page aligned virtual address
+ * @param page - page to map, from kmem_page_alloc
+ * @return 0 on success, -1 on error
+ */
+int kpaging_map(unsigned int vaddr, void *page);
+
+/**
+ * Unmaps a page of memory
+ * The page itself isn't freed.
+ * @param vaddr - page aligned virtual address
+ * @return the page that was mapped, NULL if nothing was mapped
+ */
+void *kpaging_unmap(unsigned int vaddr);
+
+/**
+ * Checks whether a page is mapped
+ * @param vaddr - page aligned virtual address
+ * @return 1 if a page is mapped at the address, 0 if not
+ */
+int kpaging_present(unsigned int vaddr);
+
+/**
+ * Shares a page copy-on-write
+ * The page mapped at one address is mapped at another as well, and both
+ * mappings are made read-only; the first write to either gets its own
+ * copy. Call kpaging_shootdown once the pages have been shared.
+ * @param from - page aligned address of the mapped page
+ * @param to - page aligned address to map it at
+ * @return 0 on success, -1 on error
+ */
+int kpaging_share(unsigned int from, unsigned int to);
+
+/**
+ * Frees the page table covering an address
+ * Every page in the table must already be unmapped.
+ * @param vaddr - any address covered by the table
+ */
+void kpaging_table_free(unsigned int vaddr);
+
+/**
+ * Shows the page table covering one address at another on this CPU
+ * A forked process' stack is addressed where its parent's was, so its
+ * stack's page table is shown there while it runs. The previous alias,
+ * if any, is removed.
+ * @param vaddr - address the table should appear at
+ * @param from - address the table is mapped at; vaddr itself for no alias
+ */
+void kpaging_alias(unsigned int vaddr, unsigned int from);
+
+/**
+ * Flushes one page from this CPU's TLB, and makes the other CPUs flush
+ * theirs when they next enter the kernel
+ * The page is flushed under this CPU's alias of its table as well.
+ * @param vaddr - page aligned virtual address
+ */
+void kpaging_invalidate(unsigned int vaddr);
+
+/**
+ * Flushes this CPU's TLB and makes the other CPUs flush theirs when they
+ * next enter the kernel
+ */
+void kpaging_shootdown(void);
+
+/**
+ * Flushes this CPU's TLB if pages were unmapped since it last did so
+ * Must be called with the kernel lock held, before touching memory that
+ * another CPU may have unmapped.
+ */
+void kpaging_sync(void);
+
+/**
+ * Retrieves the copy-on-write counters
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int kpaging_get_stats(kpaging_stats_t *stats);
+
+/**
+ * Page fault handler
+ * Runs in the page fault task of the CPU that faulted.
+ * @param error - page fault error code
+ */
+void kpaging_fault(unsigned int error);
+
+__BEGIN_DECLS
+
+extern void kpaging_fault_task();
+
+__END_DECLS
+#endif
+#endif
@@ -11,24 +11,49 @@
 #include "trapframe.h"
 #include "ringbuf.h"
 #include "queue.h"
+#include "syscall_common.h"
 
 #ifndef PROC_MAX
-#define PROC_MAX        20   // maximum number of processes to support
+#define PROC_MAX        256  // maximum number of processes to support
+#endif
+
+#ifndef PROC_CHUNK
+#define PROC_CHUNK      16   // Process table entries allocated at a time
+#endif
+
+#ifndef PROC_PID_SLOT_BITS
+#define PROC_PID_SLOT_BITS 8 // Low pid bits holding the process table entry
+#endif
+
+#define PROC_PID_SLOT_MASK  ((1 << PROC_PID_SLOT_BITS) - 1)
+#define PROC_PID_GEN_MASK   (0x7fffffff >> PROC_PID_SLOT_BITS)
+
+#if PROC_MAX > (1 << PROC_PID_SLOT_BITS)
+#error "PROC_MAX entries don't fit in PROC_PID_SLOT_BITS"
 #endif
 
 #define PROC_IO_MAX     4    // Maximum process I/O buffers
 
 #define PROC_NAME_LEN   32   // Maximum length of a process name
-#define PROC_STACK_SIZE 8192 // Process stack size
+#define PROC_STACK_SIZE 0x100000 // Default process stack size (mapped as it grows)
 
 // Process types
 typedef enum proc_type_t {
     PROC_TYPE_NONE,     // Undefined/none
     PROC_TYPE_KERNEL,   // Kernel process
-    PROC_TYPE_USER      // User process
+    PROC_TYPE_USER,     // User process
+    PROC_TYPE_IDLE      // Idle task of a CPU (never queued)
 } proc_type_t;
 
 
+// Scheduling classes
+typedef enum sched_class_t {
+    SCHED_CLASS_MLFQ,   // Multilevel feedback queue (best effort)
+    SCHED_CLASS_STRIDE, // Proportional share by tickets
+    SCHED_CLASS_EDF     // Earliest deadline first (periodic)
+} sched_class_t;
+
+
 // Process States
 typedef enum state_t {
     NONE,               // Process has no state (doesn't exist)
@@ -36,6 +61,7 @@ typedef enum state_t {
     ACTIVE,             // Process is active (scheduled)
     SLEEPING,           // Process is sleeping (not scheduled)
     WAITING,            // Process is waiting (not scheduled)
+    ZOMBIE,             // Process has exited but its parent hasn't collected it
 } state_t;
 
 
@@ -43,6 +69,9 @@ typedef enum state_t {
 // Contains all details to describe a process
 typedef struct proc_t {
     int pid;                        // Process id
+    int entry;                      // Index into the process table
+    int parent;                     // Process id of the parent, -1 if none
+    struct proc_t *owner;           // Process a thread belongs to (itself for a process)
     state_t state;                  // Process state
     proc_type_t type;               // Process type (kernel or user)
 
@@ -51,13 +80,64 @@ typedef struct proc_t {
     int start_time;                 // Time started
     int run_time;                   // Total run time of the process
     int cpu_time;                   // Current CPU time the process has used
-    int sleep_time;                 // Time that a process should be sleeping
+    int sleep_time;                 // Ticks to sleep after the previous sleeper wakes
+
+    int priority;                   // Current scheduling level (0 is the highest)
+    int base_priority;              // Level the process returns to when aged
+    int inherited_priority;         // Level inherited from mutex waiters
+
+    struct mutex_t *waiting_mutex;  // Mutex the process is waiting on
+
+    int exit_status;                // Exit status kept while a zombie
+    int exit_pending;               // Ended while running on another CPU; that CPU exits it
+    int wait_child;                 // 1 while blocked waiting for a child to exit
+    int wait_pid;                   // Child being waited for, -1 for any child
+    int *wait_status;               // Where to store the child's exit status
+
+    sched_class_t sched_class;      // Scheduling class
+    int tickets;                    // Share of the CPU (stride class)
+    unsigned int stride;            // Pass increment per tick (stride class)
+    unsigned int pass;              // Virtual time used (stride class)
+
+    int period;                     // Release period in ticks (EDF class)
+    int budget;                     // CPU budget per period in ticks (EDF class)
+    int budget_left;                // Budget left in the current job
+    int release_time;               // Tick the current job was released
+    int deadline;                   // Absolute deadline of the current job
+    int job_started;                // Current job has been dispatched
+    int job_done;                   // Current job has completed
+    int release_pending;            // Waiting for the next job release
+    int throttle_pending;           // Overran its budget; throttled when its CPU next schedules
+    int deadline_misses;            // Number of deadlines missed
+    int jitter_last;                // Release jitter of the current job
+    int jitter_max;                 // Worst release jitter seen
+
+    unsigned long long user_cycles;   // TSC cycles spent running the process
+    unsigned long long kernel_cycles; // TSC cycles spent in its system calls
+    unsigned long long irq_cycles;    // TSC cycles spent in interrupts taken while it ran
+
+    int burst_avg;                  // Average CPU burst in 1/16th ticks
+
+    unsigned long long wakeup_tsc;  // TSC when the process was woken, 0 if not waiting to run
+    unsigned int latency[SCHED_LATENCY_BUCKETS]; // Wakeup-to-run latency histogram
+
+    unsigned int heap_key;          // Ordering key while in a process heap
+    int heap_index;                 // Position in a process heap, -1 if none
 
-    queue_t *scheduler_queue;       // Pointer to the queue where the process resides
+    int cpu;                        // CPU whose run queue the process is on, -1 if none
+    int handoff;                    // Handed the CPU by a directed yield; not preempted
+                                    // until the scheduler next runs
+    struct proc_list_t *scheduler_queue; // Pointer to the run list where the process resides
+    struct proc_bitmap_t *ready_set; // Pointer to the ready bitmap where the process resides
+    struct proc_t *list_next;       // Next process in the run list
+    struct proc_t *list_prev;       // Previous process in the run list
+    struct proc_t *sleep_next;      // Next process in the sleep list
 
     ringbuf_t *io[PROC_IO_MAX];     // Process input/output buffers
 
-    unsigned char *stack;           // Pointer to the process stack
+    unsigned char *stack;           // Pointer to the base of the process stack
+    int stack_size;                 // Size of the process stack
+    int home;                       // Entry whose stack region the process sees its stack in
     trapframe_t *trapframe;         // Pointer to the trapframe
 } proc_t;
 
@@ -79,18 +159,152 @@ void kproc_init(void);
  * @param proc_ptr - address of process to execute
  * @param proc_name - "friendly" process name
  * @param proc_type - process type (kernel or user)
+ * @param stack_size - stack size needed in bytes, 0 for PROC_STACK_SIZE;
+ *                     rounded up to whole pages
  * @return process id of the created process, -1 on error
  */
-int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type);
+int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type, int stack_size);
+
+/**
+ * Creates a batch of processes
+ * Every table entry and stack is reserved before any process starts,
+ * so either the whole batch is created or none of it is.
+ * @param specs - array of process descriptions
+ * @param count - number of processes to create, up to PROC_SPAWN_MAX
+ * @param proc_type - process type (kernel or user)
+ * @param pids - array to receive the process id of each process
+ * @return number of processes created, -1 on error
+ */
+int kproc_create_batch(proc_spawn_t *specs, int count, proc_type_t proc_type, int *pids);
+
+/**
+ * Sets a process' input/output pointers to the specified TTY's
+ * intput/output buffers.
+ * @param pid       - The PID of the process to attach.
+ * @param tty_index - The TTY index to attach to the process.
+ * @return -1 on error, 0 when successful.
+ */
+int kproc_attach_tty(int pid, int tty_index);
 
 /**
  * Destroys a process
- * If the process is currently scheduled it must be unscheduled
+ * If the process is currently scheduled it must be unscheduled. A process
+ * running on another CPU is destroyed by that CPU when it next enters the
+ * kernel, and a process whose threads are still running elsewhere stays
+ * a zombie until the last of them is gone; its heap is theirs too.
  * @param proc - process entry
  * @return 0 on success, -1 on error
  */
 int kproc_destroy(proc_t *proc);
 
+/**
+ * Exits a process
+ * A process with a parent becomes a zombie holding its exit status until
+ * the parent collects it with kproc_wait; any other process is destroyed.
+ * A process running on another CPU is exited by that CPU when it next
+ * enters the kernel; its other threads are ended right away.
+ * @param proc - process entry
+ * @param status - exit status
+ * @return 0 on success, -1 on error
+ */
+int kproc_exit(proc_t *proc, int status);
+
+/**
+ * Collects an exited child of a process
+ * If no matching child has exited yet, the process blocks; when a child
+ * exits, its pid is returned to the process by kproc_exit.
+ * @param proc - process entry of the parent
+ * @param pid - child to wait for, -1 for any child
+ * @param status - where to store the child's exit status, may be NULL
+ * @param threads - 1 to wait for threads, 0 for child processes
+ * @return pid of the collected child, 0 if the process blocked, -1 on error
+ */
+int kproc_wait(proc_t *proc, int pid, int *status, int threads);
+
+/**
+ * Creates a thread in the process of the given thread
+ * The thread shares the process' identity and I/O bindings but runs on
+ * its own stack. It starts in spec->start(spec->entry, spec->arg).
+ * @param creator - process entry of the creating thread
+ * @param spec - pointer to the thread description
+ * @return thread id of the new thread, -1 on error
+ */
+int kproc_thread_create(proc_t *creator, thread_spec_t *spec);
+
+/**
+ * Creates a copy of a process
+ * The child gets a copy-on-write copy of the parent's stack, addressed
+ * where the parent's is, and resumes from the same trapframe with 0 as
+ * the system call's return value. It inherits the parent's I/O bindings.
+ * A process with live threads can't fork: another CPU could keep writing
+ * to a shared page through a stale TLB entry.
+ * @param parent - process entry of the forking process
+ * @return process id of the child, -1 on error
+ */
+int kproc_fork(proc_t *parent);
+
+/**
+ * Moves the break of a process' heap
+ * Threads share the heap of their process. The break can't be lowered
+ * while the process has threads, as one running on another CPU could
+ * keep writing to the freed pages until it next enters the kernel.
+ * @param proc - process entry
+ * @param brk - new end of the heap in the kernel's view, NULL to leave it
+ * @return end of the heap as the process sees it, NULL on error
+ */
+void *kproc_brk(proc_t *proc, void *brk);
+
+/**
+ * Translates an address in a process' stack to the one valid on every CPU
+ * A forked process sees its stack where its parent's was; the kernel
+ * addresses it in its own region.
+ * @param proc - process entry
+ * @param addr - address as the process sees it
+ * @return address in the kernel's view
+ */
+void *kproc_global_addr(proc_t *proc, void *addr);
+
+/**
+ * Translates an address in the kernel's view to the one a process sees
+ * @param proc - process entry
+ * @param addr - address in the kernel's view
+ * @return address as the process sees it
+ */
+void *kproc_local_addr(proc_t *proc, void *addr);
+
+/**
+ * Switches this CPU to the kernel's view of memory on entry to the kernel
+ * @param proc - process entry of the interrupted process
+ * @param trapframe - trapframe as the process saw it
+ * @return trapframe in the kernel's view
+ */
+trapframe_t *kproc_enter(proc_t *proc, trapframe_t *trapframe);
+
+/**
+ * Switches this CPU to a process' view of memory before running it
+ * @param proc - process entry
+ * @return trapframe as the process sees it
+ */
+trapframe_t *kproc_resume(proc_t *proc);
+
+/**
+ * Checks that a process hasn't overflowed its stack
+ * The guard page below the stack catches overflows as they happen; this
+ * checks that the saved trapframe lies within the stack.
+ * @param proc - process entry
+ * @return 0 if the stack is intact, -1 if it has overflowed
+ */
+int kproc_stack_check(proc_t *proc);
+
+/**
+ * Returns the most stack a process has used
+ * Stack pages are only mapped once touched and stay mapped until the
+ * process exits, so this is the mapped part of the stack.
+ * @param proc - process entry
+ * @return number of bytes used at the high-water mark, -1 on error
+ */
+int kproc_stack_peak(proc_t *proc);
+
 /**
  * Looks up a process in the process table via the process id
  * @param pid - process id
@@ -105,6 +319,12 @@ proc_t *pid_to_proc(int pid);
  */
 proc_t *entry_to_proc(int entry);
 
+/**
+ * Idle process
+ * Each CPU has one, run whenever there is nothing else to do.
+ */
+void kproc_idle(void);
+
 /**
  * Test process
  */
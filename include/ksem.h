@@ -55,4 +55,10 @@ int ksem_wait(int id);
  * @return -1 on error, otherwise the current semaphore count
  */
 int ksem_post(int id);
+
+/**
+ * Removes a process that is going away from every semaphore wait queue
+ * @param proc - pointer to the process entry
+ */
+void ksem_forget(proc_t *proc);
 #endif
@@ -61,8 +61,9 @@ int ksyscall_proc_sleep(int seconds);
 
 /**
  * Exits the current process
+ * @param status - exit status for the parent process
  */
-int ksyscall_proc_exit(void);
+int ksyscall_proc_exit(int status);
 
 /**
  * Gets the current process' id
@@ -77,6 +78,124 @@ int ksyscall_proc_get_pid(void);
  */
 int ksyscall_proc_get_name(char *name);
 
+/**
+ * Sets the scheduling priority of a process
+ * @param pid - process id
+ * @param priority - priority level (0 is the highest)
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_set_priority(int pid, int priority);
+
+/**
+ * Sets the CPU share of a process
+ * @param pid - process id
+ * @param tickets - number of tickets, 0 to return to priority scheduling
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_set_tickets(int pid, int tickets);
+
+/**
+ * Makes the active process periodic
+ * @param period - release period in ticks, 0 to stop being periodic
+ * @param budget - CPU budget per period in ticks
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_set_periodic(int period, int budget);
+
+/**
+ * Completes the active process' current job and waits for the next period
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_wait_period(void);
+
+/**
+ * Gets the statistics of a process
+ * @param pid - process id
+ * @param stats - pointer to the statistics structure to fill in
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_get_stats(int pid, proc_stats_t *stats);
+
+/**
+ * Gets a wakeup-to-run latency histogram
+ * @param pid - process id, -1 for the system-wide histogram
+ * @param hist - buffer of SCHED_LATENCY_BUCKETS counters to fill in
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_get_latency(int pid, unsigned int *hist);
+
+/**
+ * Gives up the CPU to the next process waiting to run
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_yield(void);
+
+/**
+ * Gives up the CPU to the specified process
+ * @param pid - id of a process waiting to run
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_yield_to(int pid);
+
+/**
+ * Creates a new process
+ * @param spec - pointer to the process description
+ * @return process id of the new process, -1 on error
+ */
+int ksyscall_proc_spawn(proc_spawn_t *spec);
+
+/**
+ * Creates a batch of processes
+ * @param specs - array of process descriptions
+ * @param count - number of processes
+ * @param pids - array to receive the process id of each process
+ * @return number of processes created, -1 on error
+ */
+int ksyscall_proc_spawn_batch(proc_spawn_t *specs, int count, int *pids);
+
+/**
+ * Waits for a child of the current process to exit
+ * @param pid - child to wait for, -1 for any child
+ * @param status - where to store the child's exit status, may be NULL
+ * @return pid of the child that exited, -1 on error
+ */
+int ksyscall_proc_wait(int pid, int *status);
+
+/**
+ * Creates a thread in the current process
+ * @param spec - pointer to the thread description
+ * @return thread id of the new thread, -1 on error
+ */
+int ksyscall_thread_create(thread_spec_t *spec);
+
+/**
+ * Exits the current thread
+ * @param status - exit status for the thread that created it
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_thread_exit(int status);
+
+/**
+ * Waits for a thread created by the current thread to exit
+ * @param tid - thread to wait for, -1 for any
+ * @param status - where to store the thread's exit status, may be NULL
+ * @return thread id of the thread that exited, -1 on error
+ */
+int ksyscall_thread_join(int tid, int *status);
+
+/**
+ * Creates a copy-on-write copy of the current process
+ * @return process id of the child to the parent, 0 to the child, -1 on error
+ */
+int ksyscall_proc_fork(void);
+
+/**
+ * Moves the end of the current process' heap
+ * @param brk - new end of the heap, NULL to leave it
+ * @return end of the heap, NULL on error
+ */
+void *ksyscall_proc_brk(void *brk);
+
 /**
  * Allocates a mutex from the kernel
  * @return -1 on error, all other values indicate the mutex id
@@ -0,0 +1,52 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process ready bitmaps
+ */
+#ifndef PROC_BITMAP_H
+#define PROC_BITMAP_H
+
+#include "kproc.h"
+#include "bit_util.h"
+
+// Set of runnable processes indexed by process table entry
+// Bit (entry + 1) is set while the process is in the set. Processes are
+// picked in round-robin order of their entries, starting after the one
+// picked last, so picking is a bit scan rather than a list walk. Each
+// process records the set it is in in proc_t.ready_set.
+typedef struct proc_bitmap_t {
+    unsigned int bits[BITMAP_WORDS(PROC_MAX)]; // Bit per process table entry
+    int cursor;                 // Bit of the process picked last
+    int size;                   // Number of processes in the set
+} proc_bitmap_t;
+
+/**
+ * Initializes an empty set
+ * @param set - pointer to the set
+ */
+void proc_bitmap_init(proc_bitmap_t *set);
+
+/**
+ * Adds a process to the set
+ * @param set - pointer to the set
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int proc_bitmap_add(proc_bitmap_t *set, proc_t *proc);
+
+/**
+ * Removes a process from the set it is in
+ * @param proc - pointer to the process entry
+ */
+void proc_bitmap_remove(proc_t *proc);
+
+/**
+ * Removes and returns the next process after the cursor
+ * @param set - pointer to the set
+ * @return pointer to the process entry, NULL if the set is empty
+ */
+proc_t *proc_bitmap_pop(proc_bitmap_t *set);
+
+#endif
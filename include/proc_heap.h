@@ -0,0 +1,57 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process priority heap
+ */
+#ifndef PROC_HEAP_H
+#define PROC_HEAP_H
+
+#include "kproc.h"
+
+// Binary min-heap of processes ordered by proc_t.heap_key
+// Keys may wrap around as long as the live keys span less than 2^31.
+// Each process records its position in proc_t.heap_index (-1 when it
+// is not in a heap) so it can be removed without searching.
+typedef struct proc_heap_t {
+    int size;                   // Number of processes in the heap
+    proc_t *items[PROC_MAX];    // Heap storage
+} proc_heap_t;
+
+/**
+ * Initializes an empty heap
+ * @param heap - pointer to the heap
+ */
+void proc_heap_init(proc_heap_t *heap);
+
+/**
+ * Adds a process to the heap using its current heap key
+ * @param heap - pointer to the heap
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int proc_heap_insert(proc_heap_t *heap, proc_t *proc);
+
+/**
+ * Removes a process from the heap
+ * @param heap - pointer to the heap
+ * @param proc - pointer to the process entry
+ */
+void proc_heap_remove(proc_heap_t *heap, proc_t *proc);
+
+/**
+ * Returns the process with the lowest key without removing it
+ * @param heap - pointer to the heap
+ * @return pointer to the process entry, NULL if the heap is empty
+ */
+proc_t *proc_heap_peek(proc_heap_t *heap);
+
+/**
+ * Removes and returns the process with the lowest key
+ * @param heap - pointer to the heap
+ * @return pointer to the process entry, NULL if the heap is empty
+ */
+proc_t *proc_heap_pop(proc_heap_t *heap);
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process run lists
+ */
+#ifndef PROC_LIST_H
+#define PROC_LIST_H
+
+#include "kproc.h"
+
+// Doubly linked FIFO list of processes
+// The links are embedded in proc_t (list_next/list_prev) and each process
+// records the list it is on in proc_t.scheduler_queue, so a process can
+// be on at most one list and is added or removed in constant time.
+typedef struct proc_list_t {
+    int size;                   // Number of processes in the list
+    proc_t *head;               // First process in the list
+    proc_t *tail;               // Last process in the list
+} proc_list_t;
+
+/**
+ * Initializes an empty list
+ * @param list - pointer to the list
+ */
+void proc_list_init(proc_list_t *list);
+
+/**
+ * Adds a process to the end of the list
+ * @param list - pointer to the list
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int proc_list_append(proc_list_t *list, proc_t *proc);
+
+/**
+ * Removes a process from the list it is on
+ * @param proc - pointer to the process entry
+ */
+void proc_list_remove(proc_t *proc);
+
+/**
+ * Removes and returns the process at the front of the list
+ * @param list - pointer to the list
+ * @return pointer to the process entry, NULL if the list is empty
+ */
+proc_t *proc_list_pop(proc_list_t *list);
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process stacks
+ *
+ * Each process table entry owns a PROC_STACK_REGION of address space in
+ * the stack area. A stack is reserved at the top of its region and only
+ * its top page is mapped up front; lower pages are mapped as the stack
+ * grows into them. The page below the reservation is never mapped, so an
+ * overflow faults instead of running into another stack.
+ *
+ * The bottom of the region holds the process heap, which grows up to its
+ * break as the process moves it. Heap pages are mapped, zeroed, when
+ * first touched. The heap starts out one page long so a user allocator
+ * always has somewhere to keep its state.
+ */
+#ifndef PROC_STACK_H
+#define PROC_STACK_H
+
+#include "kmem.h"
+#include "kpaging.h"
+
+#define PROC_STACK_AREA     KPAGING_KERNEL_TOP  // Start of the stack area
+#define PROC_STACK_REGION   KPAGING_TABLE_SPAN  // Address space of each process table entry
+#define PROC_STACK_MAX      (PROC_STACK_REGION - 2 * KMEM_PAGE_SIZE) // Largest stack; leaves a guard page and the first heap page
+
+// Usage of the process stacks
+typedef struct proc_stack_stats_t {
+    int stacks;                 // Stacks allocated
+    int resident;               // Pages mapped into stacks
+    int peak;                   // Most pages ever mapped into stacks at once
+    int faults;                 // Faults that grew a stack
+    int heap;                   // Pages mapped into heaps
+} proc_stack_stats_t;
+
+/**
+ * Initializes the process stacks
+ */
+void proc_stack_init(void);
+
+/**
+ * Rounds a stack size up to whole pages
+ * @param size - requested stack size in bytes
+ * @return stack size in bytes, -1 if the request is too large
+ */
+int proc_stack_size(int size);
+
+/**
+ * Allocates the stack of a process table entry
+ * Only the top page is mapped. The heap starts out one page long.
+ * @param entry - process table entry
+ * @param size - stack size in bytes; must be a whole number of pages
+ * @return pointer to the base of the stack, NULL on error
+ */
+unsigned char *proc_stack_alloc(int entry, int size);
+
+/**
+ * Allocates the stack of a process table entry as a copy-on-write copy of
+ * another entry's stack
+ * The copy is as large as the original and placed as far below the top of
+ * its region, so offsets into the stack carry over. The heap is copied
+ * the same way. Every page mapped in the original is shared until either
+ * side writes to it.
+ * @param entry - process table entry of the copy
+ * @param from - process table entry whose stack is copied
+ * @return pointer to the base of the copy, NULL on error
+ */
+unsigned char *proc_stack_fork(int entry, int from);
+
+/**
+ * Frees the stack and heap of a process table entry and every page
+ * mapped into them
+ * @param entry - process table entry
+ */
+void proc_stack_free(int entry);
+
+/**
+ * Maps the memory a faulting access needs
+ * Below the break, the heap page holding the address is mapped. In the
+ * stack, every page from the one holding the address up to the part of
+ * the stack already mapped is, plus a spare page below.
+ * @param addr - faulting address
+ * @return 0 on success, -1 if the address isn't in a stack or heap or out of memory
+ */
+int proc_stack_fault(unsigned int addr);
+
+/**
+ * Moves the break of a process table entry's heap
+ * Pages above a lowered break are unmapped and freed.
+ * @param entry - process table entry
+ * @param brk - new end of the heap; at most a guard page below the stack
+ * @return 0 on success, -1 on error
+ */
+int proc_stack_set_brk(int entry, unsigned int brk);
+
+/**
+ * Returns the break of a process table entry's heap
+ * @param entry - process table entry
+ * @return end of the heap, 0 if the entry has no stack
+ */
+unsigned int proc_stack_get_brk(int entry);
+
+/**
+ * Returns the start of a process table entry's heap
+ * @param entry - process table entry
+ * @return start of the heap, the bottom of the entry's region
+ */
+unsigned int proc_stack_heap(int entry);
+
+/**
+ * Returns the process table entry whose region holds an address
+ * @param addr - address
+ * @return process table entry, -1 if the address isn't in the stack area
+ */
+int proc_stack_entry(unsigned int addr);
+
+/**
+ * Returns how much of a stack is mapped
+ * @param entry - process table entry
+ * @return number of bytes mapped, 0 if the entry has no stack
+ */
+int proc_stack_resident(int entry);
+
+/**
+ * Retrieves the usage of the process stacks
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int proc_stack_get_stats(proc_stack_stats_t *stats);
+
+#endif
@@ -11,9 +11,58 @@
 #include "kproc.h"
 
 #ifndef SCHEDULER_TIMESLICE
-#define SCHEDULER_TIMESLICE 10
+#define SCHEDULER_TIMESLICE 10              // Initial timeslice of a new process
 #endif
 
+#ifndef SCHEDULER_TIMESLICE_MIN
+#define SCHEDULER_TIMESLICE_MIN 1           // Shortest adaptive timeslice
+#endif
+
+#ifndef SCHEDULER_TIMESLICE_MAX
+#define SCHEDULER_TIMESLICE_MAX 80          // Longest adaptive timeslice
+#endif
+
+#ifndef SCHEDULER_BURST_WEIGHT
+#define SCHEDULER_BURST_WEIGHT 3            // Each burst moves the average by 1/8
+#endif
+
+#define SCHEDULER_BURST_SHIFT 4             // Fraction bits of the burst average
+
+#ifndef SCHEDULER_LEVELS
+#define SCHEDULER_LEVELS 4          // Number of priority levels (0 is the highest)
+#endif
+
+#ifndef SCHEDULER_STRIDE_LEVEL
+#define SCHEDULER_STRIDE_LEVEL 1    // Level the stride class band runs at, ahead of MLFQ processes on it
+#endif
+
+#ifndef SCHEDULER_BITMAP
+#define SCHEDULER_BITMAP 0          // 1 to keep each level as a ready bitmap instead of a list
+#endif
+
+#ifndef SCHEDULER_BOOST_INTERVAL
+#define SCHEDULER_BOOST_INTERVAL 100 // Ticks between aging passes
+#endif
+
+#ifndef SCHEDULER_CLASS_DEFAULT
+#define SCHEDULER_CLASS_DEFAULT SCHED_CLASS_MLFQ // Class of new processes
+#endif
+
+#ifndef SCHEDULER_TICKETS_DEFAULT
+#define SCHEDULER_TICKETS_DEFAULT 100 // Tickets of new processes
+#endif
+
+#define SCHEDULER_TICKETS_MAX   1000    // Maximum tickets per process
+#define SCHEDULER_STRIDE1       (1 << 20) // Stride of a process with one ticket
+
+#define SCHEDULER_EDF_UTIL_SCALE 1000   // EDF utilization of 100%
+
+// Scheduler activity since startup
+typedef struct scheduler_stats_t {
+    unsigned int switches;              // Times a CPU switched to a different process
+    unsigned int wakeups;               // Woken processes that have run
+    unsigned long long wakeup_cycles;   // Total wakeup-to-run latency of those, in TSC cycles
+} scheduler_stats_t;
 
 /**
  * Initializes the scheduler, data structures, etc.
@@ -38,11 +87,121 @@ void scheduler_add(proc_t *proc);
  */
 void scheduler_remove(proc_t *proc);
 
+/**
+ * Scheduler timer callback
+ * Charges the ticks since it last ran to the running processes and wakes
+ * the sleepers that are due.
+ */
+void scheduler_timer(void);
+
 /**
  * Puts a process to sleep
  * @param proc - pointer to the process entry
- * @param seconds - number of seconds to sleep
+ * @param ticks - number of timer ticks to sleep
+ */
+void scheduler_sleep(proc_t *proc, int ticks);
+
+/**
+ * Returns the number of ticks until the next sleeping process wakes
+ * @return number of ticks, -1 if no process is sleeping
+ */
+int scheduler_next_wakeup(void);
+
+/**
+ * Returns the priority level a process is scheduled at
+ * This is the higher of its own priority and any inherited priority.
+ * @param proc - pointer to the process entry
+ * @return priority level (0 is the highest)
+ */
+int scheduler_priority(proc_t *proc);
+
+/**
+ * Sets the priority a process inherits from the processes it blocks
+ * The process is moved to its new effective priority level immediately.
+ * @param proc - pointer to the process entry
+ * @param priority - inherited priority level, SCHEDULER_LEVELS for none
+ */
+void scheduler_inherit_priority(proc_t *proc, int priority);
+
+/**
+ * Sets the base priority of a process
+ * The process is moved to the new priority level immediately.
+ * @param proc - pointer to the process entry
+ * @param priority - priority level (0 is the highest)
+ * @return 0 on success, -1 on error
+ */
+int scheduler_set_priority(proc_t *proc, int priority);
+
+/**
+ * Sets the number of tickets held by a process
+ * A process with tickets is scheduled by the stride class and receives
+ * a share of the stride band's CPU time proportional to its tickets.
+ * Zero tickets moves the process back to the multilevel feedback queue.
+ * @param proc - pointer to the process entry
+ * @param tickets - number of tickets, 0 for none
+ * @return 0 on success, -1 on error
+ */
+int scheduler_set_tickets(proc_t *proc, int tickets);
+
+/**
+ * Makes a process periodic under the EDF class
+ * Admission fails if the total utilization (budget / period) of all
+ * periodic processes would exceed 100%. The first job is released
+ * immediately. A period of 0 returns the process to the multilevel
+ * feedback queue.
+ * @param proc - pointer to the process entry
+ * @param period - release period in ticks, 0 for none
+ * @param budget - CPU budget per period in ticks
+ * @return 0 on success, -1 on error
+ */
+int scheduler_set_periodic(proc_t *proc, int period, int budget);
+
+/**
+ * Completes the current job of an EDF process
+ * The process waits until its next job is released.
+ * @param proc - pointer to the process entry
+ * @return 0 on success, -1 on error
+ */
+int scheduler_wait_period(proc_t *proc);
+
+/**
+ * Copies a wakeup-to-run latency histogram
+ * @param proc - pointer to the process entry, NULL for the system-wide histogram
+ * @param hist - buffer of SCHED_LATENCY_BUCKETS counters to copy to
+ * @return 0 on success, -1 on error
+ */
+int scheduler_get_latency(proc_t *proc, unsigned int *hist);
+
+/**
+ * Copies the scheduler's activity counters
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int scheduler_get_stats(scheduler_stats_t *stats);
+
+/**
+ * Selects adaptive or fixed timeslices
+ * @param adaptive - 1 to size slices from each process' bursts, 0 to give
+ *                   every process SCHEDULER_TIMESLICE
+ */
+void scheduler_set_adaptive(int adaptive);
+
+/**
+ * Gives up the CPU
+ * The process goes to the back of its run queue without being demoted.
+ * @param proc - pointer to the active process entry
+ * @return 0 on success, -1 on error
+ */
+int scheduler_yield(proc_t *proc);
+
+/**
+ * Hands the CPU directly to another runnable process
+ * The target runs next on this CPU for the rest of the caller's
+ * timeslice, and the caller goes to the back of its run queue.
+ * @param proc - pointer to the active process entry
+ * @param target - pointer to the process entry to run
+ * @return 0 on success, -1 on error
  */
-void scheduler_sleep(proc_t *proc, int seconds);
+int scheduler_yield_to(proc_t *proc, proc_t *target);
 
 #endif
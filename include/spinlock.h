@@ -0,0 +1,37 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Spinlock Definitions
+ */
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+// Spinlock
+// Busy-waits until the lock is free. Kernel code runs with interrupts
+// disabled, so a lock is never taken by an interrupt on the same CPU.
+typedef struct spinlock_t {
+    volatile int locked;        // 1 while held
+    int cpu;                    // CPU holding the lock, -1 if free
+} spinlock_t;
+
+/**
+ * Initializes a spinlock in the unlocked state
+ * @param lock - pointer to the spinlock
+ */
+void spin_init(spinlock_t *lock);
+
+/**
+ * Acquires a spinlock, waiting until it is free
+ * @param lock - pointer to the spinlock
+ */
+void spin_lock(spinlock_t *lock);
+
+/**
+ * Releases a spinlock
+ * @param lock - pointer to the spinlock
+ */
+void spin_unlock(spinlock_t *lock);
+
+#endif
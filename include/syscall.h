@@ -48,6 +48,144 @@ void proc_sleep(int seconds);
  */
 void proc_exit(int exitcode);
 
+/**
+ * Sets the scheduling priority of a process
+ * @param pid - process id
+ * @param priority - priority level (0 is the highest)
+ * @return 0 on success, -1 on error
+ */
+int proc_set_priority(int pid, int priority);
+
+/**
+ * Sets the CPU share of a process
+ * A process with tickets receives CPU time in proportion to its tickets
+ * relative to the other processes holding tickets.
+ * @param pid - process id
+ * @param tickets - number of tickets, 0 to return to priority scheduling
+ * @return 0 on success, -1 on error
+ */
+int proc_set_tickets(int pid, int tickets);
+
+/**
+ * Makes the current process periodic
+ * A new job is released every period and scheduled by its deadline (the
+ * next release) ahead of other processes. A job that runs for longer
+ * than its budget is suspended until the next release.
+ * @param period - release period in ticks, 0 to stop being periodic
+ * @param budget - CPU budget per period in ticks
+ * @return 0 on success, -1 on error or if the budget can't be guaranteed
+ */
+int proc_set_periodic(int period, int budget);
+
+/**
+ * Completes the current job and waits for the next period
+ * @return 0 on success, -1 on error
+ */
+int proc_wait_period(void);
+
+/**
+ * Gets the statistics of a process
+ * @param pid - process id
+ * @param stats - pointer to the statistics structure to fill in
+ * @return 0 on success, -1 on error
+ */
+int proc_get_stats(int pid, proc_stats_t *stats);
+
+/**
+ * Gets a wakeup-to-run latency histogram
+ * @param pid - process id, -1 for the system-wide histogram
+ * @param hist - buffer of SCHED_LATENCY_BUCKETS counters to fill in
+ * @return 0 on success, -1 on error
+ */
+int proc_get_latency(int pid, unsigned int *hist);
+
+/**
+ * Gives up the CPU to the next process waiting to run
+ * @return 0 on success, -1 on error
+ */
+int proc_yield(void);
+
+/**
+ * Gives up the CPU to the specified process
+ * The process runs immediately for the rest of the caller's timeslice.
+ * @param pid - id of a process waiting to run
+ * @return 0 on success, -1 if the process isn't waiting to run
+ */
+int proc_yield_to(int pid);
+
+/**
+ * Creates a new process
+ * @param entry - function the process starts in
+ * @param name - process name
+ * @param stack_size - stack size needed in bytes, 0 for the default
+ * @param tty - TTY to attach the process to, -1 to share the caller's
+ * @return process id of the new process, -1 on error
+ */
+int proc_spawn(void *entry, char *name, int stack_size, int tty);
+
+/**
+ * Creates a batch of processes in a single system call
+ * Either every process is created or none are.
+ * @param specs - array of process descriptions
+ * @param count - number of processes, up to PROC_SPAWN_MAX
+ * @param pids - array to receive the process id of each process
+ * @return number of processes created, -1 on error
+ */
+int proc_spawn_batch(proc_spawn_t *specs, int count, int *pids);
+
+/**
+ * Waits for a child process to exit
+ * Blocks until the child exits unless it already has.
+ * @param pid - child to wait for, -1 for any child
+ * @param status - where to store the child's exit code, may be NULL
+ * @return pid of the child that exited, -1 if there is no such child
+ */
+int proc_wait(int pid, int *status);
+
+/**
+ * Creates a copy of the current process
+ * The child resumes here with a copy-on-write copy of the stack and the
+ * same TTY. Only the main thread of a process can fork.
+ * @return process id of the child to the parent, 0 to the child, -1 on error
+ */
+int proc_fork(void);
+
+/**
+ * Moves the end of the process heap
+ * The heap grows up from the bottom of the process' address space and
+ * may reach to a guard page below the stack. Pages are mapped when first
+ * touched; pages above a lowered end are freed. Threads share the heap
+ * of their process, and it can't be lowered while the process has them.
+ * @param brk - new end of the heap, NULL to leave it
+ * @return end of the heap, NULL on error
+ */
+void *proc_brk(void *brk);
+
+/**
+ * Creates a thread in the current process
+ * The thread shares the process' id, name and I/O buffers. Returning
+ * from the thread function exits the thread with the returned value.
+ * @param entry - function the thread runs
+ * @param arg - argument passed to the function
+ * @param stack_size - stack size needed in bytes, 0 for the default
+ * @return thread id of the new thread, -1 on error
+ */
+int thread_create(int (*entry)(void *), void *arg, int stack_size);
+
+/**
+ * Exits the current thread
+ * @param status - exit status for the thread that created it
+ */
+void thread_exit(int status);
+
+/**
+ * Waits for a thread created by the current thread to exit
+ * @param tid - thread to wait for, -1 for any
+ * @param status - where to store the thread's exit status, may be NULL
+ * @return thread id of the thread that exited, -1 if there is no such thread
+ */
+int thread_join(int tid, int *status);
+
 /**
  * Writes up to n bytes to the process' specified IO buffer
  * @param io - the IO buffer to write to
@@ -11,6 +11,14 @@
 #define PROC_IO_IN      0       // IO Input Id
 #define PROC_IO_OUT     1       // IO Output Id
 
+// Address space of each process: its stack at the top and its heap at
+// the bottom
+#define PROC_REGION_SIZE 0x400000
+
+// Number of wakeup latency histogram buckets; bucket n counts latencies
+// of 2^n to 2^(n+1)-1 TSC cycles and the last bucket everything longer
+#define SCHED_LATENCY_BUCKETS 32
+
 // Syscall identifiers
 typedef enum {
     SYSCALL_NONE,
@@ -30,8 +38,71 @@ typedef enum {
     SYSCALL_SEM_INIT,
     SYSCALL_SEM_DESTROY,
     SYSCALL_SEM_WAIT,
-    SYSCALL_SEM_POST
+    SYSCALL_SEM_POST,
+    SYSCALL_PROC_SET_PRIORITY,
+    SYSCALL_PROC_SET_TICKETS,
+    SYSCALL_PROC_SET_PERIODIC,
+    SYSCALL_PROC_WAIT_PERIOD,
+    SYSCALL_PROC_GET_STATS,
+    SYSCALL_PROC_GET_LATENCY,
+    SYSCALL_PROC_YIELD,
+    SYSCALL_PROC_YIELD_TO,
+    SYSCALL_PROC_SPAWN,
+    SYSCALL_PROC_SPAWN_BATCH,
+    SYSCALL_PROC_WAIT,
+    SYSCALL_THREAD_CREATE,
+    SYSCALL_THREAD_EXIT,
+    SYSCALL_THREAD_JOIN,
+    SYSCALL_PROC_FORK,
+    SYSCALL_PROC_BRK
 } syscall_t;
 
+#define PROC_SPAWN_MAX  32      // Most processes created by one batched spawn
+
+// Description of a process to spawn
+typedef struct proc_spawn_t {
+    void *entry;            // Function the process starts in
+    char *name;             // Process name
+    int stack_size;         // Stack size needed in bytes, 0 for the default
+    int tty;                // TTY to attach to, -1 to share the caller's
+} proc_spawn_t;
+
+// Description of a thread to create
+typedef struct thread_spec_t {
+    void *start;            // Startup routine, called as start(entry, arg)
+    void *entry;            // Function the thread runs
+    void *arg;              // Argument passed to the function
+    int stack_size;         // Stack size needed in bytes, 0 for the default
+} thread_spec_t;
+
+// Process statistics
+typedef struct proc_stats_t {
+    int pid;                // Process id
+    int period;             // Release period in ticks, 0 if not periodic
+    int budget;             // CPU budget per period in ticks
+    int deadline_misses;    // Number of deadlines missed
+    int jitter_last;        // Release jitter of the current job in ticks
+    int jitter_max;         // Worst release jitter seen in ticks
+    unsigned long long user_cycles;     // TSC cycles spent running
+    unsigned long long kernel_cycles;   // TSC cycles spent in system calls
+    unsigned long long irq_cycles;      // TSC cycles spent in interrupts
+    unsigned int tsc_hz;                // TSC cycles per second
+    int stack_size;         // Size of the process stack in bytes
+    int stack_peak;         // Most stack used in bytes
+    int pages_shared;       // Pages shared copy-on-write by forks (system-wide)
+    int pages_copied;       // Shared pages copied when written (system-wide)
+    int heap_size;          // Size of the process heap in bytes
+    int stack_pages;        // Pages mapped into stacks (system-wide)
+    int stack_pages_peak;   // Most pages ever mapped into stacks at once (system-wide)
+    int stack_faults;       // Faults that grew a stack (system-wide)
+} proc_stats_t;
+
+// Kept by the kernel at the top of every process and thread stack, so
+// user code can find it from any address in the stack
+typedef struct proc_info_t {
+    void *heap;             // Start of the process heap
+    int reserved;           // Keeps the trapframe below 8-byte aligned
+} proc_info_t;
+
 #endif
 
@@ -13,6 +13,114 @@
 #include "vga.h"
 #include "tty.h"
 #include "kproc.h"
+#include "scheduler.h"
+#include "tsc.h"
+#include "queue.h"
+#include "proc_list.h"
+#include "proc_bitmap.h"
+#include "cpu.h"
+#include "syscall.h"
+#include "kheap.h"
+#include "kmutex.h"
+#include "ksem.h"
+
+#ifndef TEST_LATENCY_TTY
+#define TEST_LATENCY_TTY 5  // TTY showing the scheduling latency histogram
+#endif
+
+#ifndef TEST_BENCH_TTY
+#define TEST_BENCH_TTY 6    // TTY showing benchmark results
+#endif
+
+#ifndef TEST_KHEAP_TTY
+#define TEST_KHEAP_TTY 7    // TTY showing the kernel heap caches
+#endif
+
+#ifndef TEST_BENCH
+#define TEST_BENCH 1        // 1 to run the benchmarks at startup
+#endif
+
+#define TEST_BENCH_ROWS 20  // Lines of benchmark results
+
+#define TEST_BENCH_LOOPS 1000   // Iterations timed by each benchmark
+#define TEST_BENCH_PROCS 16     // Runnable processes in the run queue benchmarks
+#define TEST_BENCH_SLEEP (1 << 30) // Sleep time of the tick benchmark's sleepers, never reached
+
+#define TEST_YIELD_TRIPS 200   // Round trips timed each way by the ping/pong test
+
+#define TEST_SLICE_PROCS 2      // Spinning processes in the timeslice test
+#define TEST_SLICE_TICKS 1000   // Length of each half of the timeslice test
+
+#define TEST_SMP_PROCS 4        // Spinning processes in the SMP scaling test
+#define TEST_SMP_TICKS 1000     // Length of the SMP scaling test
+
+#define TEST_STRIDE_PROCS 3     // Stride processes in the share test
+#define TEST_STRIDE_TICKS 10000 // Length of the share test
+
+#define TEST_LOCK_SPINNERS 2    // Middle priority spinners in the lock latency test
+#define TEST_LOCK_HOLD 5        // Ticks the low priority owner holds the lock at a time
+#define TEST_LOCK_TICKS 2000    // Length of each half of the lock latency test
+
+// Benchmark results, one line each, and the number of lines in use
+char test_bench_text[TEST_BENCH_ROWS][VGA_WIDTH+1];
+int test_bench_rows = 0;
+
+// Stand-in process entries for the run queue benchmarks
+proc_t test_bench_procs[TEST_BENCH_PROCS];
+
+// Semaphore ping/pong test processes and their semaphores (-1 until ping
+// creates them), its line of results, 1 while pong hands the CPU back
+// with proc_yield_to, the average cost of a round trip without and with
+// it, and 1 once ping is done
+int test_yield_pids[2] = { -1, -1 };
+volatile int test_yield_sems[2] = { -1, -1 };
+int test_yield_row = -1;
+volatile int test_yield_handoff = 0;
+volatile unsigned int test_yield_cycles[2];
+volatile int test_yield_done = 0;
+
+// Timeslice test processes, the half it is in (adaptive, then fixed, -1
+// when not running), when that half started and its first line of results
+int test_slice_pids[TEST_SLICE_PROCS];
+int test_slice_phase = -1;
+int test_slice_start = 0;
+int test_slice_row = -1;
+scheduler_stats_t test_slice_stats;
+
+// SMP scaling test processes, when the test started (-1 when not
+// running) and its line of results, with the TSC and the time all CPUs
+// had spent waiting for the kernel lock when it started
+int test_smp_pids[TEST_SMP_PROCS];
+int test_smp_start = -1;
+int test_smp_row = -1;
+unsigned long long test_smp_tsc;
+unsigned long long test_smp_lock;
+
+// Test loading the CPUs: 0 timeslices, 1 SMP scaling, 2 stride share,
+// 3 lock latency, -1 when none is left. They run one after another so they don't
+// compete for the CPUs.
+int test_bench_stage = -1;
+
+// Stride share test processes, their tickets, when the test started and
+// its first line of results
+int test_stride_pids[TEST_STRIDE_PROCS];
+int test_stride_tickets[TEST_STRIDE_PROCS] = { 100, 200, 300 };
+int test_stride_start = -1;
+int test_stride_row = -1;
+
+// Lock latency test processes (waiter, owner, then spinners), its mutex,
+// the half it is in (inheritance, then none, -1 when not running), when
+// that half started and its line of results, how long the owner holds
+// the lock in TSC cycles, and the worst wait and number of waits in each
+// half
+int test_lock_pids[2 + TEST_LOCK_SPINNERS];
+int test_lock_mutex = -1;
+volatile int test_lock_phase = -1;
+int test_lock_start = 0;
+int test_lock_row = -1;
+unsigned long long test_lock_hold;
+volatile unsigned int test_lock_max[2];
+volatile int test_lock_waits[2];
 
 /**
  * Displays a "spinner" to show activity at the top-right corner of the
@@ -58,10 +166,10 @@ void test_proc_list(void) {
         }
     }
 
-    snprintf(buf, VGA_WIDTH, "Entry    PID   State    Time     CPU    Name");
+    snprintf(buf, VGA_WIDTH, "Entry    PID   State  Pri   Time     CPU    User     Sys     IRQ  Stack  Name");
     vga_puts_at(0, 0, bg_color, fg_color, buf);
 
-    for (int i = 0; i < PROC_MAX; i++) {
+    for (int i = 0; i < PROC_MAX && row < VGA_HEIGHT; i++) {
         snprintf(buf, VGA_WIDTH, "%*s", VGA_WIDTH, " ");
 
         proc_t *proc = entry_to_proc(i);
@@ -96,14 +204,21 @@ void test_proc_list(void) {
                 fg_color = VGA_COLOR_BROWN;
                 break;
 
+            case ZOMBIE:
+                state = 'Z';
+                fg_color = VGA_COLOR_DARK_GREY;
+                break;
+
             default:
                 state = '?';
                 fg_color = VGA_COLOR_DARK_GREY;
                 break;
         }
 
-        snprintf(buf, VGA_WIDTH, "%5d  %5d  %4c  %8d  %6d    %s",
-                 i, proc->pid, state, proc->run_time, proc->cpu_time, proc->name);
+        snprintf(buf, VGA_WIDTH, "%5d  %5d  %4c  %4d  %6d  %6d  %6d  %6d  %6d  %5d  %s",
+                 i, proc->pid, state, scheduler_priority(proc), proc->run_time, proc->cpu_time,
+                 tsc_to_ms(proc->user_cycles), tsc_to_ms(proc->kernel_cycles),
+                 tsc_to_ms(proc->irq_cycles), kproc_stack_peak(proc), proc->name);
 
         vga_puts_at(0, row, bg_color, fg_color, buf);
 
@@ -112,6 +227,799 @@ void test_proc_list(void) {
 
 }
 
+/**
+ * Displays the system-wide wakeup-to-run latency histogram
+ * Only non-empty buckets are shown, one per row.
+ */
+void test_latency(void) {
+    char buf[VGA_WIDTH+1] = {0};
+    unsigned int hist[SCHED_LATENCY_BUCKETS];
+    unsigned int mhz = tsc_get_hz() / 1000000;
+    int row = 1;
+
+    if (tty_get_active() != TEST_LATENCY_TTY) {
+        return;
+    }
+
+    if (scheduler_get_latency(NULL, hist) != 0 || mhz == 0) {
+        return;
+    }
+
+    snprintf(buf, VGA_WIDTH, "%-*s", VGA_WIDTH, "Bucket    Cycles >=       us >=       Count");
+    vga_puts_at(0, 0, VGA_COLOR_BLACK, VGA_COLOR_LIGHT_GREY, buf);
+
+    for (int i = 0; i < SCHED_LATENCY_BUCKETS && row < VGA_HEIGHT; i++) {
+        if (!hist[i]) {
+            continue;
+        }
+
+        snprintf(buf, VGA_WIDTH, "%6d  %11u  %10u  %10u",
+                 i, 1u << i, (1u << i) / mhz, hist[i]);
+        vga_puts_at(0, row, VGA_COLOR_BLACK, VGA_COLOR_WHITE, buf);
+        row++;
+    }
+}
+
+/**
+ * Displays the usage of every kernel heap cache
+ */
+void test_kheap(void) {
+    char buf[VGA_WIDTH+1] = {0};
+    int row = 1;
+
+    if (tty_get_active() != TEST_KHEAP_TTY) {
+        return;
+    }
+
+    snprintf(buf, VGA_WIDTH, "%-*s", VGA_WIDTH,
+             "Cache             Size  Slabs  In use    Peak      Allocs       Frees");
+    vga_puts_at(0, 0, VGA_COLOR_BLACK, VGA_COLOR_LIGHT_GREY, buf);
+
+    for (kheap_cache_t *cache = kheap_caches(); cache && row < VGA_HEIGHT; cache = cache->next) {
+        snprintf(buf, VGA_WIDTH, "%-16s  %4d  %5d  %6d  %6d  %10u  %10u",
+                 cache->name, cache->size, cache->slabs, cache->in_use, cache->peak,
+                 cache->allocs, cache->frees);
+        vga_puts_at(0, row, VGA_COLOR_BLACK, VGA_COLOR_WHITE, buf);
+        row++;
+    }
+}
+
+/**
+ * Reserves lines of benchmark results
+ * @param count - number of lines
+ * @return index of the first line, -1 if there is no room
+ */
+int test_bench_reserve(int count) {
+    int row = test_bench_rows;
+
+    if (row + count > TEST_BENCH_ROWS) {
+        return -1;
+    }
+
+    test_bench_rows += count;
+    return row;
+}
+
+/**
+ * Times blocking and waking a process with many processes runnable
+ * The process is taken off an intrusive run list and appended again,
+ * compared with finding its pid by rotating a queue_t as the run queue
+ * did before.
+ */
+void test_bench_runlist(void) {
+    proc_list_t list;
+    queue_t queue;
+    unsigned long long start;
+    unsigned int list_cycles;
+    unsigned int queue_cycles;
+    proc_t *proc;
+    int row = test_bench_reserve(1);
+    int item;
+
+    if (row < 0) {
+        return;
+    }
+
+    proc_list_init(&list);
+    queue_init(&queue);
+
+    for (int i = 0; i < TEST_BENCH_PROCS; i++) {
+        test_bench_procs[i].pid = i;
+        test_bench_procs[i].scheduler_queue = NULL;
+        proc_list_append(&list, &test_bench_procs[i]);
+        queue_in(&queue, i);
+    }
+
+    start = tsc_read();
+    for (int n = 0; n < TEST_BENCH_LOOPS; n++) {
+        proc = &test_bench_procs[n % TEST_BENCH_PROCS];
+        proc_list_remove(proc);
+        proc_list_append(&list, proc);
+    }
+    list_cycles = (tsc_read() - start) / TEST_BENCH_LOOPS;
+
+    start = tsc_read();
+    for (int n = 0; n < TEST_BENCH_LOOPS; n++) {
+        for (int i = 0; i < TEST_BENCH_PROCS; i++) {
+            queue_out(&queue, &item);
+
+            if (item != n % TEST_BENCH_PROCS) {
+                queue_in(&queue, item);
+            }
+        }
+        queue_in(&queue, n % TEST_BENCH_PROCS);
+    }
+    queue_cycles = (tsc_read() - start) / TEST_BENCH_LOOPS;
+
+    snprintf(test_bench_text[row], VGA_WIDTH, "Block/wake, %d runnable: list %u, queue rotation %u cycles",
+             TEST_BENCH_PROCS, list_cycles, queue_cycles);
+    kernel_log_info("test: %s", test_bench_text[row]);
+}
+
+/**
+ * Times picking the next process with many processes runnable
+ * Each pick takes the next process round-robin and puts it back, from a
+ * ready bitmap with a cursor, from an intrusive run list, and from a
+ * queue_t of pids looked up by scanning, as the scheduler first did.
+ */
+void test_bench_pick(void) {
+    proc_bitmap_t set;
+    proc_list_t list;
+    queue_t queue;
+    unsigned long long start;
+    unsigned int bitmap_cycles;
+    unsigned int list_cycles;
+    unsigned int queue_cycles;
+    proc_t *proc;
+    int row = test_bench_reserve(1);
+    int bit;
+    int item;
+
+    if (row < 0) {
+        return;
+    }
+
+    proc_bitmap_init(&set);
+    proc_list_init(&list);
+    queue_init(&queue);
+
+    for (int i = 0; i < TEST_BENCH_PROCS; i++) {
+        test_bench_procs[i].pid = i;
+        test_bench_procs[i].entry = i;
+        test_bench_procs[i].ready_set = NULL;
+        test_bench_procs[i].scheduler_queue = NULL;
+        proc_bitmap_add(&set, &test_bench_procs[i]);
+        proc_list_append(&list, &test_bench_procs[i]);
+        queue_in(&queue, i);
+    }
+
+    // The same search proc_bitmap_pop does, on the stand-in entries
+    start = tsc_read();
+    for (int n = 0; n < TEST_BENCH_LOOPS; n++) {
+        bit = bitmap_find_next(set.bits, BITMAP_WORDS(PROC_MAX), set.cursor);
+        if (!bit) {
+            bit = bitmap_find_first(set.bits, BITMAP_WORDS(PROC_MAX));
+        }
+
+        proc = &test_bench_procs[bit - 1];
+        set.cursor = bit;
+        proc_bitmap_remove(proc);
+        proc_bitmap_add(&set, proc);
+    }
+    bitmap_cycles = (tsc_read() - start) / TEST_BENCH_LOOPS;
+
+    start = tsc_read();
+    for (int n = 0; n < TEST_BENCH_LOOPS; n++) {
+        proc = proc_list_pop(&list);
+        proc_list_append(&list, proc);
+    }
+    list_cycles = (tsc_read() - start) / TEST_BENCH_LOOPS;
+
+    // The first scheduler looked each pid up with a scan of the table.
+    start = tsc_read();
+    for (int n = 0; n < TEST_BENCH_LOOPS; n++) {
+        queue_out(&queue, &item);
+
+        for (int i = 0; i < TEST_BENCH_PROCS; i++) {
+            proc = &test_bench_procs[i];
+
+            if (proc->pid == item) {
+                break;
+            }
+        }
+        queue_in(&queue, proc->pid);
+    }
+    queue_cycles = (tsc_read() - start) / TEST_BENCH_LOOPS;
+
+    snprintf(test_bench_text[row], VGA_WIDTH, "Pick, %d runnable: bitmap %u, list %u, queue %u cycles",
+             TEST_BENCH_PROCS, bitmap_cycles, list_cycles, queue_cycles);
+    kernel_log_info("test: %s", test_bench_text[row]);
+}
+
+/**
+ * Times the scheduler tick with more and more processes asleep
+ * Stand-in processes sleep far longer than the benchmark runs, so the
+ * tick only pays for the head of the sleep list; with a sleep list
+ * ordered by wake time the cost stays flat up to PROC_MAX sleepers.
+ */
+void test_bench_tick(void) {
+    int sleepers[] = { 0, PROC_MAX / 16, PROC_MAX / 4, PROC_MAX };
+    unsigned int cycles[4];
+    unsigned long long start;
+    proc_t *procs;
+    int row = test_bench_reserve(1);
+
+    if (row < 0) {
+        return;
+    }
+
+    procs = kmalloc(PROC_MAX * sizeof(proc_t));
+    if (!procs) {
+        kernel_log_error("test: Unable to allocate the tick benchmark's sleepers.");
+        return;
+    }
+
+    for (int i = 0; i < PROC_MAX; i++) {
+        procs[i].pid = -1;
+        procs[i].state = IDLE;
+        procs[i].cpu = -1;
+        procs[i].sleep_time = 0;
+        procs[i].sleep_next = NULL;
+    }
+
+    for (int n = 0, asleep = 0; n < 4; n++) {
+        while (asleep < sleepers[n]) {
+            scheduler_sleep(&procs[asleep], TEST_BENCH_SLEEP + asleep);
+            asleep++;
+        }
+
+        start = tsc_read();
+        for (int i = 0; i < TEST_BENCH_LOOPS; i++) {
+            scheduler_timer();
+        }
+        cycles[n] = (tsc_read() - start) / TEST_BENCH_LOOPS;
+    }
+
+    for (int i = 0; i < PROC_MAX; i++) {
+        scheduler_remove(&procs[i]);
+    }
+    kfree(procs);
+
+    snprintf(test_bench_text[row], VGA_WIDTH, "Tick, %d/%d/%d/%d sleepers: %u/%u/%u/%u cycles",
+             sleepers[0], sleepers[1], sleepers[2], sleepers[3],
+             cycles[0], cycles[1], cycles[2], cycles[3]);
+    kernel_log_info("test: %s", test_bench_text[row]);
+}
+
+/**
+ * Ping side of the semaphore ping/pong test
+ * Posts pong's semaphore and waits on its own, timing the round trips
+ * first with both sides leaving the CPU to the scheduler and then with
+ * each handing it to the other with proc_yield_to after posting.
+ */
+void test_yield_ping(void) {
+    unsigned long long start;
+
+    test_yield_sems[0] = sem_init(0);
+    test_yield_sems[1] = sem_init(0);
+
+    if (test_yield_sems[0] < 0 || test_yield_sems[1] < 0) {
+        test_yield_done = 1;
+        proc_exit(-1);
+    }
+
+    for (int handoff = 0; handoff < 2; handoff++) {
+        test_yield_handoff = handoff;
+        start = tsc_read();
+
+        for (int i = 0; i < TEST_YIELD_TRIPS; i++) {
+            sem_post(test_yield_sems[1]);
+
+            if (handoff) {
+                proc_yield_to(test_yield_pids[1]);
+            }
+
+            sem_wait(test_yield_sems[0]);
+        }
+
+        test_yield_cycles[handoff] = (tsc_read() - start) / TEST_YIELD_TRIPS;
+    }
+
+    test_yield_done = 1;
+    proc_exit(0);
+}
+
+/**
+ * Pong side of the semaphore ping/pong test
+ * Answers every post from ping until it is destroyed.
+ */
+void test_yield_pong(void) {
+    while (test_yield_sems[1] < 0) {
+        proc_yield();
+    }
+
+    while (1) {
+        sem_wait(test_yield_sems[1]);
+        sem_post(test_yield_sems[0]);
+
+        if (test_yield_handoff) {
+            proc_yield_to(test_yield_pids[0]);
+        }
+    }
+}
+
+/**
+ * Starts the semaphore ping/pong test
+ * Ping creates the semaphores, as they can't be allocated before the
+ * processes run.
+ */
+void test_yield_begin(void) {
+    test_yield_row = test_bench_reserve(1);
+    if (test_yield_row < 0) {
+        return;
+    }
+
+    test_yield_pids[0] = kproc_create(test_yield_ping, "yping", PROC_TYPE_USER, 0);
+    test_yield_pids[1] = kproc_create(test_yield_pong, "ypong", PROC_TYPE_USER, 0);
+
+    snprintf(test_bench_text[test_yield_row], VGA_WIDTH, "Semaphore ping/pong: running");
+}
+
+/**
+ * Reports the semaphore ping/pong test once ping is done
+ */
+void test_yield_end(void) {
+    proc_t *proc;
+
+    if (test_yield_row < 0 || !test_yield_done) {
+        return;
+    }
+
+    proc = pid_to_proc(test_yield_pids[1]);
+    if (proc) {
+        kproc_destroy(proc);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (test_yield_sems[i] >= 0) {
+            ksem_destroy(test_yield_sems[i]);
+        }
+    }
+
+    snprintf(test_bench_text[test_yield_row], VGA_WIDTH,
+             "Semaphore ping/pong, %d round trips: plain %u, yield_to %u cycles each",
+             TEST_YIELD_TRIPS, test_yield_cycles[0], test_yield_cycles[1]);
+    kernel_log_info("test: %s", test_bench_text[test_yield_row]);
+    test_yield_row = -1;
+}
+
+/**
+ * Starts the timeslice test
+ * Spinning processes run beside the shells and ping/pong processes,
+ * first with adaptive timeslices and then with every process getting
+ * SCHEDULER_TIMESLICE, for TEST_SLICE_TICKS ticks each.
+ */
+void test_slice_begin(void) {
+    test_slice_row = test_bench_reserve(3);
+    if (test_slice_row < 0) {
+        return;
+    }
+
+    for (int i = 0; i < TEST_SLICE_PROCS; i++) {
+        test_slice_pids[i] = kproc_create(kproc_test, "spin", PROC_TYPE_USER, 0);
+    }
+
+    scheduler_set_adaptive(1);
+    scheduler_get_stats(&test_slice_stats);
+    test_slice_start = timer_get_ticks();
+    test_slice_phase = 0;
+
+    snprintf(test_bench_text[test_slice_row], VGA_WIDTH, "Timeslices: running for %d ticks",
+             2 * TEST_SLICE_TICKS);
+}
+
+/**
+ * Advances the timeslice test once a half has run long enough
+ * Each half reports context switches per second and the mean
+ * wakeup-to-run latency of woken processes.
+ * @return 1 once the test is over, 0 while it is still running
+ */
+int test_slice_step(void) {
+    scheduler_stats_t stats;
+    unsigned int wakeups;
+    unsigned int mhz = tsc_get_hz() / 1000000;
+    int ticks = timer_get_ticks() - test_slice_start;
+    proc_t *proc;
+
+    if (test_slice_phase < 0) {
+        return 1;
+    }
+
+    if (ticks < TEST_SLICE_TICKS) {
+        return 0;
+    }
+
+    scheduler_get_stats(&stats);
+    wakeups = stats.wakeups - test_slice_stats.wakeups;
+
+    snprintf(test_bench_text[test_slice_row + 1 + test_slice_phase], VGA_WIDTH,
+             "  %-8s %6d switches/s, %6u wakeups, mean latency %6u us",
+             test_slice_phase ? "fixed" : "adaptive",
+             (int)(stats.switches - test_slice_stats.switches) * TIMER_HZ / ticks, wakeups,
+             (wakeups && mhz) ? (unsigned int)((stats.wakeup_cycles - test_slice_stats.wakeup_cycles)
+                                               / wakeups / mhz) : 0);
+    kernel_log_info("test: %s", test_bench_text[test_slice_row + 1 + test_slice_phase]);
+
+    test_slice_stats = stats;
+    test_slice_start = timer_get_ticks();
+
+    if (test_slice_phase == 0) {
+        scheduler_set_adaptive(0);
+        test_slice_phase = 1;
+        return 0;
+    }
+
+    scheduler_set_adaptive(1);
+    test_slice_phase = -1;
+
+    for (int i = 0; i < TEST_SLICE_PROCS; i++) {
+        proc = pid_to_proc(test_slice_pids[i]);
+
+        if (proc) {
+            kproc_destroy(proc);
+        }
+    }
+
+    snprintf(test_bench_text[test_slice_row], VGA_WIDTH, "Timeslices over %d ticks each:",
+             TEST_SLICE_TICKS);
+    return 1;
+}
+
+/**
+ * Adds up the time every CPU has spent waiting for the kernel lock
+ * @return number of TSC cycles
+ */
+unsigned long long test_smp_lock_cycles(void) {
+    unsigned long long cycles = 0;
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        if (cpu_entry(i)->started) {
+            cycles += cpu_entry(i)->lock_cycles;
+        }
+    }
+
+    return cycles;
+}
+
+/**
+ * Starts the SMP scaling test
+ * TEST_SMP_PROCS spinning processes run for TEST_SMP_TICKS ticks. Run
+ * with qemu -smp 1 through 4 to see how their throughput scales.
+ */
+void test_smp_begin(void) {
+    test_smp_row = test_bench_reserve(1);
+    if (test_smp_row < 0) {
+        return;
+    }
+
+    for (int i = 0; i < TEST_SMP_PROCS; i++) {
+        test_smp_pids[i] = kproc_create(kproc_test, "smp", PROC_TYPE_USER, 0);
+    }
+
+    test_smp_tsc = tsc_read();
+    test_smp_lock = test_smp_lock_cycles();
+    test_smp_start = timer_get_ticks();
+
+    snprintf(test_bench_text[test_smp_row], VGA_WIDTH, "SMP scaling: running for %d ticks",
+             TEST_SMP_TICKS);
+}
+
+/**
+ * Finishes the SMP scaling test once it has run long enough
+ * Throughput is the user time the spinning processes received, in CPUs'
+ * worth, next to the share of all CPUs' time spent waiting for the
+ * kernel lock.
+ * @return 1 once the test is over, 0 while it is still running
+ */
+int test_smp_step(void) {
+    unsigned long long elapsed;
+    unsigned long long work = 0;
+    unsigned int lock;
+    unsigned int cpus = 0;
+    proc_t *proc;
+
+    if (test_smp_start < 0) {
+        return 1;
+    }
+
+    if (timer_get_ticks() - test_smp_start < TEST_SMP_TICKS) {
+        return 0;
+    }
+    test_smp_start = -1;
+
+    elapsed = tsc_read() - test_smp_tsc;
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        cpus += cpu_entry(i)->started ? 1 : 0;
+    }
+
+    for (int i = 0; i < TEST_SMP_PROCS; i++) {
+        proc = pid_to_proc(test_smp_pids[i]);
+
+        if (proc) {
+            work += proc->user_cycles;
+            kproc_destroy(proc);
+        }
+    }
+
+    work = work * 100 / elapsed;
+    lock = (test_smp_lock_cycles() - test_smp_lock) * 1000 / (elapsed * cpus);
+
+    snprintf(test_bench_text[test_smp_row], VGA_WIDTH,
+             "SMP scaling, %u CPUs: %d spinners got %u.%02u CPUs, lock wait %u.%u%%",
+             cpus, TEST_SMP_PROCS, (unsigned int)work / 100, (unsigned int)work % 100,
+             lock / 10, lock % 10);
+    kernel_log_info("test: %s", test_bench_text[test_smp_row]);
+    return 1;
+}
+
+/**
+ * Starts the stride share test
+ * Spinning processes holding different numbers of tickets compete for
+ * the stride band for TEST_STRIDE_TICKS ticks. Each CPU keeps its own
+ * stride band, so the shares only add up like this on a single CPU.
+ */
+void test_stride_begin(void) {
+    test_stride_row = test_bench_reserve(1 + TEST_STRIDE_PROCS);
+    if (test_stride_row < 0) {
+        return;
+    }
+
+    for (int i = 0; i < TEST_STRIDE_PROCS; i++) {
+        test_stride_pids[i] = kproc_create(kproc_test, "stride", PROC_TYPE_USER, 0);
+
+        if (test_stride_pids[i] < 0
+                || scheduler_set_tickets(pid_to_proc(test_stride_pids[i]), test_stride_tickets[i]) != 0) {
+            kernel_log_error("test: Unable to start the stride share test.");
+            return;
+        }
+    }
+
+    test_stride_start = timer_get_ticks();
+    snprintf(test_bench_text[test_stride_row], VGA_WIDTH, "Stride share: running for %d ticks",
+             TEST_STRIDE_TICKS);
+}
+
+/**
+ * Finishes the stride share test once it has run long enough
+ * Each process' share of the run time the test processes received is
+ * compared with its share of the tickets, in tenths of a percent.
+ * @return 1 once the test is over, 0 while it is still running
+ */
+int test_stride_step(void) {
+    proc_t *proc;
+    int time[TEST_STRIDE_PROCS];
+    int total_time = 0;
+    int total_tickets = 0;
+
+    if (test_stride_start < 0) {
+        return 1;
+    }
+
+    if (timer_get_ticks() - test_stride_start < TEST_STRIDE_TICKS) {
+        return 0;
+    }
+    test_stride_start = -1;
+
+    for (int i = 0; i < TEST_STRIDE_PROCS; i++) {
+        proc = pid_to_proc(test_stride_pids[i]);
+        time[i] = proc ? proc->run_time : 0;
+        total_time += time[i];
+        total_tickets += test_stride_tickets[i];
+
+        if (proc) {
+            kproc_destroy(proc);
+        }
+    }
+
+    snprintf(test_bench_text[test_stride_row], VGA_WIDTH, "Stride share over %d ticks (tickets: wanted/got, 0.1%%):",
+             TEST_STRIDE_TICKS);
+
+    for (int i = 0; i < TEST_STRIDE_PROCS; i++) {
+        snprintf(test_bench_text[test_stride_row + 1 + i], VGA_WIDTH, "  %4d: %4d / %4d",
+                 test_stride_tickets[i], test_stride_tickets[i] * 1000 / total_tickets,
+                 total_time ? time[i] * 1000 / total_time : 0);
+        kernel_log_info("test: %s", test_bench_text[test_stride_row + 1 + i]);
+    }
+
+    return 1;
+}
+
+/**
+ * Owner side of the lock latency test
+ * Runs at the lowest priority and spins holding the lock for
+ * TEST_LOCK_HOLD ticks at a time.
+ */
+void test_lock_owner(void) {
+    unsigned long long start;
+
+    while (1) {
+        mutex_lock(test_lock_mutex);
+
+        start = tsc_read();
+        while (tsc_read() - start < test_lock_hold) {
+        }
+
+        mutex_unlock(test_lock_mutex);
+    }
+}
+
+/**
+ * Waiting side of the lock latency test
+ * Runs at the highest priority, taking the lock once a second, and keeps
+ * the longest wait of each half.
+ */
+void test_lock_waiter(void) {
+    unsigned long long start;
+    unsigned int cycles;
+    int phase;
+
+    while (1) {
+        proc_sleep(1);
+
+        phase = test_lock_phase;
+        start = tsc_read();
+        mutex_lock(test_lock_mutex);
+        cycles = tsc_read() - start;
+        mutex_unlock(test_lock_mutex);
+
+        // Drop waits that started in the other half.
+        if (phase < 0 || phase != test_lock_phase) {
+            continue;
+        }
+
+        test_lock_waits[phase]++;
+        if (cycles > test_lock_max[phase]) {
+            test_lock_max[phase] = cycles;
+        }
+    }
+}
+
+/**
+ * Starts the lock latency test
+ * A high priority process takes a lock that a CPU-bound low priority
+ * process holds most of the time, while middle priority spinners compete
+ * with the owner, first with priority inheritance and then without, for
+ * TEST_LOCK_TICKS ticks each. The spinners are demoted like any CPU-bound
+ * process, so without inheritance the owner shares the lowest level with
+ * them. Each CPU schedules on its own, so run with qemu -smp 1.
+ */
+void test_lock_begin(void) {
+    int priority[2 + TEST_LOCK_SPINNERS];
+    proc_t *proc;
+
+    test_lock_row = test_bench_reserve(1);
+    if (test_lock_row < 0) {
+        return;
+    }
+
+    test_lock_mutex = kmutex_init();
+    if (test_lock_mutex < 0) {
+        kernel_log_error("test: Unable to start the lock latency test.");
+        return;
+    }
+    test_lock_hold = (unsigned long long)tsc_get_hz() / TIMER_HZ * TEST_LOCK_HOLD;
+
+    test_lock_pids[0] = kproc_create(test_lock_waiter, "lwait", PROC_TYPE_USER, 0);
+    priority[0] = 0;
+    test_lock_pids[1] = kproc_create(test_lock_owner, "lowner", PROC_TYPE_USER, 0);
+    priority[1] = SCHEDULER_LEVELS - 1;
+
+    for (int i = 2; i < 2 + TEST_LOCK_SPINNERS; i++) {
+        test_lock_pids[i] = kproc_create(kproc_test, "lspin", PROC_TYPE_USER, 0);
+        priority[i] = SCHEDULER_LEVELS / 2;
+    }
+
+    for (int i = 0; i < 2 + TEST_LOCK_SPINNERS; i++) {
+        proc = pid_to_proc(test_lock_pids[i]);
+
+        if (!proc || scheduler_set_priority(proc, priority[i]) != 0) {
+            kernel_log_error("test: Unable to start the lock latency test.");
+            return;
+        }
+    }
+
+    kmutex_set_inherit(1);
+    test_lock_start = timer_get_ticks();
+    test_lock_phase = 0;
+
+    snprintf(test_bench_text[test_lock_row], VGA_WIDTH, "Lock latency: running for %d ticks",
+             2 * TEST_LOCK_TICKS);
+}
+
+/**
+ * Advances the lock latency test once a half has run long enough
+ * The worst time from mutex_lock to acquiring the lock is reported with
+ * and without inheritance.
+ * @return 1 once the test is over, 0 while it is still running
+ */
+int test_lock_step(void) {
+    unsigned int mhz = tsc_get_hz() / 1000000;
+    proc_t *proc;
+
+    if (test_lock_phase < 0) {
+        return 1;
+    }
+
+    if (timer_get_ticks() - test_lock_start < TEST_LOCK_TICKS) {
+        return 0;
+    }
+
+    if (test_lock_phase == 0) {
+        kmutex_set_inherit(0);
+        test_lock_start = timer_get_ticks();
+        test_lock_phase = 1;
+        return 0;
+    }
+
+    kmutex_set_inherit(1);
+    test_lock_phase = -1;
+
+    // The waiter goes first so the owner's lock isn't handed to it.
+    for (int i = 0; i < 2 + TEST_LOCK_SPINNERS; i++) {
+        proc = pid_to_proc(test_lock_pids[i]);
+
+        if (proc) {
+            kproc_destroy(proc);
+        }
+    }
+    kmutex_destroy(test_lock_mutex);
+
+    snprintf(test_bench_text[test_lock_row], VGA_WIDTH,
+             "Lock wait, owner holds %d ticks: inherit %u us, none %u us worst (%d/%d waits)",
+             TEST_LOCK_HOLD, mhz ? test_lock_max[0] / mhz : 0, mhz ? test_lock_max[1] / mhz : 0,
+             test_lock_waits[0], test_lock_waits[1]);
+    kernel_log_info("test: %s", test_bench_text[test_lock_row]);
+    return 1;
+}
+
+/**
+ * Displays the benchmark results
+ */
+void test_bench(void) {
+    char buf[VGA_WIDTH+1] = {0};
+
+    test_yield_end();
+
+    if (test_bench_stage == 0 && test_slice_step()) {
+        test_bench_stage = 1;
+        test_smp_begin();
+    }
+
+    if (test_bench_stage == 1 && test_smp_step()) {
+        test_bench_stage = 2;
+        test_stride_begin();
+    }
+
+    if (test_bench_stage == 2 && test_stride_step()) {
+        test_bench_stage = 3;
+        test_lock_begin();
+    }
+
+    if (test_bench_stage == 3 && test_lock_step()) {
+        test_bench_stage = -1;
+    }
+
+    if (tty_get_active() != TEST_BENCH_TTY) {
+        return;
+    }
+
+    for (int i = 0; i < TEST_BENCH_ROWS && i < VGA_HEIGHT; i++) {
+        snprintf(buf, VGA_WIDTH, "%-*s", VGA_WIDTH, test_bench_text[i]);
+        vga_puts_at(0, i, VGA_COLOR_BLACK, VGA_COLOR_WHITE, buf);
+    }
+}
+
 /**
  * Initializes all tests
  */
@@ -119,13 +1027,31 @@ void test_init(void) {
     kernel_log_info("Initializing test functions");
 
     // Register the spinner to update at a rate of 10 times per second
-    timer_callback_register(&test_spinner, 10, -1);
+    timer_callback_deferrable(timer_callback_register(&test_spinner, 10, -1));
 
     // Register the timer to update at a rate of 4 times per second
-    timer_callback_register(&test_timer, 25, -1);
+    timer_callback_deferrable(timer_callback_register(&test_timer, 25, -1));
 
     // Register the process list to update at a rate of 10 times per second
-    timer_callback_register(&test_proc_list, 10, -1);
+    timer_callback_deferrable(timer_callback_register(&test_proc_list, 10, -1));
+
+    // Register the latency histogram to update once per second
+    timer_callback_deferrable(timer_callback_register(&test_latency, 100, -1));
+
+    // Register the heap caches to update once per second
+    timer_callback_deferrable(timer_callback_register(&test_kheap, 100, -1));
+
+    // Register the benchmark results to update once per second
+    timer_callback_deferrable(timer_callback_register(&test_bench, 100, -1));
+
+    if (TEST_BENCH) {
+        test_bench_runlist();
+        test_bench_pick();
+        test_bench_tick();
+        test_yield_begin();
+        test_slice_begin();
+        test_bench_stage = 0;
+    }
 }
 
 #endif
@@ -12,6 +12,12 @@
 #define TIMERS_MAX 32
 #endif
 
+#ifndef TIMER_HZ
+#define TIMER_HZ 100            // Number of timer ticks per second
+#endif
+
+#define PIT_FREQUENCY 1193182   // PIT input clock (Hz)
+
 /**
  * Registers a new callback to be called at the specified interval
  * @param func_ptr - function pointer to be called
@@ -30,6 +36,30 @@ int timer_callback_register(void (*func_ptr)(), int interval, int repeat);
  */
 int timer_callback_unregister(int id);
 
+/**
+ * Marks the specified callback as deferrable
+ * Deferrable callbacks do not need to wake an idle CPU; they are run
+ * once the tick resumes.
+ * @param id - timer id
+ *
+ * @return 0 on success, -1 on error
+ */
+int timer_callback_deferrable(int id);
+
+/**
+ * Stops the periodic tick while the CPU is idle
+ * The timer is programmed one-shot for the nearest of the given expiry
+ * or the next non-deferrable callback.
+ * @param ticks - number of ticks until the next wakeup, -1 if none
+ */
+void timer_tickless_enter(int ticks);
+
+/**
+ * Restarts the periodic tick after an early wakeup
+ * Ticks that elapsed while the tick was stopped are caught up.
+ */
+void timer_tickless_exit(void);
+
 /**
  * Returns the number of ticks that have occurred since startup
  *
@@ -0,0 +1,40 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Time Stamp Counter Definitions
+ */
+#ifndef TSC_H
+#define TSC_H
+
+#ifndef TSC_CALIBRATE_HZ
+#define TSC_CALIBRATE_HZ 20     // Calibration runs for 1/20th of a second
+#endif
+
+/**
+ * Reads the CPU time stamp counter
+ * @return number of cycles since the CPU was reset
+ */
+unsigned long long tsc_read(void);
+
+/**
+ * Returns the calibrated time stamp counter frequency
+ * @return cycles per second
+ */
+unsigned int tsc_get_hz(void);
+
+/**
+ * Converts a number of cycles to milliseconds
+ * @param cycles - number of cycles
+ * @return number of milliseconds
+ */
+unsigned int tsc_to_ms(unsigned long long cycles);
+
+/**
+ * Calibrates the time stamp counter frequency against the PIT
+ * Must be called with interrupts disabled.
+ */
+void tsc_init(void);
+
+#endif
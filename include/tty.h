@@ -43,8 +43,8 @@ typedef struct tty_t {
 
     int echo;                   // If the TTY should echo or not
 
-    ringbuf_t io_input;         // Input buffer
-    ringbuf_t io_output;        // Output buffer
+    ringbuf_t *io_input;        // Input buffer
+    ringbuf_t *io_output;       // Output buffer
 } tty_t;
 
 /**
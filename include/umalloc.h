@@ -0,0 +1,49 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * User Heap
+ */
+#ifndef UMALLOC_H
+#define UMALLOC_H
+
+#define UMALLOC_MIN_SHIFT   4       // Smallest size class (16 bytes)
+#define UMALLOC_MAX_SHIFT   22      // Largest size class (4MB, more than any heap)
+#define UMALLOC_GROW        0x4000  // Least the heap is grown by at a time
+
+// Usage of the current process' heap
+typedef struct umalloc_stats_t {
+    int size;                   // Bytes in the heap
+    int used;                   // Bytes carved into blocks
+    int in_use;                 // Blocks allocated
+    unsigned int allocs;        // Number of allocations
+    unsigned int frees;         // Number of frees
+} umalloc_stats_t;
+
+/**
+ * Allocates memory from the process heap
+ * Requests are rounded up to a power-of-two size class, and each class
+ * keeps a list of freed blocks to reuse. The heap is shared by the
+ * threads of a process.
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if the heap is full
+ */
+void *umalloc(int size);
+
+/**
+ * Frees memory allocated by umalloc
+ * The block is kept for reuse by its size class, not returned to the
+ * kernel; the process' heap is freed when it exits.
+ * @param ptr - pointer to the memory, may be NULL
+ */
+void ufree(void *ptr);
+
+/**
+ * Retrieves the usage of the process heap
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int umalloc_get_stats(umalloc_stats_t *stats);
+
+#endif
@@ -90,3 +90,119 @@ int bit_toggle(int value, int bit) {
     // flipped, while the other bits remain unchanged.
     return (value ^ toggle_bit);
 }
+
+/**
+ * Finds the lowest bit that is set in the given integer value
+ * @param value - the integer value to search
+ * @return the lowest set bit (numbered from 1), 0 if no bits are set
+ */
+int bit_find_first(int value) {
+    int bit;
+
+    if(value == 0) {
+        return 0;
+    }
+
+    // Bit Scan Forward (BSF) stores the index of the lowest set bit,
+    // numbered from 0, in a single instruction.
+    asm("bsfl %1, %0" : "=r"(bit) : "rm"(value));
+
+    return bit + 1;
+}
+
+/**
+ * Finds the highest bit that is set in the given integer value
+ * @param value - the integer value to search
+ * @return the highest set bit (numbered from 1), 0 if no bits are set
+ */
+int bit_find_last(int value) {
+    int bit;
+
+    if(value == 0) {
+        return 0;
+    }
+
+    // Bit Scan Reverse (BSR) stores the index of the highest set bit,
+    // numbered from 0, in a single instruction.
+    asm("bsrl %1, %0" : "=r"(bit) : "rm"(value));
+
+    return bit + 1;
+}
+
+/**
+ * Finds the lowest bit above the given bit that is set in the integer value
+ * @param value - the integer value to search
+ * @param bit - bit to search after (numbered from 1), 0 to search from the start
+ * @return the next set bit (numbered from 1), 0 if no higher bits are set
+ */
+int bit_find_next(int value, int bit) {
+    if(bit >= 32) {
+        return 0;
+    }
+
+    // Mask off the given bit and everything below it, then scan what's left.
+    return bit_find_first(value & ~((1u << bit) - 1));
+}
+
+/**
+ * Checks if the given bit is set in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to check (numbered from 1)
+ * @return 1 if set, 0 if not set
+ */
+int bitmap_test(unsigned int *map, int bit) {
+    return bit_test(map[(bit - 1) / 32], (bit - 1) % 32 + 1);
+}
+
+/**
+ * Sets the specified bit in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to set (numbered from 1)
+ */
+void bitmap_set(unsigned int *map, int bit) {
+    map[(bit - 1) / 32] = bit_set(map[(bit - 1) / 32], (bit - 1) % 32 + 1);
+}
+
+/**
+ * Clears the specified bit in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to clear (numbered from 1)
+ */
+void bitmap_clear(unsigned int *map, int bit) {
+    map[(bit - 1) / 32] = bit_clear(map[(bit - 1) / 32], (bit - 1) % 32 + 1);
+}
+
+/**
+ * Finds the lowest bit that is set in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param words - number of words in the bitmap
+ * @return the lowest set bit (numbered from 1), 0 if no bits are set
+ */
+int bitmap_find_first(unsigned int *map, int words) {
+    return bitmap_find_next(map, words, 0);
+}
+
+/**
+ * Finds the lowest bit above the given bit that is set in a multi-word bitmap
+ * @param map - pointer to the bitmap words
+ * @param words - number of words in the bitmap
+ * @param bit - bit to search after (numbered from 1), 0 to search from the start
+ * @return the next set bit (numbered from 1), 0 if no higher bits are set
+ */
+int bitmap_find_next(unsigned int *map, int words, int bit) {
+    int word = bit / 32;
+    int found;
+
+    if(word >= words) {
+        return 0;
+    }
+
+    // Search the rest of the word holding the given bit, then whole words.
+    found = bit_find_next(map[word], bit % 32);
+
+    while(!found && ++word < words) {
+        found = bit_find_first(map[word]);
+    }
+
+    return found ? word * 32 + found : 0;
+}
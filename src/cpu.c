@@ -0,0 +1,356 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Multiprocessor Implementation
+ */
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "kproc.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "tsc.h"
+#include "kpaging.h"
+
+// Local APIC definitions
+#define LAPIC_MSR_BASE          0x1b        // APIC base address MSR
+#define LAPIC_BASE_MASK         0xfffff000  // Base address bits of the MSR
+#define LAPIC_REG_ID            0x020       // Local APIC id
+#define LAPIC_REG_EOI           0x0b0       // End of interrupt
+#define LAPIC_REG_SVR           0x0f0       // Spurious interrupt vector
+#define LAPIC_REG_ISR           0x100       // In-service (8 registers)
+#define LAPIC_REG_ICR_LO        0x300       // Interrupt command (low)
+#define LAPIC_REG_ICR_HI        0x310       // Interrupt command (high)
+#define LAPIC_REG_TIMER         0x320       // Timer local vector table entry
+#define LAPIC_REG_TIMER_INIT    0x380       // Timer initial count
+#define LAPIC_REG_TIMER_COUNT   0x390       // Timer current count
+#define LAPIC_REG_TIMER_DIV     0x3e0       // Timer divide configuration
+
+#define LAPIC_SVR_ENABLE        0x100       // Software enable
+#define LAPIC_TIMER_PERIODIC    0x20000     // Periodic timer mode
+#define LAPIC_TIMER_MASKED      0x10000     // Timer interrupt masked
+#define LAPIC_TIMER_DIV16       0x3         // Divide the bus clock by 16
+
+#define LAPIC_ICR_INIT          0x500       // INIT delivery mode
+#define LAPIC_ICR_STARTUP       0x600       // Startup (SIPI) delivery mode
+#define LAPIC_ICR_ASSERT        0x4000      // Level assert
+#define LAPIC_ICR_ALL_BUT_SELF  0xc0000     // Destination: all except self
+#define LAPIC_ICR_PENDING       0x1000      // Delivery status
+
+#define CPUID_FEATURE_APIC      0x200       // CPUID.1:EDX on-chip APIC
+
+// Time to wait for the application processors to check in (microseconds)
+#define CPU_START_TIMEOUT       100000
+
+// Local APIC registers, NULL if there is no local APIC
+// Also used by context.S to find the kernel stack of the current CPU.
+volatile unsigned int *cpu_lapic;
+
+// Local APIC timer count for one tick
+unsigned int cpu_lapic_tick_count;
+
+// Per-CPU data, indexed by local APIC id
+cpu_t cpu_table[CPU_MAX];
+
+// Number of CPUs running
+volatile int cpu_count;
+
+// Set once the bootstrap processor lets the application processors run
+volatile int cpu_go;
+
+/**
+ * Reads a local APIC register
+ * @param reg - register offset
+ * @return register value
+ */
+unsigned int cpu_lapic_read(int reg) {
+    return cpu_lapic[reg / 4];
+}
+
+/**
+ * Writes a local APIC register
+ * @param reg - register offset
+ * @param value - value to write
+ */
+void cpu_lapic_write(int reg, unsigned int value) {
+    cpu_lapic[reg / 4] = value;
+}
+
+/**
+ * Busy-waits for the given time using the TSC
+ * @param us - number of microseconds to wait
+ */
+void cpu_delay(int us) {
+    unsigned long long start = tsc_read();
+    unsigned long long cycles = (unsigned long long)(tsc_get_hz() / 1000000) * us;
+
+    while(tsc_read() - start < cycles) {
+        asm volatile("pause");
+    }
+}
+
+/**
+ * Sends an interprocessor interrupt to all other CPUs
+ * @param command - delivery mode and vector
+ */
+void cpu_ipi_others(unsigned int command) {
+    cpu_lapic_write(LAPIC_REG_ICR_HI, 0);
+    cpu_lapic_write(LAPIC_REG_ICR_LO, command | LAPIC_ICR_ALL_BUT_SELF);
+
+    while(cpu_lapic_read(LAPIC_REG_ICR_LO) & LAPIC_ICR_PENDING) {
+        asm volatile("pause");
+    }
+}
+
+/**
+ * Enables the local APIC of the current CPU
+ */
+void cpu_lapic_enable(void) {
+    cpu_lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | IRQ_APIC_SPURIOUS);
+}
+
+/**
+ * Local APIC timer interrupt handler
+ * The scheduler runs on the way out of the kernel; the tick itself is
+ * accounted by the bootstrap processor's PIT.
+ */
+void cpu_timer_irq_handler(void) {
+    cpu_lapic_write(LAPIC_REG_EOI, 0);
+}
+
+/**
+ * Local APIC spurious interrupt handler
+ * Spurious interrupts must not be acknowledged.
+ */
+void cpu_spurious_irq_handler(void) {
+}
+
+/**
+ * Returns the id of the current CPU
+ * @return local APIC id, 0 if there is no local APIC
+ */
+int cpu_id(void) {
+    if(!cpu_lapic) {
+        return 0;
+    }
+
+    return cpu_lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+/**
+ * Returns the per-CPU data of the current CPU
+ * @return pointer to the CPU entry
+ */
+cpu_t *cpu_get(void) {
+    return &cpu_table[cpu_id()];
+}
+
+/**
+ * Returns the per-CPU data of the given CPU
+ * @param id - CPU id
+ * @return pointer to the CPU entry, NULL if the id is invalid
+ */
+cpu_t *cpu_entry(int id) {
+    if(id < 0 || id >= CPU_MAX) {
+        return NULL;
+    }
+
+    return &cpu_table[id];
+}
+
+/**
+ * Returns the highest priority interrupt in service on this CPU's local APIC
+ * @return interrupt vector, -1 if none or there is no local APIC
+ */
+int cpu_lapic_in_service(void) {
+    unsigned int isr;
+
+    if(!cpu_lapic) {
+        return -1;
+    }
+
+    // Eight 32-bit registers, one bit per vector; higher vectors have
+    // higher priority.
+    for(int reg = 7; reg >= 0; reg--) {
+        isr = cpu_lapic_read(LAPIC_REG_ISR + reg * 0x10);
+
+        for(int bit = 31; bit >= 0; bit--) {
+            if(isr & (1u << bit)) {
+                return reg * 32 + bit;
+            }
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Indicates if every started CPU is running its idle task
+ * @return 1 if all CPUs are idle, 0 otherwise
+ */
+int cpu_all_idle(void) {
+    for(int i = 0; i < CPU_MAX; i++) {
+        if(cpu_table[i].started && cpu_table[i].current != cpu_table[i].idle_proc) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Initializes the local APIC of the bootstrap processor
+ * Must be called after the TSC is calibrated.
+ */
+void cpu_init(void) {
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int lo, hi;
+    unsigned long long start;
+    cpu_t *cpu;
+
+    kernel_log_info("Initializing CPUs");
+
+    memset(cpu_table, 0, sizeof(cpu_table));
+    for(int i = 0; i < CPU_MAX; i++) {
+        cpu_table[i].id = i;
+    }
+
+    // Without a local APIC the kernel runs on the bootstrap processor only.
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if(edx & CPUID_FEATURE_APIC) {
+        asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(LAPIC_MSR_BASE));
+        cpu_lapic = (volatile unsigned int *)(lo & LAPIC_BASE_MASK);
+    }
+    else {
+        kernel_log_warn("cpu: No local APIC; running on one CPU.");
+    }
+
+    cpu = cpu_get();
+    if(cpu->id >= CPU_MAX) {
+        kernel_panic("cpu: Bootstrap processor id %d is not supported.", cpu_id());
+    }
+
+    cpu->bsp = 1;
+    cpu->started = 1;
+    cpu_count = 1;
+
+    if(!cpu_lapic) {
+        return;
+    }
+
+    interrupts_irq_register(IRQ_APIC_TIMER, isr_entry_apic_timer, cpu_timer_irq_handler);
+    interrupts_irq_register(IRQ_APIC_SPURIOUS, isr_entry_apic_spurious, cpu_spurious_irq_handler);
+    cpu_lapic_enable();
+
+    // Measure the local APIC timer over one tick so the application
+    // processors can tick at the same rate as the PIT.
+    cpu_lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV16);
+    cpu_lapic_write(LAPIC_REG_TIMER, LAPIC_TIMER_MASKED | IRQ_APIC_TIMER);
+    cpu_lapic_write(LAPIC_REG_TIMER_INIT, 0xffffffff);
+
+    start = tsc_read();
+    while(tsc_read() - start < tsc_get_hz() / TIMER_HZ);
+
+    cpu_lapic_tick_count = 0xffffffff - cpu_lapic_read(LAPIC_REG_TIMER_COUNT);
+    cpu_lapic_write(LAPIC_REG_TIMER_INIT, 0);
+
+    kernel_log_info("cpu: Bootstrap processor %d, local APIC timer %u counts per tick",
+                    cpu->id, cpu_lapic_tick_count);
+}
+
+/**
+ * Starts the application processors
+ * Each processor creates its own idle task and starts scheduling.
+ */
+void cpu_start(void) {
+    unsigned char *trampoline = (unsigned char *)CPU_TRAMPOLINE_ADDR;
+    int size = cpu_trampoline_end - cpu_trampoline_start;
+    int waited = 0;
+
+    if(!cpu_lapic) {
+        return;
+    }
+
+    kernel_log_info("Starting application processors");
+
+    // Copy the startup code below 1MB and hand it the descriptor tables
+    // so the processors can switch straight to protected mode.
+    memcpy(trampoline, cpu_trampoline_start, size);
+    asm volatile("sgdt %0" : "=m"(*(trampoline + (cpu_trampoline_gdtr - cpu_trampoline_start))));
+    asm volatile("sidt %0" : "=m"(*(trampoline + (cpu_trampoline_idtr - cpu_trampoline_start))));
+
+    // INIT-SIPI-SIPI broadcast; the startup vector is the page number.
+    cpu_ipi_others(LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    cpu_delay(10000);
+
+    for(int i = 0; i < 2; i++) {
+        cpu_ipi_others(LAPIC_ICR_STARTUP | (CPU_TRAMPOLINE_ADDR >> 12));
+        cpu_delay(200);
+    }
+
+    // The number of processors isn't known up front; wait for the
+    // stragglers and then let them all run.
+    while(waited < CPU_START_TIMEOUT) {
+        cpu_delay(1000);
+        waited += 1000;
+    }
+
+    kernel_log_info("cpu: %d CPUs running", cpu_count);
+    cpu_go = 1;
+}
+
+/**
+ * Application processor entry point
+ * Called by the startup trampoline on the CPU's kernel stack.
+ * @param id - CPU id
+ */
+void cpu_ap_main(int id) {
+    cpu_t *cpu = &cpu_table[id];
+
+    spin_lock(&kernel_lock);
+
+    cpu_lapic_enable();
+
+    // Process stacks live in paged memory.
+    kpaging_cpu_init();
+
+    // Create the idle task for this CPU; it runs whenever there is no
+    // other work, so the CPU always has a process to return to.
+    if(kproc_create(&kproc_idle, "idle", PROC_TYPE_IDLE, 0) < 0 || !cpu->idle_proc) {
+        kernel_log_error("cpu: Unable to create the idle task for CPU %d.", id);
+        spin_unlock(&kernel_lock);
+
+        while(1) {
+            asm("cli");
+            asm("hlt");
+        }
+    }
+
+    cpu->started = 1;
+    cpu_count++;
+    kernel_log_info("cpu: CPU %d started", id);
+
+    spin_unlock(&kernel_lock);
+
+    // Wait for the bootstrap processor to finish starting up.
+    while(!cpu_go) {
+        asm volatile("pause");
+    }
+
+    // Tick at the same rate as the PIT.
+    spin_lock(&kernel_lock);
+    cpu_lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV16);
+    cpu_lapic_write(LAPIC_REG_TIMER, LAPIC_TIMER_PERIODIC | IRQ_APIC_TIMER);
+    cpu_lapic_write(LAPIC_REG_TIMER_INIT, cpu_lapic_tick_count);
+
+    cpu->current = cpu->idle_proc;
+    cpu->current->state = ACTIVE;
+    cpu->exit_tsc = tsc_read();
+    spin_unlock(&kernel_lock);
+
+    kernel_context_exit(cpu->idle_proc->trapframe);
+}
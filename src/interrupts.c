@@ -25,6 +25,8 @@
 #define PIC2_DATA   (PIC2_BASE+1)   // address for setting data for PIC2
 
 #define PIC_EOI     0x20            // PIC End-of-Interrupt command
+#define PIC_READ_ISR 0x0b           // PIC OCW3 command to read the in-service register
+#define PIC_CASCADE 2               // PIC1 input the secondary PIC is chained to
 
 // Interrupt descriptor table
 struct i386_gate *idt = NULL;
@@ -214,6 +216,41 @@ int pic_irq_enabled(int irq) {
     return (mask & (1 << irq)) ? 0 : 1;
 }
 
+/**
+ * Returns the highest priority IRQ in service on the PIC
+ *
+ * @return IRQ number (0x20 - 0x2f), -1 if none
+ */
+int pic_irq_in_service(void) {
+    int isr1;
+    int isr2;
+
+    outportb(PIC1_CMD, PIC_READ_ISR);
+    outportb(PIC2_CMD, PIC_READ_ISR);
+    isr1 = inportb(PIC1_CMD);
+    isr2 = inportb(PIC2_CMD);
+
+    // Lower IRQs have higher priority; the secondary PIC's IRQs rank at
+    // the cascade input.
+    for(int irq = 0; irq < 8; irq++) {
+        if(!(isr1 & (1 << irq))) {
+            continue;
+        }
+
+        if(irq == PIC_CASCADE) {
+            for(int irq2 = 0; irq2 < 8; irq2++) {
+                if(isr2 & (1 << irq2)) {
+                    return 0x28 + irq2;
+                }
+            }
+        }
+
+        return 0x20 + irq;
+    }
+
+    return -1;
+}
+
 /**
  * Dismisses an interrupt by sending the EOI command to the appropriate
  * PIC device(s). If the IRQ is assosciated with the secondary PIC, the
@@ -14,6 +14,9 @@
 #include "vga.h"
 #include "scheduler.h"
 #include "interrupts.h"
+#include "timer.h"
+#include "tsc.h"
+#include "kpaging.h"
 
 #ifndef KERNEL_LOG_LEVEL_DEFAULT
 #define KERNEL_LOG_LEVEL_DEFAULT KERNEL_LOG_LEVEL_INFO
@@ -22,6 +25,9 @@
 // Current log level
 int kernel_log_level = KERNEL_LOG_LEVEL_DEFAULT;
 
+// Serializes the kernel context between CPUs
+spinlock_t kernel_lock;
+
 /**
  * Initializes any kernel internal data structures and variables
  */
@@ -31,6 +37,8 @@ void kernel_init() {
 
     kernel_log_info("Initializing kernel...");
 
+    spin_init(&kernel_lock);
+
 }
 
 /**
@@ -248,21 +256,82 @@ void kernel_exit() {
 }
 
 void kernel_context_enter(trapframe_t *trapframe) {
-    // Save currently running trapframe.
-    if(active_proc) {
-        active_proc->trapframe = trapframe;
+    unsigned long long enter_tsc = tsc_read();
+    unsigned long long exit_tsc;
+    int interrupt = trapframe->interrupt;
+    cpu_t *cpu = cpu_get();
+    proc_t *proc;
+    int pid = -1;
+
+    // Only one CPU runs in the kernel context at a time. This covers the
+    // process table, run queues, mutexes, semaphores and timers.
+    spin_lock(&kernel_lock);
+    cpu->lock_cycles += tsc_read() - enter_tsc;
+    proc = cpu->current;
+
+    // Drop stale mappings of stacks freed by other CPUs.
+    kpaging_sync();
+
+    // Save currently running trapframe, as the kernel addresses it.
+    if(proc) {
+        proc->trapframe = kproc_enter(proc, trapframe);
+
+        // The process has been running since the kernel context was exited.
+        proc->user_cycles += enter_tsc - cpu->exit_tsc;
+        pid = proc->pid;
+
+        // Stop before an overflow spreads past the process' stack.
+        if(kproc_stack_check(proc) != 0) {
+            kernel_panic("Process %s (pid %d) overflowed its %d byte stack!",
+                         proc->name, proc->pid, proc->stack_size);
+        }
+    }
+
+    // Catch up on ticks that passed while the tick was stopped. A timer
+    // interrupt accounts for them itself, and the other CPUs' local ticks
+    // don't need the PIT.
+    if(interrupt != IRQ_TIMER && interrupt != IRQ_APIC_TIMER) {
+        timer_tickless_exit();
     }
 
     // Process interrupt that occured.
-    interrupts_irq_handler(trapframe->interrupt);
+    interrupts_irq_handler(interrupt);
+
+    // Finish a process that another CPU ended while it ran here.
+    if(proc && proc->pid == pid && proc->exit_pending) {
+        kproc_exit(proc, proc->exit_status);
+    }
 
     // Run the Scheduler.
     scheduler_run();
 
-    if(!active_proc) {
+    if(!cpu->current) {
         kernel_panic("No active process!");
     }
 
+    // Stop the periodic tick while every CPU is idle. Only the bootstrap
+    // processor receives the PIT.
+    if(cpu->bsp && cpu_all_idle()) {
+        timer_tickless_enter(scheduler_next_wakeup());
+    }
+
+    // Charge the time spent in the kernel to the interrupted process; its
+    // own system calls count as kernel time, anything else as IRQ time.
+    // The process may have exited while in the kernel.
+    exit_tsc = tsc_read();
+    if(proc && proc->pid == pid) {
+        if(interrupt == IRQ_SYSCALL) {
+            proc->kernel_cycles += exit_tsc - enter_tsc;
+        }
+        else {
+            proc->irq_cycles += exit_tsc - enter_tsc;
+        }
+    }
+    cpu->exit_tsc = exit_tsc;
+
+    trapframe = kproc_resume(cpu->current);
+    spin_unlock(&kernel_lock);
+
     // Exit kernel context.
-    kernel_context_exit(active_proc->trapframe);
+    kernel_context_exit(trapframe);
 }
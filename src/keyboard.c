@@ -455,14 +455,14 @@ unsigned int keyboard_decode(unsigned int c) {
 
     //When CTRL + n is pressed together, create a new process.
     if(d == 110 && (CTRL_L_ON == true || CTRL_R_ON == true)) {
-        kproc_create(test_proc, "test", PROC_TYPE_USER);
+        kproc_create(test_proc, "test", PROC_TYPE_USER, 0);
         // Avoids printing characters when the intention is to create processes.
         return KEY_NULL;
     }
 
     //When CTRL + q is pressed together, create a new process.
     if(d == 113 && (CTRL_L_ON == true || CTRL_R_ON == true)) {
-        kproc_destroy(active_proc);
+        kproc_exit(active_proc, -1);
         // Avoids printing characters when the intention is to destroy processes.
         return KEY_NULL;
     }
@@ -0,0 +1,312 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Heap
+ */
+
+#include <spede/stddef.h>
+#include <spede/stdio.h>
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "kheap.h"
+#include "kmem.h"
+#include "bit_util.h"
+
+#define KHEAP_MAGIC         0x51ab51ab  // Marks the start of a slab
+
+// Number of kmalloc size classes
+#define KHEAP_CLASSES       (KHEAP_MAX_SHIFT - KHEAP_MIN_SHIFT + 1)
+
+// Header at the start of every page the heap hands out
+// A slab holds objects of one cache. A large allocation has no cache
+// and spans `pages` pages. Any pointer from the heap finds its header by
+// rounding down to the page boundary.
+typedef struct kheap_slab_t {
+    unsigned int magic;         // KHEAP_MAGIC
+    kheap_cache_t *cache;       // Owning cache, NULL for a large allocation
+    int pages;                  // Pages in a large allocation
+    int in_use;                 // Objects allocated from the slab
+    void *free;                 // Free objects, linked through their first word
+    struct kheap_slab_t *next;  // Next slab on the cache's partial list
+    struct kheap_slab_t *prev;  // Previous slab on the cache's partial list
+} kheap_slab_t;
+
+// Bytes reserved at the start of a page for the header, kept 8-byte aligned
+#define KHEAP_HEADER_SIZE   ((sizeof(kheap_slab_t) + 7) & ~7)
+
+// kmalloc size classes, smallest first
+kheap_cache_t kheap_classes[KHEAP_CLASSES];
+
+// All caches
+kheap_cache_t *kheap_cache_list;
+
+/**
+ * Finds the header of the slab or large allocation holding a pointer
+ * @param ptr - pointer returned by the heap
+ * @return pointer to the header, NULL if the pointer isn't from the heap
+ */
+kheap_slab_t *kheap_slab(void *ptr) {
+    kheap_slab_t *slab = (kheap_slab_t *)((unsigned int)ptr & ~(KMEM_PAGE_SIZE - 1));
+
+    if(slab->magic != KHEAP_MAGIC) {
+        return NULL;
+    }
+
+    return slab;
+}
+
+/**
+ * Adds a slab to the front of its cache's partial list
+ * @param cache - pointer to the cache
+ * @param slab - pointer to the slab
+ */
+void kheap_partial_push(kheap_cache_t *cache, kheap_slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial;
+
+    if(cache->partial) {
+        cache->partial->prev = slab;
+    }
+    cache->partial = slab;
+}
+
+/**
+ * Removes a slab from its cache's partial list
+ * @param cache - pointer to the cache
+ * @param slab - pointer to the slab
+ */
+void kheap_partial_remove(kheap_cache_t *cache, kheap_slab_t *slab) {
+    if(slab->prev) {
+        slab->prev->next = slab->next;
+    }
+    else {
+        cache->partial = slab->next;
+    }
+
+    if(slab->next) {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/**
+ * Allocates a new slab for a cache and puts it on the partial list
+ * @param cache - pointer to the cache
+ * @return 0 on success, -1 if out of memory
+ */
+int kheap_grow(kheap_cache_t *cache) {
+    kheap_slab_t *slab = kmem_page_alloc(1);
+    unsigned char *obj;
+
+    if(!slab) {
+        return -1;
+    }
+
+    slab->magic  = KHEAP_MAGIC;
+    slab->cache  = cache;
+    slab->pages  = 1;
+    slab->in_use = 0;
+    slab->free   = NULL;
+
+    // Link the objects so the lowest address is handed out first.
+    obj = (unsigned char *)slab + KHEAP_HEADER_SIZE + (cache->per_slab - 1) * cache->size;
+    for(int i = 0; i < cache->per_slab; i++, obj -= cache->size) {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+    }
+
+    kheap_partial_push(cache, slab);
+    cache->slabs++;
+    return 0;
+}
+
+/**
+ * Initializes a cache of equally sized objects
+ * @param cache - pointer to the cache
+ * @param name - cache name
+ * @param size - object size in bytes
+ * @return 0 on success, -1 on error
+ */
+int kheap_cache_init(kheap_cache_t *cache, char *name, int size) {
+    // Objects hold the free list link while free and stay word aligned.
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    if(size <= 0 || size > (int)(KMEM_PAGE_SIZE - KHEAP_HEADER_SIZE)) {
+        kernel_log_error("kheap: %d byte objects don't fit in a slab.", size);
+        return -1;
+    }
+
+    memset(cache, 0, sizeof(kheap_cache_t));
+    strncpy(cache->name, name, KHEAP_NAME_LEN - 1);
+    cache->size = size;
+    cache->per_slab = (KMEM_PAGE_SIZE - KHEAP_HEADER_SIZE) / size;
+
+    cache->next = kheap_cache_list;
+    kheap_cache_list = cache;
+    return 0;
+}
+
+/**
+ * Allocates an object from a cache
+ * @param cache - pointer to the cache
+ * @return pointer to the object, NULL if out of memory
+ */
+void *kheap_cache_alloc(kheap_cache_t *cache) {
+    kheap_slab_t *slab;
+    void *obj;
+
+    if(!cache->partial && kheap_grow(cache) != 0) {
+        kernel_log_warn("kheap: out of memory for cache %s.", cache->name);
+        return NULL;
+    }
+
+    slab = cache->partial;
+    obj = slab->free;
+    slab->free = *(void **)obj;
+    slab->in_use++;
+
+    // A full slab leaves the partial list until an object comes back.
+    if(!slab->free) {
+        kheap_partial_remove(cache, slab);
+    }
+
+    cache->in_use++;
+    cache->allocs++;
+    if(cache->in_use > cache->peak) {
+        cache->peak = cache->in_use;
+    }
+
+    return obj;
+}
+
+/**
+ * Returns an object to its cache
+ * @param cache - pointer to the cache
+ * @param obj - pointer to the object
+ */
+void kheap_cache_free(kheap_cache_t *cache, void *obj) {
+    kheap_slab_t *slab;
+
+    if(!obj) {
+        return;
+    }
+
+    slab = kheap_slab(obj);
+    if(!slab || slab->cache != cache) {
+        kernel_log_error("kheap: 0x%08x doesn't belong to cache %s.", (unsigned int)obj, cache->name);
+        return;
+    }
+
+    // A full slab has a free object again.
+    if(!slab->free) {
+        kheap_partial_push(cache, slab);
+    }
+
+    *(void **)obj = slab->free;
+    slab->free = obj;
+    slab->in_use--;
+
+    cache->in_use--;
+    cache->frees++;
+
+    // Give an empty slab back unless it's the only one left with room.
+    if(slab->in_use == 0 && (slab->prev || slab->next)) {
+        kheap_partial_remove(cache, slab);
+        slab->magic = 0;
+        kmem_page_free(slab, 1);
+        cache->slabs--;
+    }
+}
+
+/**
+ * Returns the list of all caches, for reporting statistics
+ * @return pointer to the first cache
+ */
+kheap_cache_t *kheap_caches(void) {
+    return kheap_cache_list;
+}
+
+/**
+ * Allocates kernel memory
+ * Requests up to 1024 bytes come from the power-of-two size class
+ * caches; larger requests get whole pages.
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if out of memory
+ */
+void *kmalloc(int size) {
+    kheap_slab_t *slab;
+    int pages;
+    int shift;
+
+    if(size <= 0) {
+        return NULL;
+    }
+
+    if(size <= (1 << KHEAP_MAX_SHIFT)) {
+        // The class is the next power of two that holds the request.
+        shift = bit_find_last(size - 1);
+        if(shift < KHEAP_MIN_SHIFT) {
+            shift = KHEAP_MIN_SHIFT;
+        }
+        return kheap_cache_alloc(&kheap_classes[shift - KHEAP_MIN_SHIFT]);
+    }
+
+    pages = (size + KHEAP_HEADER_SIZE + KMEM_PAGE_SIZE - 1) / KMEM_PAGE_SIZE;
+    slab = kmem_page_alloc(pages);
+    if(!slab) {
+        kernel_log_warn("kheap: out of memory for %d bytes.", size);
+        return NULL;
+    }
+
+    slab->magic = KHEAP_MAGIC;
+    slab->cache = NULL;
+    slab->pages = pages;
+    return (unsigned char *)slab + KHEAP_HEADER_SIZE;
+}
+
+/**
+ * Frees memory allocated by kmalloc or kheap_cache_alloc
+ * @param ptr - pointer to the memory, may be NULL
+ */
+void kfree(void *ptr) {
+    kheap_slab_t *slab;
+
+    if(!ptr) {
+        return;
+    }
+
+    slab = kheap_slab(ptr);
+    if(!slab) {
+        kernel_log_error("kheap: 0x%08x was not allocated from the heap.", (unsigned int)ptr);
+        return;
+    }
+
+    if(slab->cache) {
+        kheap_cache_free(slab->cache, ptr);
+    }
+    else {
+        slab->magic = 0;
+        kmem_page_free(slab, slab->pages);
+    }
+}
+
+/**
+ * Initializes the kernel heap and the kmalloc size classes
+ */
+void kheap_init(void) {
+    char name[KHEAP_NAME_LEN];
+
+    kernel_log_info("Initializing kernel heap");
+
+    kheap_cache_list = NULL;
+
+    for(int i = 0; i < KHEAP_CLASSES; i++) {
+        snprintf(name, sizeof(name), "kmalloc-%d", 1 << (i + KHEAP_MIN_SHIFT));
+        kheap_cache_init(&kheap_classes[i], name, 1 << (i + KHEAP_MIN_SHIFT));
+    }
+}
@@ -0,0 +1,413 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Memory Allocator
+ */
+
+#include <spede/stddef.h>
+#include <spede/string.h>
+#include <spede/machine/io.h>
+
+#include "kernel.h"
+#include "kmem.h"
+#include "kpaging.h"
+
+// CMOS memory size registers
+#define CMOS_PORT_INDEX     0x70
+#define CMOS_PORT_DATA      0x71
+#define CMOS_EXT_MEM_LOW    0x30    // KB above 1MB, low byte
+#define CMOS_EXT_MEM_HIGH   0x31    // KB above 1MB, high byte
+#define CMOS_HIGH_MEM_LOW   0x34    // 64KB blocks above 16MB, low byte
+#define CMOS_HIGH_MEM_HIGH  0x35    // 64KB blocks above 16MB, high byte
+
+#define KMEM_ORDER_USED     0xff    // Page is allocated or inside a free block
+
+// Free block, linked through its first page
+typedef struct kmem_block_t {
+    struct kmem_block_t *next;
+    struct kmem_block_t *prev;
+} kmem_block_t;
+
+// End of the kernel image, provided by the linker
+extern char end[];
+
+// Usable memory regions
+kmem_region_t kmem_regions[KMEM_REGIONS_MAX];
+int kmem_region_count;
+
+// First managed page and the number of pages after it
+unsigned int kmem_base;
+int kmem_pages;
+
+// Order of the free block starting at each page, KMEM_ORDER_USED otherwise
+unsigned char *kmem_order;
+
+// References to each allocated page beyond the first (copy-on-write sharing)
+unsigned short *kmem_refs;
+
+// Free blocks of each order (buddy allocator)
+kmem_block_t *kmem_free_lists[KMEM_MAX_ORDER + 1];
+
+// Number of free pages
+int kmem_free;
+
+/**
+ * Reads a CMOS register
+ * @param reg - register index
+ * @return register value
+ */
+unsigned char kmem_cmos_read(unsigned char reg) {
+    outportb(CMOS_PORT_INDEX, reg);
+    return inportb(CMOS_PORT_DATA);
+}
+
+/**
+ * Builds the memory map from the memory sizes the BIOS stores in CMOS
+ * SPEDE doesn't pass a multiboot/E820 map to the kernel, so this is the
+ * fallback when nothing was added with kmem_region_add.
+ */
+void kmem_probe(void) {
+    unsigned int ext_kb = kmem_cmos_read(CMOS_EXT_MEM_LOW)
+                        | (kmem_cmos_read(CMOS_EXT_MEM_HIGH) << 8);
+    unsigned int high_blocks = kmem_cmos_read(CMOS_HIGH_MEM_LOW)
+                             | (kmem_cmos_read(CMOS_HIGH_MEM_HIGH) << 8);
+
+    // Memory above 16MB is only reported in its own registers.
+    if(high_blocks) {
+        kmem_region_add(0x100000, 0xf00000);
+        kmem_region_add(0x1000000, high_blocks * 0x10000);
+    }
+    else {
+        kmem_region_add(0x100000, ext_kb * 1024);
+    }
+}
+
+/**
+ * Converts a page number to its address
+ * @param page - page number from the first managed page
+ * @return pointer to the page
+ */
+kmem_block_t *kmem_page_addr(int page) {
+    return (kmem_block_t *)(kmem_base + page * KMEM_PAGE_SIZE);
+}
+
+/**
+ * Converts an address to its page number
+ * @param addr - pointer into a page
+ * @return page number from the first managed page
+ */
+int kmem_addr_page(void *addr) {
+    return ((unsigned int)addr - kmem_base) / KMEM_PAGE_SIZE;
+}
+
+/**
+ * Adds a block to the free list of its order
+ * @param page - first page of the block
+ * @param order - order of the block
+ */
+void kmem_list_push(int page, int order) {
+    kmem_block_t *block = kmem_page_addr(page);
+
+    block->prev = NULL;
+    block->next = kmem_free_lists[order];
+    if(block->next) {
+        block->next->prev = block;
+    }
+    kmem_free_lists[order] = block;
+    kmem_order[page] = order;
+}
+
+/**
+ * Removes a block from the free list of its order
+ * @param page - first page of the block
+ * @param order - order of the block
+ */
+void kmem_list_remove(int page, int order) {
+    kmem_block_t *block = kmem_page_addr(page);
+
+    if(block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        kmem_free_lists[order] = block->next;
+    }
+
+    if(block->next) {
+        block->next->prev = block->prev;
+    }
+    kmem_order[page] = KMEM_ORDER_USED;
+}
+
+/**
+ * Frees a block, merging it with its buddy for as long as the buddy is free
+ * @param page - first page of the block
+ * @param order - order of the block
+ */
+void kmem_block_free(int page, int order) {
+    int buddy;
+
+    while(order < KMEM_MAX_ORDER) {
+        buddy = page ^ (1 << order);
+
+        if(buddy + (1 << order) > kmem_pages || kmem_order[buddy] != order) {
+            break;
+        }
+
+        kmem_list_remove(buddy, order);
+        if(buddy < page) {
+            page = buddy;
+        }
+        order++;
+    }
+
+    kmem_list_push(page, order);
+}
+
+/**
+ * Frees a run of pages as the largest aligned blocks that cover it
+ * @param page - first page of the run
+ * @param count - number of pages
+ */
+void kmem_range_free(int page, int count) {
+    int order;
+
+    while(count > 0) {
+        order = 0;
+        while(order < KMEM_MAX_ORDER && (page & ((2 << order) - 1)) == 0 && (2 << order) <= count) {
+            order++;
+        }
+
+        kmem_block_free(page, order);
+        page += 1 << order;
+        count -= 1 << order;
+    }
+}
+
+/**
+ * Adds a region of usable memory to the memory map
+ * Must be called before kmem_init; regions are clipped to the memory
+ * after the kernel image and below KPAGING_KERNEL_TOP.
+ * @param base - physical address of the region
+ * @param length - length of the region in bytes
+ * @return 0 on success, -1 if the map is full
+ */
+int kmem_region_add(unsigned int base, unsigned int length) {
+    if(kmem_region_count >= KMEM_REGIONS_MAX) {
+        kernel_log_warn("kmem: memory map is full; ignoring 0x%08x.", base);
+        return -1;
+    }
+
+    // Only memory the kernel has mapped can be handed out.
+    if(base >= KPAGING_KERNEL_TOP) {
+        return 0;
+    }
+    if(length > KPAGING_KERNEL_TOP - base) {
+        length = KPAGING_KERNEL_TOP - base;
+    }
+
+    kmem_regions[kmem_region_count].base = base;
+    kmem_regions[kmem_region_count].length = length;
+    kmem_region_count++;
+    return 0;
+}
+
+/**
+ * Initializes the kernel memory allocator
+ * Builds the memory map (probing the firmware if nothing was added) and
+ * hands every usable page after the kernel image to the page allocator.
+ */
+void kmem_init(void) {
+    unsigned int top = 0;
+    unsigned int first;
+    unsigned int last;
+    int meta;
+
+    kernel_log_info("Initializing kernel memory allocator");
+
+    if(kmem_region_count == 0) {
+        kmem_probe();
+    }
+
+    // Manage every page from the end of the kernel image to the end of
+    // the highest region; pages in holes are simply never freed.
+    kmem_base = ((unsigned int)end + KMEM_PAGE_SIZE - 1) & ~(KMEM_PAGE_SIZE - 1);
+
+    for(int i = 0; i < kmem_region_count; i++) {
+        last = kmem_regions[i].base + kmem_regions[i].length;
+        if(last > top) {
+            top = last;
+        }
+    }
+
+    if(top <= kmem_base) {
+        kernel_panic("kmem: no memory after the kernel image!");
+    }
+    kmem_pages = (top - kmem_base) / KMEM_PAGE_SIZE;
+
+    // The order and reference count of each page are kept in the first
+    // managed pages.
+    meta = (kmem_pages * (sizeof(unsigned char) + sizeof(unsigned short)) + 1 + KMEM_PAGE_SIZE - 1) / KMEM_PAGE_SIZE;
+    kmem_order = (unsigned char *)kmem_base;
+    memset(kmem_order, KMEM_ORDER_USED, kmem_pages);
+    kmem_refs = (unsigned short *)(kmem_base + ((kmem_pages + 1) & ~1));
+    memset(kmem_refs, 0, kmem_pages * sizeof(unsigned short));
+
+    for(int i = 0; i <= KMEM_MAX_ORDER; i++) {
+        kmem_free_lists[i] = NULL;
+    }
+    kmem_free = 0;
+
+    for(int i = 0; i < kmem_region_count; i++) {
+        first = kmem_regions[i].base;
+        last = kmem_regions[i].base + kmem_regions[i].length;
+
+        if(first < kmem_base + meta * KMEM_PAGE_SIZE) {
+            first = kmem_base + meta * KMEM_PAGE_SIZE;
+        }
+
+        // Only whole pages inside the region are usable.
+        first = (first + KMEM_PAGE_SIZE - 1) & ~(KMEM_PAGE_SIZE - 1);
+        last &= ~(KMEM_PAGE_SIZE - 1);
+
+        if(first >= last) {
+            continue;
+        }
+
+        kmem_range_free(kmem_addr_page((void *)first), (last - first) / KMEM_PAGE_SIZE);
+        kmem_free += (last - first) / KMEM_PAGE_SIZE;
+    }
+
+    kernel_log_info("kmem: %d of %d pages free at 0x%08x", kmem_free, kmem_pages, kmem_base);
+}
+
+/**
+ * Allocates contiguous pages of kernel memory
+ * @param count - number of pages
+ * @return pointer to the first page, NULL if not enough memory is free
+ */
+void *kmem_page_alloc(int count) {
+    int order = 0;
+    int found;
+    int page;
+
+    if(count <= 0 || count > kmem_free) {
+        return NULL;
+    }
+
+    while((1 << order) < count) {
+        order++;
+    }
+
+    if(order > KMEM_MAX_ORDER) {
+        kernel_log_warn("kmem: %d pages is larger than the largest block.", count);
+        return NULL;
+    }
+
+    // Take the smallest free block that is large enough.
+    for(found = order; found <= KMEM_MAX_ORDER && !kmem_free_lists[found]; found++);
+
+    if(found > KMEM_MAX_ORDER) {
+        kernel_log_warn("kmem: no run of %d free pages.", count);
+        return NULL;
+    }
+
+    page = kmem_addr_page(kmem_free_lists[found]);
+    kmem_list_remove(page, found);
+
+    // Split it, freeing the upper halves, until it is the right order.
+    while(found > order) {
+        found--;
+        kmem_list_push(page + (1 << found), found);
+    }
+
+    // Give back the pages past the requested count.
+    kmem_range_free(page + count, (1 << order) - count);
+
+    kmem_free -= count;
+    return kmem_page_addr(page);
+}
+
+/**
+ * Frees pages allocated by kmem_page_alloc
+ * A single page shared with kmem_page_share loses one reference and is
+ * only freed with the last.
+ * @param addr - pointer to the first page
+ * @param count - number of pages
+ */
+void kmem_page_free(void *addr, int count) {
+    int page;
+
+    if(!addr) {
+        return;
+    }
+
+    page = kmem_addr_page(addr);
+
+    if((unsigned int)addr < kmem_base || count <= 0 || page + count > kmem_pages) {
+        kernel_log_error("kmem: 0x%08x is not kernel memory.", (unsigned int)addr);
+        return;
+    }
+
+    if(kmem_order[page] != KMEM_ORDER_USED) {
+        kernel_log_error("kmem: page 0x%08x freed twice.", (unsigned int)addr);
+        return;
+    }
+
+    // A shared page is only freed with its last reference.
+    if(count == 1 && kmem_refs[page] > 0) {
+        kmem_refs[page]--;
+        return;
+    }
+
+    kmem_range_free(page, count);
+    kmem_free += count;
+}
+
+/**
+ * Returns the number of pages that are free
+ * @return number of free pages
+ */
+int kmem_pages_free(void) {
+    return kmem_free;
+}
+
+/**
+ * Adds a reference to an allocated page
+ * The page is then only freed once kmem_page_free has been called for
+ * every reference.
+ * @param addr - pointer to the page
+ * @return 0 on success, -1 on error
+ */
+int kmem_page_share(void *addr) {
+    int page = kmem_addr_page(addr);
+
+    if((unsigned int)addr < kmem_base || page >= kmem_pages || kmem_order[page] != KMEM_ORDER_USED) {
+        kernel_log_error("kmem: 0x%08x is not an allocated page.", (unsigned int)addr);
+        return -1;
+    }
+
+    if(kmem_refs[page] == 0xffff) {
+        kernel_log_warn("kmem: page 0x%08x has too many references.", (unsigned int)addr);
+        return -1;
+    }
+
+    kmem_refs[page]++;
+    return 0;
+}
+
+/**
+ * Indicates if a page has more than one reference
+ * @param addr - pointer to the page
+ * @return 1 if the page is shared, 0 otherwise
+ */
+int kmem_page_shared(void *addr) {
+    int page = kmem_addr_page(addr);
+
+    if((unsigned int)addr < kmem_base || page >= kmem_pages) {
+        return 0;
+    }
+
+    return kmem_refs[page] > 0;
+}
@@ -13,13 +13,136 @@
 #include "queue.h"
 #include "scheduler.h"
 #include "kproc.h"
+#include "kheap.h"
 
-// Table of all mutexes
-mutex_t mutexes[MUTEX_MAX];
+// Table of all mutexes, NULL where the id is free
+mutex_t *mutexes[MUTEX_MAX];
+
+// Cache the mutexes are allocated from
+kheap_cache_t mutex_cache;
 
 // Mutex ids to be allocated
 queue_t mutex_queue;
 
+// 1 when owners inherit the priority of their waiters
+int kmutex_inheritance = 1;
+
+/**
+ * Removes a process from the mutex wait queue
+ * @param mutex - pointer to the mutex
+ * @param proc - pointer to the process entry
+ */
+void kmutex_wait_remove(mutex_t *mutex, proc_t *proc) {
+    int pid;
+    int size = mutex->wait_queue.size;
+
+    for(int i = 0; i < size; i++) {
+        if(queue_out(&mutex->wait_queue, &pid) != 0) {
+            kernel_log_warn("kmutex: Unable to queue out process from the mutex wait queue.");
+            continue;
+        }
+
+        if(pid != proc->pid) {
+            queue_in(&mutex->wait_queue, pid);
+        }
+    }
+}
+
+/**
+ * Adds a process to the mutex wait queue in priority order
+ * Processes of equal priority are kept in the order they arrived.
+ * @param mutex - pointer to the mutex
+ * @param proc - pointer to the process entry
+ * @return -1 on error, 0 on success
+ */
+int kmutex_wait_insert(mutex_t *mutex, proc_t *proc) {
+    int pid;
+    int inserted = 0;
+    int size = mutex->wait_queue.size;
+    int priority = scheduler_priority(proc);
+    proc_t *waiter;
+
+    if(queue_is_full(&mutex->wait_queue)) {
+        return -1;
+    }
+
+    // Rotate through the queue once, placing the process in front of
+    // the first waiter with a lower priority.
+    for(int i = 0; i < size; i++) {
+        queue_out(&mutex->wait_queue, &pid);
+        waiter = pid_to_proc(pid);
+
+        if(!inserted && waiter && scheduler_priority(waiter) > priority) {
+            queue_in(&mutex->wait_queue, proc->pid);
+            inserted = 1;
+        }
+        queue_in(&mutex->wait_queue, pid);
+    }
+
+    if(!inserted) {
+        queue_in(&mutex->wait_queue, proc->pid);
+    }
+
+    return 0;
+}
+
+/**
+ * Propagates a waiter's priority to the owner of a mutex
+ * If the owner is itself waiting on a mutex, the priority is passed
+ * along the chain of owners.
+ * @param mutex - pointer to the mutex being waited on
+ * @param priority - priority level of the waiting process
+ */
+void kmutex_inherit(mutex_t *mutex, int priority) {
+    proc_t *owner;
+
+    while(kmutex_inheritance && mutex && mutex->owner) {
+        owner = mutex->owner;
+
+        // Nothing further to do once an owner already runs high enough.
+        if(scheduler_priority(owner) <= priority) {
+            break;
+        }
+
+        scheduler_inherit_priority(owner, priority);
+
+        // Keep the owner's position in its own wait queue in order.
+        mutex = owner->waiting_mutex;
+        if(mutex) {
+            kmutex_wait_remove(mutex, owner);
+            kmutex_wait_insert(mutex, owner);
+        }
+    }
+}
+
+/**
+ * Recomputes the priority a process inherits from the mutexes it holds
+ * The process runs at the highest priority among all of their waiters,
+ * or its own while inheritance is off.
+ * @param proc - pointer to the process entry
+ */
+void kmutex_update_inherited(proc_t *proc) {
+    int pid;
+    int priority = SCHEDULER_LEVELS;
+    proc_t *waiter;
+
+    for(int i = 0; kmutex_inheritance && i < MUTEX_MAX; i++) {
+        if(!mutexes[i] || mutexes[i]->owner != proc || queue_is_empty(&mutexes[i]->wait_queue)) {
+            continue;
+        }
+
+        // Wait queues are in priority order, so only the head matters.
+        pid = mutexes[i]->wait_queue.items[mutexes[i]->wait_queue.head];
+        waiter = pid_to_proc(pid);
+
+        if(waiter && scheduler_priority(waiter) < priority) {
+            priority = scheduler_priority(waiter);
+        }
+    }
+
+    scheduler_inherit_priority(proc, priority);
+}
+
 /**
  * Initializes kernel mutex data structures
  * @return -1 on error, 0 on success
@@ -27,12 +150,13 @@ queue_t mutex_queue;
 int kmutexes_init() {
     kernel_log_info("Initializing kernel mutexes");
 
-    // Initialize the mutex table.
+    // Initialize the mutex table; mutexes are allocated as they're used.
     for(int i = 0; i < MUTEX_MAX; i++) {
-        mutexes[i].allocated = 0;
-        mutexes[i].locks = 0;
-        mutexes[i].owner = NULL;
-        queue_init(&mutexes[i].wait_queue);
+        mutexes[i] = NULL;
+    }
+
+    if(kheap_cache_init(&mutex_cache, "mutex", sizeof(mutex_t)) != 0) {
+        return -1;
     }
 
     // Initialize the mutex queue.
@@ -69,8 +193,13 @@ int kmutex_init(void) {
         return -1;
     }
 
-    // Pointer to the mutex table entry.
-    mutex = &mutexes[id];
+    // Allocate the mutex.
+    mutex = kheap_cache_alloc(&mutex_cache);
+    if(!mutex) {
+        queue_in(&mutex_queue, id);
+        return -1;
+    }
+    mutexes[id] = mutex;
 
     // Initialize the mutex data structure (mutex_t + all members).
     memset(mutex, 0, sizeof(mutex_t));
@@ -100,7 +229,11 @@ int kmutex_destroy(int id) {
     }
 
     // Look up the mutex in the mutex table.
-    mutex = &mutexes[id];
+    mutex = mutexes[id];
+    if(!mutex) {
+        kernel_log_error("kmutex: Unable to destroy unallocated mutex.");
+        return -1;
+    }
 
     // If the mutex is locked, prevent it from being destroyed (return error).
     if(mutex->locks > 0) {
@@ -114,8 +247,9 @@ int kmutex_destroy(int id) {
         return -1;
     }
 
-    // Clear the memory for the data structure.
-    free(mutex);
+    // Return the memory for the data structure.
+    mutexes[id] = NULL;
+    kheap_cache_free(&mutex_cache, mutex);
 
     return 0;
 }
@@ -135,7 +269,11 @@ int kmutex_lock(int id) {
     }
 
     // Look up the mutex in the mutex table.
-    mutex = &mutexes[id];
+    mutex = mutexes[id];
+    if(!mutex) {
+        kernel_log_error("kmutex: Unable to lock unallocated mutex.");
+        return -1;
+    }
 
     // If the mutex is already locked
     //   1. Set the active process state to WAITING
@@ -151,10 +289,14 @@ int kmutex_lock(int id) {
         }
         active_proc -> state = WAITING;
 
-        if(queue_in(&mutex -> wait_queue, active_proc -> pid) != 0) {
+        if(kmutex_wait_insert(mutex, active_proc) != 0) {
             kernel_log_error("kmutex: Unable to add process to the mutex wait queue");
             return -1;
         }
+        active_proc->waiting_mutex = mutex;
+
+        // The owner runs at least at the waiter's priority until it unlocks.
+        kmutex_inherit(mutex, scheduler_priority(active_proc));
 
         scheduler_remove(active_proc);
     }
@@ -171,6 +313,55 @@ int kmutex_lock(int id) {
     return mutex->locks;
 }
 
+/**
+ * Releases the owner's hold on a mutex
+ * The mutex passes to the highest priority waiter that still exists.
+ * @param mutex - pointer to the mutex, which must be owned
+ * @return the remaining lock count
+ */
+int kmutex_release(mutex_t *mutex) {
+    proc_t *proc;
+    int pid = -1;
+
+    // Decrement the lock count.
+    mutex->locks--;
+
+    // Any priority inherited through this mutex no longer applies.
+    proc = mutex->owner;
+    mutex->owner = NULL;
+
+    // While there are still locks held:
+    //    1. Obtain the highest priority process from the mutex wait queue
+    //    2. Set the owner of the mutex to the process
+    // Waiters that have gone away since only drop their lock.
+    while(mutex->locks > 0 && !mutex->owner) {
+        if(queue_out(&mutex->wait_queue, &pid) != 0) {
+            kernel_log_error("kmutex: Lock count doesn't match the mutex wait queue.");
+            mutex->locks = 0;
+            break;
+        }
+
+        mutex->owner = pid_to_proc(pid);
+        if(!mutex->owner) {
+            kernel_log_warn("kmutex: Skipping pid %d, which no longer exists.", pid);
+            mutex->locks--;
+        }
+    }
+
+    kmutex_update_inherited(proc);
+
+    // Add the new owner back to the scheduler; it inherits from the
+    // processes still waiting.
+    proc = mutex->owner;
+    if(proc) {
+        proc->waiting_mutex = NULL;
+        scheduler_add(proc);
+        kmutex_update_inherited(proc);
+    }
+
+    return mutex->locks;
+}
+
 /**
  * Unlocks the specified mutex
  * @param id - the mutex id
@@ -178,8 +369,6 @@ int kmutex_lock(int id) {
  */
 int kmutex_unlock(int id) {
     mutex_t *mutex;
-    proc_t *proc;
-    int pid = -1;
 
     if(id < 0 || id >= MUTEX_MAX) {
         kernel_log_error("kmutex: Unable to unlock mutex ID outside valid range.");
@@ -187,35 +376,53 @@ int kmutex_unlock(int id) {
     }
 
     // Look up the mutex in the mutex table.
-    mutex = &mutexes[id];
+    mutex = mutexes[id];
+    if(!mutex) {
+        kernel_log_error("kmutex: Unable to unlock unallocated mutex.");
+        return -1;
+    }
 
     // If the mutex is not locked, there is nothing to do.
     if(!mutex->owner) {
         return 0;
     }
 
-    // Decrement the lock count.
-    mutex->locks--;
+    // Return the mutex lock count.
+    return kmutex_release(mutex);
+}
+
+/**
+ * Removes a process that is going away from every mutex
+ * The process leaves the wait queue it is in, so its owner stops
+ * inheriting from it, and any mutex it holds passes to the next waiter.
+ * @param proc - pointer to the process entry
+ */
+void kmutex_forget(proc_t *proc) {
+    mutex_t *mutex = proc->waiting_mutex;
 
-    // If there are no more locks held:
-    //    1. Clear the owner of the mutex
-    if(mutex->locks == 0) {
-        mutex->owner = NULL;
+    if(mutex) {
+        kmutex_wait_remove(mutex, proc);
+        mutex->locks--;
+        proc->waiting_mutex = NULL;
+
+        if(mutex->owner) {
+            kmutex_update_inherited(mutex->owner);
+        }
     }
-    // If there are still locks held:
-    //    1. Obtain a process from the mutex wait queue
-    //    2. Add the process back to the scheduler
-    //    3. Set the owner of the mutex to the process
-    else {
-        if(queue_out(&mutex->wait_queue, &pid) != 0) {
-            kernel_log_error("kmutex: Unable to obtain process from the mutex wait queue.");
-            return -1;
+
+    for(int i = 0; i < MUTEX_MAX; i++) {
+        if(mutexes[i] && mutexes[i]->owner == proc) {
+            kmutex_release(mutexes[i]);
         }
-        proc = pid_to_proc(pid);
-        scheduler_add(proc);
-        mutex->owner = proc;
     }
+}
 
-    // Return the mutex lock count.
-    return mutex->locks;
+/**
+ * Turns priority inheritance on or off
+ * An owner already running at an inherited priority keeps it until it
+ * next unlocks.
+ * @param inherit - 1 to have owners inherit their waiters' priority, 0 not to
+ */
+void kmutex_set_inherit(int inherit) {
+    kmutex_inheritance = inherit;
 }
@@ -0,0 +1,709 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Kernel Paging
+ *
+ * Everything below KPAGING_KERNEL_TOP is identity mapped with global 4MB
+ * pages, so the kernel runs exactly as it did before paging. Above it,
+ * 4KB pages are mapped on request (process stacks and heaps).
+ *
+ * Processes run in ring 0, so the CPU pushes a fault's frame on the
+ * faulting stack. A stack growing into an unmapped page can't take that
+ * push, so page faults are routed through a task gate to a task with its
+ * own stack; each CPU has its own fault task and interrupt table.
+ *
+ * Each CPU runs on its own copy of the kernel page directory, so that it
+ * can show a forked process' stack where the process expects it (see
+ * kpaging_alias) without disturbing the other CPUs.
+ */
+#include <spede/string.h>
+#include <spede/machine/proc_reg.h>
+#include <spede/machine/seg.h>
+
+#include "kernel.h"
+#include "kpaging.h"
+#include "kmem.h"
+#include "kproc.h"
+#include "proc_stack.h"
+#include "interrupts.h"
+
+#define KPAGING_IRQ_PAGE_FAULT  0x0e    // Page fault exception
+#define KPAGING_FAULT_STACK     8192    // Stack size of the page fault task
+#define KPAGING_GDT_MAX         64      // Maximum descriptors in the kernel GDT
+
+#define KPAGING_ACC_TSS         0x89    // Present, available 32-bit TSS
+#define KPAGING_ACC_TASK_GATE   0x85    // Present task gate
+
+#define KPAGING_CR0_PG          0x80000000  // Paging enable
+#define KPAGING_CR0_WP          0x00010000  // Read-only pages apply to the kernel too
+#define KPAGING_CR4_PSE         0x00000010  // 4MB page enable
+#define KPAGING_CR4_PGE         0x00000080  // Global page enable
+
+// Selectors of a CPU's task state segments in the kernel GDT
+#define KPAGING_TSS_SEL(id)     ((kpaging_gdt_tss + 2 * (id)) * 8)
+#define KPAGING_FAULT_SEL(id)   ((kpaging_gdt_tss + 2 * (id) + 1) * 8)
+
+// 32-bit task state segment
+typedef struct kpaging_tss_t {
+    unsigned int link;          // Selector of the task to return to
+    unsigned int esp0;
+    unsigned int ss0;
+    unsigned int esp1;
+    unsigned int ss1;
+    unsigned int esp2;
+    unsigned int ss2;
+    unsigned int cr3;           // Page directory loaded when entering the task
+    unsigned int eip;
+    unsigned int eflags;
+    unsigned int eax;
+    unsigned int ecx;
+    unsigned int edx;
+    unsigned int ebx;
+    unsigned int esp;
+    unsigned int ebp;
+    unsigned int esi;
+    unsigned int edi;
+    unsigned int es;
+    unsigned int cs;
+    unsigned int ss;
+    unsigned int ds;
+    unsigned int fs;
+    unsigned int gs;
+    unsigned int ldt;
+    unsigned int iomap;         // I/O permission map offset in the upper half
+} kpaging_tss_t;
+
+// Segment descriptor
+typedef struct kpaging_desc_t {
+    unsigned int lo;
+    unsigned int hi;
+} kpaging_desc_t;
+
+// Local APIC registers (cpu.c)
+extern volatile unsigned int *cpu_lapic;
+
+// Kernel page directory
+// Page tables are shared by every CPU's directory.
+unsigned int *kpaging_dir;
+
+// Page directory of each CPU
+unsigned int *kpaging_cpu_dir[CPU_MAX];
+
+// Directory entry each CPU shows another page table at, -1 if none, and
+// the entry of the table shown
+int kpaging_cpu_alias[CPU_MAX];
+int kpaging_cpu_from[CPU_MAX];
+
+// Kernel GDT: the boot descriptors followed by two task state segments
+// per CPU
+kpaging_desc_t kpaging_gdt[KPAGING_GDT_MAX];
+
+// Index of the first task state segment in the kernel GDT
+int kpaging_gdt_tss;
+
+// Task each CPU runs processes in, and its page fault task
+kpaging_tss_t kpaging_tss[CPU_MAX];
+kpaging_tss_t kpaging_fault_tss[CPU_MAX];
+
+// Stacks of the page fault tasks
+unsigned char kpaging_fault_stack[CPU_MAX][KPAGING_FAULT_STACK];
+
+// Advances whenever a mapping is removed; each CPU flushes its TLB when
+// it sees a generation it hasn't flushed for
+unsigned int kpaging_tlb_gen;
+unsigned int kpaging_tlb_seen[CPU_MAX];
+
+// Pages shared copy-on-write, and shared pages copied when written
+int kpaging_cow_shared;
+int kpaging_cow_copied;
+
+/**
+ * Reloads the page directory, flushing all non-global TLB entries
+ */
+void kpaging_flush(void) {
+    asm volatile("movl %0, %%cr3" : : "r"(kpaging_cpu_dir[cpu_id()]) : "memory");
+}
+
+/**
+ * Sets a page directory entry in the kernel and every CPU's directory
+ * @param index - directory index
+ * @param value - directory entry
+ */
+void kpaging_set_pde(int index, unsigned int value) {
+    kpaging_dir[index] = value;
+
+    for(int id = 0; id < CPU_MAX; id++) {
+        if(!kpaging_cpu_dir[id]) {
+            continue;
+        }
+
+        if(kpaging_cpu_alias[id] != index) {
+            kpaging_cpu_dir[id][index] = value;
+        }
+
+        if(kpaging_cpu_alias[id] >= 0 && kpaging_cpu_from[id] == index) {
+            kpaging_cpu_dir[id][kpaging_cpu_alias[id]] = value;
+        }
+    }
+}
+
+/**
+ * Fills in a task state segment descriptor
+ * @param index - GDT index
+ * @param tss - task state segment
+ */
+void kpaging_gdt_set_tss(int index, kpaging_tss_t *tss) {
+    unsigned int base = (unsigned int)tss;
+    unsigned int limit = sizeof(kpaging_tss_t) - 1;
+
+    kpaging_gdt[index].lo = (limit & 0xffff) | (base << 16);
+    kpaging_gdt[index].hi = ((base >> 16) & 0xff) | (KPAGING_ACC_TSS << 8)
+                          | (limit & 0xf0000) | (base & 0xff000000);
+}
+
+/**
+ * Sets up the current CPU's tasks and turns paging on
+ * @param idt - interrupt table of the CPU
+ */
+void kpaging_cpu_start(struct i386_gate *idt) {
+    int id = cpu_id();
+    kpaging_tss_t *tss = &kpaging_tss[id];
+    kpaging_tss_t *fault = &kpaging_fault_tss[id];
+    unsigned int *dir = kmem_page_alloc(1);
+    unsigned int cr;
+
+    if(!dir) {
+        kernel_panic("kpaging: unable to allocate a page directory for CPU %d!", id);
+    }
+    memcpy(dir, kpaging_dir, KMEM_PAGE_SIZE);
+    kpaging_cpu_dir[id] = dir;
+
+    // Switching tasks saves the running state in the current TSS and
+    // loads the page directory from the TSS being entered.
+    memset(tss, 0, sizeof(kpaging_tss_t));
+    tss->cr3   = (unsigned int)dir;
+    tss->iomap = sizeof(kpaging_tss_t) << 16;
+
+    memset(fault, 0, sizeof(kpaging_tss_t));
+    fault->cr3    = (unsigned int)dir;
+    fault->eip    = (unsigned int)kpaging_fault_task;
+    fault->eflags = EF_DEFAULT_VALUE;
+    fault->esp    = (unsigned int)&kpaging_fault_stack[id][KPAGING_FAULT_STACK];
+    fault->cs     = KCODE_SEG;
+    fault->ss     = KDATA_SEG;
+    fault->ds     = KDATA_SEG;
+    fault->es     = KDATA_SEG;
+    fault->fs     = KDATA_SEG;
+    fault->gs     = KDATA_SEG;
+    fault->iomap  = sizeof(kpaging_tss_t) << 16;
+
+    fill_gate(&idt[KPAGING_IRQ_PAGE_FAULT], 0, KPAGING_FAULT_SEL(id), KPAGING_ACC_TASK_GATE, 0);
+
+    asm volatile("movl %%cr4, %0" : "=r"(cr));
+    cr |= KPAGING_CR4_PSE | KPAGING_CR4_PGE;
+    asm volatile("movl %0, %%cr4" : : "r"(cr));
+
+    kpaging_flush();
+
+    asm volatile("movl %%cr0, %0" : "=r"(cr));
+    cr |= KPAGING_CR0_PG | KPAGING_CR0_WP;
+    asm volatile("movl %0, %%cr0" : : "r"(cr) : "memory");
+
+    asm volatile("ltr %w0" : : "r"(KPAGING_TSS_SEL(id)));
+
+    kpaging_tlb_seen[id] = kpaging_tlb_gen;
+}
+
+/**
+ * Initializes paging on the bootstrap processor
+ * Identity maps the kernel with global 4MB pages, routes page faults to
+ * a task with its own stack and turns paging on. Must be called after
+ * the local APIC has been found.
+ */
+void kpaging_init(void) {
+    unsigned short gdtr[3];
+    unsigned short idtr[3];
+    unsigned int addr;
+    int count;
+
+    kernel_log_info("Initializing paging");
+
+    kpaging_dir = kmem_page_alloc(1);
+    if(!kpaging_dir) {
+        kernel_panic("kpaging: unable to allocate the page directory!");
+    }
+    memset(kpaging_dir, 0, KMEM_PAGE_SIZE);
+
+    for(int id = 0; id < CPU_MAX; id++) {
+        kpaging_cpu_alias[id] = -1;
+    }
+
+    for(addr = 0; addr < KPAGING_KERNEL_TOP; addr += KPAGING_TABLE_SPAN) {
+        kpaging_dir[addr / KPAGING_TABLE_SPAN] = addr | KPAGING_PRESENT | KPAGING_WRITE
+                                               | KPAGING_LARGE | KPAGING_GLOBAL;
+    }
+
+    // The local APIC registers must not be cached.
+    if(cpu_lapic) {
+        addr = (unsigned int)cpu_lapic & ~(KPAGING_TABLE_SPAN - 1);
+        kpaging_dir[addr / KPAGING_TABLE_SPAN] = addr | KPAGING_PRESENT | KPAGING_WRITE
+                                               | KPAGING_LARGE | KPAGING_GLOBAL
+                                               | KPAGING_PCD | KPAGING_PWT;
+    }
+
+    // Copy the boot GDT and add the task state segments after it. The
+    // application processors pick the new GDT up from the trampoline.
+    asm volatile("sgdt %0" : "=m"(gdtr));
+    count = (gdtr[0] + 1) / sizeof(kpaging_desc_t);
+    if(count + 2 * CPU_MAX > KPAGING_GDT_MAX) {
+        kernel_panic("kpaging: no room for the task state segments in the GDT!");
+    }
+
+    memcpy(kpaging_gdt, (void *)(gdtr[1] | ((unsigned int)gdtr[2] << 16)), count * sizeof(kpaging_desc_t));
+    kpaging_gdt_tss = count;
+
+    for(int id = 0; id < CPU_MAX; id++) {
+        kpaging_gdt_set_tss(kpaging_gdt_tss + 2 * id, &kpaging_tss[id]);
+        kpaging_gdt_set_tss(kpaging_gdt_tss + 2 * id + 1, &kpaging_fault_tss[id]);
+    }
+
+    gdtr[0] = (kpaging_gdt_tss + 2 * CPU_MAX) * sizeof(kpaging_desc_t) - 1;
+    gdtr[1] = (unsigned int)kpaging_gdt & 0xffff;
+    gdtr[2] = (unsigned int)kpaging_gdt >> 16;
+    asm volatile("lgdt %0" : : "m"(gdtr));
+
+    // The bootstrap processor keeps the boot interrupt table.
+    asm volatile("sidt %0" : "=m"(idtr));
+    kpaging_cpu_start((struct i386_gate *)(idtr[1] | ((unsigned int)idtr[2] << 16)));
+
+    kernel_log_info("kpaging: paging enabled, %d MB identity mapped", KPAGING_KERNEL_TOP >> 20);
+}
+
+/**
+ * Turns paging on for an application processor
+ * Loads the kernel page directory and the CPU's own page fault task.
+ */
+void kpaging_cpu_init(void) {
+    unsigned short idtr[3];
+    struct i386_gate *idt;
+    int size;
+
+    // Each CPU needs its own page fault gate, so it gets its own copy of
+    // the interrupt table.
+    asm volatile("sidt %0" : "=m"(idtr));
+    size = idtr[0] + 1;
+
+    idt = kmem_page_alloc(1);
+    if(!idt || size > KMEM_PAGE_SIZE) {
+        kernel_panic("kpaging: unable to allocate an interrupt table for CPU %d!", cpu_id());
+    }
+    memcpy(idt, (void *)(idtr[1] | ((unsigned int)idtr[2] << 16)), size);
+
+    kpaging_cpu_start(idt);
+
+    idtr[1] = (unsigned int)idt & 0xffff;
+    idtr[2] = (unsigned int)idt >> 16;
+    asm volatile("lidt %0" : : "m"(idtr));
+}
+
+/**
+ * Returns the page table entry for an address
+ * @param vaddr - virtual address above the kernel mapping
+ * @return pointer to the entry, NULL if no page table covers the address
+ */
+unsigned int *kpaging_pte(unsigned int vaddr) {
+    unsigned int pde = kpaging_dir[vaddr / KPAGING_TABLE_SPAN];
+
+    if(vaddr < KPAGING_KERNEL_TOP || !(pde & KPAGING_PRESENT) || (pde & KPAGING_LARGE)) {
+        return NULL;
+    }
+
+    return &((unsigned int *)(pde & KPAGING_FRAME_MASK))[(vaddr % KPAGING_TABLE_SPAN) / KMEM_PAGE_SIZE];
+}
+
+/**
+ * Sets a page table entry, allocating the page table if needed
+ * @param vaddr - page aligned virtual address
+ * @param value - page table entry
+ * @return 0 on success, -1 on error
+ */
+int kpaging_set(unsigned int vaddr, unsigned int value) {
+    int index = vaddr / KPAGING_TABLE_SPAN;
+    unsigned int *table;
+
+    if(vaddr < KPAGING_KERNEL_TOP || (kpaging_dir[index] & KPAGING_LARGE)) {
+        kernel_log_error("kpaging: 0x%08x is in the kernel mapping.", vaddr);
+        return -1;
+    }
+
+    if(!(kpaging_dir[index] & KPAGING_PRESENT)) {
+        table = kmem_page_alloc(1);
+        if(!table) {
+            kernel_log_warn("kpaging: out of memory for a page table.");
+            return -1;
+        }
+
+        memset(table, 0, KMEM_PAGE_SIZE);
+        kpaging_set_pde(index, (unsigned int)table | KPAGING_PRESENT | KPAGING_WRITE);
+    }
+
+    *kpaging_pte(vaddr) = value;
+    return 0;
+}
+
+/**
+ * Maps a page of memory
+ * The page table covering the address is allocated if needed.
+ * @param vaddr - page aligned virtual address
+ * @param page - page to map, from kmem_page_alloc
+ * @return 0 on success, -1 on error
+ */
+int kpaging_map(unsigned int vaddr, void *page) {
+    return kpaging_set(vaddr, (unsigned int)page | KPAGING_PRESENT | KPAGING_WRITE);
+}
+
+/**
+ * Flushes one page from this CPU's TLB, and makes the other CPUs flush
+ * theirs when they next enter the kernel
+ * The page is flushed under this CPU's alias of its table as well. The
+ * other CPUs may alias the table elsewhere, so they flush everything.
+ * @param vaddr - page aligned virtual address
+ */
+void kpaging_invalidate(unsigned int vaddr) {
+    int id = cpu_id();
+    unsigned int alias;
+
+    asm volatile("invlpg (%0)" : : "r"(vaddr) : "memory");
+
+    if(kpaging_cpu_alias[id] >= 0 && kpaging_cpu_from[id] == (int)(vaddr / KPAGING_TABLE_SPAN)) {
+        alias = kpaging_cpu_alias[id] * KPAGING_TABLE_SPAN + vaddr % KPAGING_TABLE_SPAN;
+        asm volatile("invlpg (%0)" : : "r"(alias) : "memory");
+    }
+
+    // Only count this CPU as flushed if it was up to date before.
+    if(kpaging_tlb_seen[id] == kpaging_tlb_gen++) {
+        kpaging_tlb_seen[id] = kpaging_tlb_gen;
+    }
+}
+
+/**
+ * Unmaps a page of memory
+ * The page itself isn't freed.
+ * @param vaddr - page aligned virtual address
+ * @return the page that was mapped, NULL if nothing was mapped
+ */
+void *kpaging_unmap(unsigned int vaddr) {
+    unsigned int *pte = kpaging_pte(vaddr);
+    void *page;
+
+    if(!pte || !(*pte & KPAGING_PRESENT)) {
+        return NULL;
+    }
+
+    page = (void *)(*pte & KPAGING_FRAME_MASK);
+    *pte = 0;
+
+    kpaging_invalidate(vaddr);
+
+    return page;
+}
+
+/**
+ * Checks whether a page is mapped
+ * @param vaddr - page aligned virtual address
+ * @return 1 if a page is mapped at the address, 0 if not
+ */
+int kpaging_present(unsigned int vaddr) {
+    unsigned int *pte = kpaging_pte(vaddr);
+
+    return pte && (*pte & KPAGING_PRESENT);
+}
+
+/**
+ * Shares a page copy-on-write
+ * The page mapped at one address is mapped at another as well, and both
+ * mappings are made read-only; the first write to either gets its own
+ * copy. Call kpaging_shootdown once the pages have been shared.
+ * @param from - page aligned address of the mapped page
+ * @param to - page aligned address to map it at
+ * @return 0 on success, -1 on error
+ */
+int kpaging_share(unsigned int from, unsigned int to) {
+    unsigned int *pte = kpaging_pte(from);
+    void *page;
+
+    if(!pte || !(*pte & KPAGING_PRESENT)) {
+        return -1;
+    }
+
+    page = (void *)(*pte & KPAGING_FRAME_MASK);
+    if(kmem_page_share(page) != 0) {
+        return -1;
+    }
+
+    if(kpaging_set(to, (unsigned int)page | KPAGING_PRESENT | KPAGING_COW) != 0) {
+        kmem_page_free(page, 1);
+        return -1;
+    }
+
+    *pte = (*pte & ~KPAGING_WRITE) | KPAGING_COW;
+    kpaging_cow_shared++;
+    return 0;
+}
+
+/**
+ * Gives a copy-on-write page its own writable copy
+ * The last mapping of a page just becomes writable again.
+ * @param pte - page table entry of the written page
+ * @return 0 on success, -1 if out of memory
+ */
+int kpaging_cow(unsigned int *pte) {
+    void *page = (void *)(*pte & KPAGING_FRAME_MASK);
+    void *copy;
+
+    if(kmem_page_shared(page)) {
+        copy = kmem_page_alloc(1);
+        if(!copy) {
+            kernel_log_warn("kpaging: out of memory copying a shared page.");
+            return -1;
+        }
+
+        memcpy(copy, page, KMEM_PAGE_SIZE);
+        kmem_page_free(page, 1);
+        *pte = (unsigned int)copy | KPAGING_PRESENT | KPAGING_WRITE;
+        kpaging_cow_copied++;
+    }
+    else {
+        *pte = (*pte & ~KPAGING_COW) | KPAGING_WRITE;
+    }
+
+    kpaging_shootdown();
+    return 0;
+}
+
+/**
+ * Frees the page table covering an address
+ * Every page in the table must already be unmapped.
+ * @param vaddr - any address covered by the table
+ */
+void kpaging_table_free(unsigned int vaddr) {
+    int index = vaddr / KPAGING_TABLE_SPAN;
+    unsigned int pde = kpaging_dir[index];
+
+    if(vaddr < KPAGING_KERNEL_TOP || !(pde & KPAGING_PRESENT) || (pde & KPAGING_LARGE)) {
+        return;
+    }
+
+    kpaging_set_pde(index, 0);
+    kmem_page_free((void *)(pde & KPAGING_FRAME_MASK), 1);
+
+    kpaging_shootdown();
+}
+
+/**
+ * Shows the page table covering one address at another on this CPU
+ * A forked process' stack is addressed where its parent's was, so its
+ * stack's page table is shown there while it runs. The previous alias,
+ * if any, is removed.
+ * @param vaddr - address the table should appear at
+ * @param from - address the table is mapped at; vaddr itself for no alias
+ */
+void kpaging_alias(unsigned int vaddr, unsigned int from) {
+    int id = cpu_id();
+    unsigned int *dir = kpaging_cpu_dir[id];
+    int index = vaddr / KPAGING_TABLE_SPAN;
+    int source = from / KPAGING_TABLE_SPAN;
+
+    if(index == source) {
+        index = -1;
+    }
+
+    // Threads of the same process need no switch.
+    if(index == kpaging_cpu_alias[id] && (index < 0 || source == kpaging_cpu_from[id])) {
+        return;
+    }
+
+    if(kpaging_cpu_alias[id] >= 0) {
+        dir[kpaging_cpu_alias[id]] = kpaging_dir[kpaging_cpu_alias[id]];
+    }
+
+    if(index >= 0) {
+        dir[index] = kpaging_dir[source];
+    }
+
+    kpaging_cpu_alias[id] = index;
+    kpaging_cpu_from[id]  = source;
+    kpaging_flush();
+}
+
+/**
+ * Flushes this CPU's TLB and makes the other CPUs flush theirs when they
+ * next enter the kernel
+ */
+void kpaging_shootdown(void) {
+    kpaging_flush();
+    kpaging_tlb_gen++;
+    kpaging_tlb_seen[cpu_id()] = kpaging_tlb_gen;
+}
+
+/**
+ * Flushes this CPU's TLB if pages were unmapped since it last did so
+ * Must be called with the kernel lock held, before touching memory that
+ * another CPU may have unmapped.
+ */
+void kpaging_sync(void) {
+    int id = cpu_id();
+
+    if(kpaging_tlb_seen[id] != kpaging_tlb_gen) {
+        kpaging_flush();
+        kpaging_tlb_seen[id] = kpaging_tlb_gen;
+    }
+}
+
+/**
+ * Retrieves the copy-on-write counters
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int kpaging_get_stats(kpaging_stats_t *stats) {
+    if(!stats) {
+        return -1;
+    }
+
+    stats->shared = kpaging_cow_shared;
+    stats->copied = kpaging_cow_copied;
+    return 0;
+}
+
+/**
+ * Looks through a CPU's alias to the address it shows
+ * @param id - CPU id
+ * @param addr - address as code on the CPU sees it
+ * @return address valid on every CPU
+ */
+unsigned int kpaging_resolve(int id, unsigned int addr) {
+    if(kpaging_cpu_alias[id] >= 0 && (int)(addr / KPAGING_TABLE_SPAN) == kpaging_cpu_alias[id]) {
+        return addr % KPAGING_TABLE_SPAN + kpaging_cpu_from[id] * KPAGING_TABLE_SPAN;
+    }
+
+    return addr;
+}
+
+/**
+ * Makes an address on this CPU writable
+ * Maps an untouched stack or heap page or copies a copy-on-write page.
+ * @param id - CPU id
+ * @param addr - address as the faulting code saw it
+ * @return 0 on success, -1 if the address can't be made writable
+ */
+int kpaging_fix(int id, unsigned int addr) {
+    unsigned int *pte;
+
+    addr = kpaging_resolve(id, addr);
+    pte = kpaging_pte(addr);
+    if(!pte || !(*pte & KPAGING_PRESENT)) {
+        return proc_stack_fault(addr);
+    }
+
+    if(*pte & KPAGING_WRITE) {
+        return 0;
+    }
+
+    if(*pte & KPAGING_COW) {
+        return kpaging_cow(pte);
+    }
+
+    return -1;
+}
+
+/**
+ * Delivers an interrupt that a page fault cut short
+ * Processes run in ring 0, so the CPU pushes an interrupt's frame on the
+ * process stack. If that push faults, the interrupt has already been
+ * acknowledged but its handler never runs, and the controller won't
+ * raise it again until it is dismissed. An interrupt still in service
+ * when a process faults can only be such a one, so push the frame the
+ * CPU would have and send the task to the handler.
+ * @param id - CPU id
+ */
+void kpaging_redeliver(int id) {
+    kpaging_tss_t *tss = &kpaging_tss[id];
+    unsigned short idtr[3];
+    unsigned int *gate;
+    unsigned int *frame;
+    int vector = cpu_lapic_in_service();
+
+    // Only the bootstrap processor receives the PIC's interrupts.
+    if(vector < 0 && cpu_get()->bsp) {
+        vector = pic_irq_in_service();
+    }
+
+    if(vector < 0) {
+        return;
+    }
+
+    frame = (unsigned int *)(tss->esp - 3 * sizeof(unsigned int));
+    if(kpaging_fix(id, (unsigned int)&frame[0]) != 0 || kpaging_fix(id, (unsigned int)&frame[2]) != 0) {
+        kernel_panic("kpaging: unable to deliver interrupt 0x%02x!", vector);
+    }
+
+    frame[0] = tss->eip;
+    frame[1] = tss->cs;
+    frame[2] = tss->eflags;
+
+    asm volatile("sidt %0" : "=m"(idtr));
+    gate = (unsigned int *)((idtr[1] | ((unsigned int)idtr[2] << 16)) + vector * 8);
+
+    tss->esp = (unsigned int)frame;
+    tss->eip = (gate[0] & 0xffff) | (gate[1] & 0xffff0000);
+    tss->eflags &= ~EF_INTR;
+}
+
+/**
+ * Page fault handler
+ * Runs in the page fault task of the CPU that faulted.
+ * @param error - page fault error code
+ */
+void kpaging_fault(unsigned int error) {
+    int id = cpu_id();
+    int locked = kernel_lock.locked && kernel_lock.cpu == id;
+    unsigned int addr;
+    proc_t *proc = NULL;
+    int entry;
+
+    asm volatile("movl %%cr2, %0" : "=r"(addr));
+
+    // A fault in the kernel context already holds the lock.
+    if(!locked) {
+        spin_lock(&kernel_lock);
+    }
+
+    // Stacks and heaps are mapped as they are touched and shared pages
+    // copied when written.
+    if(kpaging_fix(id, addr) == 0) {
+        // The kernel context runs with interrupts disabled, so only a
+        // process can have been interrupted.
+        if(!locked) {
+            kpaging_redeliver(id);
+            spin_unlock(&kernel_lock);
+        }
+        return;
+    }
+
+    addr = kpaging_resolve(id, addr);
+    entry = proc_stack_entry(addr);
+    if(entry >= 0) {
+        proc = entry_to_proc(entry);
+    }
+
+    // Only the guard page lies between the stack and the heap.
+    if(proc && (unsigned char *)addr < proc->stack && (unsigned char *)addr >= proc->stack - KMEM_PAGE_SIZE) {
+        kernel_panic("Process %s (pid %d) overflowed its %d byte stack!",
+                     proc->name, proc->pid, proc->stack_size);
+    }
+
+    kernel_panic("Page fault at 0x%08x (error 0x%x, eip 0x%08x)",
+                 addr, error, kpaging_tss[id].eip);
+}
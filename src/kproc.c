@@ -23,24 +23,82 @@
 #include "prog_user.h"
 #include "tty.h"
 #include "ringbuf.h"
+#include "kheap.h"
+#include "proc_list.h"
+#include "proc_stack.h"
+#include "kmutex.h"
+#include "ksem.h"
 
-// Next available process id to be assigned
-int next_pid;
+// Number of process table chunks and the pages holding each one
+#define PROC_CHUNKS         ((PROC_MAX + PROC_CHUNK - 1) / PROC_CHUNK)
 
-// Process table allocator
-queue_t proc_allocator;
+// Generation of each process table entry
+// A pid is the entry's generation above the entry index, and the
+// generation advances when the entry is freed, so a stale pid never
+// matches the process that reuses its entry.
+int proc_generation[PROC_MAX];
 
-// Process table
-proc_t proc_table[PROC_MAX];
+// Unused process table entries, linked through their run list links
+proc_list_t proc_free_list;
 
-// Process stacks
-unsigned char proc_stack[PROC_MAX][PROC_STACK_SIZE];
+// Process table, allocated PROC_CHUNK entries at a time as it grows
+proc_t *proc_chunks[PROC_CHUNKS];
 
-// Active process
-proc_t *active_proc;
+// Number of process table chunks allocated
+int proc_chunk_count;
 
-// Function Declaration.
-int kproc_attach_tty(int pid, int tty_index);
+/**
+ * Returns the process table entry at the given index
+ * @param entry - index into the process table
+ * @return pointer to the entry, NULL if its chunk hasn't been allocated
+ */
+proc_t *kproc_slot(int entry) {
+    if(entry < 0 || entry >= proc_chunk_count * PROC_CHUNK) {
+        return NULL;
+    }
+
+    return &proc_chunks[entry / PROC_CHUNK][entry % PROC_CHUNK];
+}
+
+/**
+ * Grows the process table by one chunk of unused entries
+ * @return 0 on success, -1 if the table is full or out of memory
+ */
+int kproc_grow(void) {
+    proc_t *chunk;
+
+    if(proc_chunk_count >= PROC_CHUNKS) {
+        return -1;
+    }
+
+    chunk = kmalloc(PROC_CHUNK * sizeof(proc_t));
+    if(!chunk) {
+        return -1;
+    }
+
+    memset(chunk, 0, PROC_CHUNK * sizeof(proc_t));
+
+    for(int i = 0; i < PROC_CHUNK; i++) {
+        chunk[i].entry      = proc_chunk_count * PROC_CHUNK + i;
+        chunk[i].pid        = -1;
+        chunk[i].state      = NONE;
+        chunk[i].type       = PROC_TYPE_NONE;
+        strcpy(chunk[i].name, "NULL");
+        chunk[i].start_time = -1;
+        chunk[i].run_time   = -1;
+        chunk[i].cpu_time   = -1;
+        chunk[i].heap_index = -1;
+
+        // Entries past PROC_MAX can't be named by a pid.
+        if(chunk[i].entry < PROC_MAX) {
+            proc_list_append(&proc_free_list, &chunk[i]);
+        }
+    }
+
+    proc_chunks[proc_chunk_count++] = chunk;
+    kernel_log_debug("kproc: process table grown to %d entries.", proc_chunk_count * PROC_CHUNK);
+    return 0;
+}
 
 /**
  * Looks up a process in the process table via the process id
@@ -48,26 +106,23 @@ int kproc_attach_tty(int pid, int tty_index);
  * @return pointer to the process entry, NULL or error or if not found
  */
 proc_t *pid_to_proc(int pid) {
-    if(pid < 0 || pid >= next_pid) {
+    int entry = pid & PROC_PID_SLOT_MASK;
+    proc_t *proc;
+
+    if(pid < 0 || entry >= PROC_MAX) {
         kernel_log_error("PID %d is not assigned to any process.", pid);
         return NULL;
     }
 
-    // Iterate through the process table and return a pointer to the valid entry
-    // where the process id matches i.e. if proc_table[8].pid == pid, return
-    // pointer to proc_table[8].
-    // Ensure that the process control block actually refers to a valid process.
-    for(int i = 0; i < PROC_MAX; i++) {
-        // Checks for a valid PCB entry.
-        if(proc_table[i].pid < 0) {
-            continue;
-        }
-        else if(proc_table[i].pid == pid) {
-          return &proc_table[i];
-        }
+    // The pid names its entry directly; it's only valid if the entry
+    // still holds that generation of the process.
+    proc = kproc_slot(entry);
+    if(!proc || proc->pid != pid) {
+        kernel_log_debug("PID %d was not found in the process table.", pid);
+        return NULL;
     }
-    kernel_log_debug("PID %d was not found in the process table.", pid);
-    return NULL;
+
+    return proc;
 }
 
 /**
@@ -81,87 +136,187 @@ int proc_to_entry(proc_t *proc) {
         return -1;
     }
 
-    // For a given process entry pointer, return the entry/index into the process table
-    //  i.e. if proc -> proc_table[3], return 3
-    // Ensure that the process control block actually refers to a valid process.
-    for(int entry = 0; entry < PROC_MAX; entry++) {
-        if(proc_table[entry].pid < 0) {
-            continue;
-        }
-        else if(proc->pid == proc_table[entry].pid) {
-            return entry;
-        }
+    // Each entry records its own index; ensure that the pointer really
+    // is that entry and that it refers to a valid process.
+    int entry = proc->entry;
+
+    if(kproc_slot(entry) != proc || proc->pid < 0) {
+        kernel_log_debug("Process with pid[%d] not found in the process table.", proc->pid);
+        return -1;
     }
-    kernel_log_debug("Process with pid[%d] not found in the process table.", proc->pid);
-    return -1;
+
+    return entry;
 }
 
 /**
  * Returns a pointer to the given process entry
  */
 proc_t * entry_to_proc(int entry) {
-    if(entry < 0 || entry > PROC_MAX) {
+    if(entry < 0 || entry >= PROC_MAX) {
         kernel_log_error("Entry %d is outside the scope of the process table.", entry);
         return NULL;
     }
 
     // For the given entry number, return a pointer to the process table entry
     // Ensure that the process control block actually refers to a valid process
-    if(proc_table[entry].pid < 0) {
+    proc_t *proc = kproc_slot(entry);
+
+    if(!proc || proc->pid < 0) {
         return NULL;
     }
     else {
-        return &proc_table[entry];
+        return proc;
     }
 }
 
 /**
- * Creates a new process
- * @param proc_ptr - address of process to execute
- * @param proc_name - "friendly" process name
- * @param proc_type - process type (kernel or user)
- * @return process id of the created process, -1 on error
+ * Reserves a process table entry and a stack for a new process
+ * @param stack_size - stack size needed in bytes, 0 for PROC_STACK_SIZE;
+ *                     rounded up to whole pages
+ * @return pointer to the reserved entry, NULL on error
  */
-int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type) {
+proc_t *kproc_reserve(int stack_size) {
     proc_t *proc = NULL;
-    int ptable_entry = -1;
 
-    // Allocate an entry in the process table via the process allocator
-    if(queue_out(&proc_allocator, &ptable_entry) != 0) {
+    // Round the stack up to whole pages.
+    stack_size = proc_stack_size(stack_size > 0 ? stack_size : PROC_STACK_SIZE);
+    if(stack_size < 0) {
+        kernel_log_warn("kproc: requested stack is larger than PROC_STACK_MAX.");
+        return NULL;
+    }
+
+    // Allocate an entry in the process table, growing it if none are free
+    if(proc_free_list.size == 0 && kproc_grow() != 0) {
         kernel_log_warn("kproc: unable to allocate a process.");
-        return -1;
+        return NULL;
+    }
+    proc = proc_list_pop(&proc_free_list);
+
+    // Allocate the process stack; pages are mapped as it grows.
+    proc->stack = proc_stack_alloc(proc->entry, stack_size);
+    if(!proc->stack) {
+        kernel_log_warn("kproc: unable to allocate a process stack.");
+        proc_list_append(&proc_free_list, proc);
+        return NULL;
     }
+    proc->stack_size = stack_size;
 
-    // Initialize the process control block.
-    proc = &proc_table[ptable_entry];
+    return proc;
+}
 
-    // Initialize the process stack via proc_stack.
-    proc->stack = &proc_stack[ptable_entry][PROC_STACK_SIZE];
+/**
+ * Releases an entry reserved by kproc_reserve that was never started
+ * @param proc - pointer to the reserved entry
+ */
+void kproc_unreserve(proc_t *proc) {
+    proc_stack_free(proc->entry);
+    proc->stack      = NULL;
+    proc->stack_size = 0;
+    proc_list_append(&proc_free_list, proc);
+}
 
-    // Initialize the trapframe pointer at the bottom of the stack.
-    proc->trapframe = (trapframe_t *)(&proc->stack[PROC_STACK_SIZE - sizeof(trapframe_t)]);
+/**
+ * Sets up the process control block of a new process
+ * @param proc - pointer to the entry, with its stack allocated
+ * @param proc_name - "friendly" process name
+ * @param proc_type - process type (kernel or user)
+ */
+void kproc_setup(proc_t *proc, char *proc_name, proc_type_t proc_type) {
+    int ptable_entry = proc->entry;
 
     // Set each of the process control block structure members to the initial starting values
-    // as each new process is created, increment next_pid
     // proc->pid, state, type, run_time, cpu_time, start_time, etc.
-    proc->pid        = next_pid++;
+    proc->pid        = (proc_generation[ptable_entry] << PROC_PID_SLOT_BITS) | ptable_entry;
+    proc->parent     = -1;
+    proc->owner      = proc;
     proc->state      = IDLE;
     proc->type       = proc_type;
     proc->start_time = timer_get_ticks();
     proc->run_time   = 0;
     proc->cpu_time   = 0;
     proc->sleep_time = 0;
+    proc->sleep_next = NULL;
+    proc->cpu        = -1;
+    proc->handoff    = 0;
+    proc->exit_pending = 0;
+    proc->scheduler_queue = NULL;
+    proc->ready_set  = NULL;
+    proc->list_next  = NULL;
+    proc->list_prev  = NULL;
+    proc->priority   = 0;
+    proc->base_priority = 0;
+    proc->inherited_priority = SCHEDULER_LEVELS;
+    proc->waiting_mutex = NULL;
+    proc->exit_status = 0;
+    proc->wait_child = 0;
+    proc->wait_pid   = -1;
+    proc->wait_status = NULL;
+    proc->sched_class = SCHEDULER_CLASS_DEFAULT;
+    proc->tickets    = SCHEDULER_TICKETS_DEFAULT;
+    proc->stride     = SCHEDULER_STRIDE1 / SCHEDULER_TICKETS_DEFAULT;
+    proc->pass       = 0;
+    proc->heap_key   = 0;
+    proc->heap_index = -1;
+    proc->period     = 0;
+    proc->budget     = 0;
+    proc->budget_left = 0;
+    proc->release_time = 0;
+    proc->deadline   = 0;
+    proc->job_started = 0;
+    proc->job_done    = 0;
+    proc->release_pending = 0;
+    proc->throttle_pending = 0;
+    proc->deadline_misses = 0;
+    proc->jitter_last = 0;
+    proc->jitter_max  = 0;
+    proc->user_cycles   = 0;
+    proc->kernel_cycles = 0;
+    proc->irq_cycles    = 0;
+    proc->burst_avg     = (SCHEDULER_TIMESLICE << SCHEDULER_BURST_SHIFT) / 2;
+    proc->wakeup_tsc    = 0;
+    memset(proc->latency, 0, sizeof(proc->latency));
     proc->io[0]      = NULL;
     proc->io[1]      = NULL;
+    proc->home       = ptable_entry;
 
     // Copy the passed-in name to the name buffer in the process control block.
-    if(strlen(proc_name) > PROC_NAME_LEN) {
+    if(strlen(proc_name) >= PROC_NAME_LEN) {
         strcpy(proc->name, "DefaultUserName");
         kernel_log_warn("Name of process exceeds length by %d.", strlen(proc_name) - PROC_NAME_LEN);
     }
     else {
         strcpy(proc->name, proc_name);
     }
+}
+
+/**
+ * Fills in the process information at the top of a stack
+ * @param proc - process entry
+ */
+void kproc_set_info(proc_t *proc) {
+    proc_info_t *info = (proc_info_t *)(proc->stack + proc->stack_size - sizeof(proc_info_t));
+
+    // Threads use the heap of their process, where they see it.
+    info->heap     = kproc_local_addr(proc, (void *)proc_stack_heap(proc->owner->entry));
+    info->reserved = 0;
+}
+
+/**
+ * Starts a process in an entry reserved by kproc_reserve
+ * @param proc - pointer to the reserved entry
+ * @param proc_ptr - address of process to execute
+ * @param proc_name - "friendly" process name
+ * @param proc_type - process type (kernel or user)
+ * @return process id of the started process
+ */
+int kproc_start(proc_t *proc, void *proc_ptr, char *proc_name, proc_type_t proc_type) {
+    // Initialize the trapframe pointer at the bottom of the stack, below
+    // the process information.
+    proc->trapframe = (trapframe_t *)(&proc->stack[proc->stack_size - sizeof(proc_info_t) - sizeof(trapframe_t)]);
+    memset(proc->trapframe, 0, sizeof(trapframe_t));
+
+    kproc_setup(proc, proc_name, proc_type);
+    kproc_set_info(proc);
 
     // Set the instruction pointer in the trapframe.
     proc->trapframe->eip = (unsigned int)proc_ptr;
@@ -176,55 +331,611 @@ int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type) {
     proc->trapframe->fs = get_fs();
     proc->trapframe->gs = get_gs();
 
+    // The idle task belongs to the CPU creating it and is never queued.
+    if(proc_type == PROC_TYPE_IDLE) {
+        proc->cpu = cpu_id();
+        cpu_get()->idle_proc = proc;
+    }
+
     // Add the process to the scheduler
     scheduler_add(proc);
 
-    kernel_log_info("Created process %s (%d) entry=%d", proc->name, proc->pid, ptable_entry);
+    kernel_log_info("Created process %s (%d) entry=%d", proc->name, proc->pid, proc->entry);
     return proc->pid;
 }
 
+/**
+ * Creates a new process
+ * @param proc_ptr - address of process to execute
+ * @param proc_name - "friendly" process name
+ * @param proc_type - process type (kernel or user)
+ * @param stack_size - stack size needed in bytes, 0 for PROC_STACK_SIZE;
+ *                     rounded up to whole pages
+ * @return process id of the created process, -1 on error
+ */
+int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type, int stack_size) {
+    proc_t *proc = kproc_reserve(stack_size);
+
+    if(!proc) {
+        return -1;
+    }
+
+    return kproc_start(proc, proc_ptr, proc_name, proc_type);
+}
+
+/**
+ * Creates a batch of processes
+ * Every table entry and stack is reserved before any process starts,
+ * so either the whole batch is created or none of it is.
+ * @param specs - array of process descriptions
+ * @param count - number of processes to create, up to PROC_SPAWN_MAX
+ * @param proc_type - process type (kernel or user)
+ * @param pids - array to receive the process id of each process
+ * @return number of processes created, -1 on error
+ */
+int kproc_create_batch(proc_spawn_t *specs, int count, proc_type_t proc_type, int *pids) {
+    proc_t *procs[PROC_SPAWN_MAX];
+
+    if(!specs || !pids || count <= 0 || count > PROC_SPAWN_MAX) {
+        kernel_log_error("kproc: invalid batch of %d processes.", count);
+        return -1;
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(!specs[i].entry || !specs[i].name) {
+            kernel_log_error("kproc: batch entry %d has no entry point or name.", i);
+            return -1;
+        }
+    }
+
+    // Reserve everything up front.
+    for(int i = 0; i < count; i++) {
+        procs[i] = kproc_reserve(specs[i].stack_size);
+
+        if(!procs[i]) {
+            while(--i >= 0) {
+                kproc_unreserve(procs[i]);
+            }
+            return -1;
+        }
+    }
+
+    for(int i = 0; i < count; i++) {
+        pids[i] = kproc_start(procs[i], specs[i].entry, specs[i].name, proc_type);
+
+        if(specs[i].tty >= 0) {
+            kproc_attach_tty(pids[i], specs[i].tty);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Checks whether a process is running on another CPU
+ * Such a process can't be taken off its CPU or have its stack freed from
+ * here; its CPU would keep running it.
+ * @param proc - process entry
+ * @return 1 if another CPU is running the process, 0 if not
+ */
+int kproc_running_elsewhere(proc_t *proc) {
+    cpu_t *cpu = cpu_entry(proc->cpu);
+
+    return cpu && cpu != cpu_get() && cpu->current == proc;
+}
+
+/**
+ * Checks whether a process has threads that haven't exited
+ * @param proc - process entry of the process
+ * @return 1 if it has live threads, 0 if not
+ */
+int kproc_has_threads(proc_t *proc) {
+    proc_t *thread;
+
+    for(int entry = 0; entry < proc_chunk_count * PROC_CHUNK; entry++) {
+        thread = kproc_slot(entry);
+
+        if(thread->pid >= 0 && thread != proc && thread->owner == proc && thread->state != ZOMBIE) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Creates a copy of a process
+ * The child gets a copy-on-write copy of the parent's stack, addressed
+ * where the parent's is, and resumes from the same trapframe with 0 as
+ * the system call's return value. It inherits the parent's I/O bindings.
+ * A process with live threads can't fork: another CPU could keep writing
+ * to a shared page through a stale TLB entry.
+ * @param parent - process entry of the forking process
+ * @return process id of the child, -1 on error
+ */
+int kproc_fork(proc_t *parent) {
+    proc_t *child;
+
+    // A thread's stack is addressed in its own region, where the forked
+    // process couldn't show it.
+    if(!parent || parent->owner != parent || parent->type == PROC_TYPE_IDLE) {
+        kernel_log_error("kproc: only the main thread of a process can fork.");
+        return -1;
+    }
+
+    // Other CPUs only flush their TLBs when they next enter the kernel, so
+    // a thread running on one could write to a page after it was shared.
+    if(kproc_has_threads(parent)) {
+        kernel_log_warn("kproc: unable to fork pid %d while it has threads.", parent->pid);
+        return -1;
+    }
+
+    if(proc_free_list.size == 0 && kproc_grow() != 0) {
+        kernel_log_warn("kproc: unable to allocate a process.");
+        return -1;
+    }
+    child = proc_list_pop(&proc_free_list);
+
+    child->stack = proc_stack_fork(child->entry, parent->entry);
+    if(!child->stack) {
+        kernel_log_warn("kproc: unable to copy the stack of pid %d.", parent->pid);
+        proc_list_append(&proc_free_list, child);
+        return -1;
+    }
+    child->stack_size = parent->stack_size;
+
+    kproc_setup(child, parent->name, parent->type);
+    child->parent = parent->pid;
+    child->home   = parent->home;
+
+    for(int io = 0; io < PROC_IO_MAX; io++) {
+        child->io[io] = parent->io[io];
+    }
+
+    // Same offset into the copy of the stack; writing the return value
+    // takes the child's own copy of the page.
+    child->trapframe = (trapframe_t *)(child->stack + ((unsigned char *)parent->trapframe - parent->stack));
+    child->trapframe->eax = 0;
+
+    scheduler_add(child);
+
+    kernel_log_info("Forked process %s (%d) entry=%d from pid %d",
+                    child->name, child->pid, child->entry, parent->pid);
+    return child->pid;
+}
+
+/**
+ * Moves the break of a process' heap
+ * Threads share the heap of their process. The break can't be lowered
+ * while the process has threads, as one running on another CPU could
+ * keep writing to the freed pages until it next enters the kernel.
+ * @param proc - process entry
+ * @param brk - new end of the heap in the kernel's view, NULL to leave it
+ * @return end of the heap as the process sees it, NULL on error
+ */
+void *kproc_brk(proc_t *proc, void *brk) {
+    proc_t *owner = proc->owner;
+
+    if(brk && (unsigned int)brk < proc_stack_get_brk(owner->entry) && kproc_has_threads(owner)) {
+        kernel_log_warn("kproc: unable to shrink the heap of pid %d while it has threads.", owner->pid);
+        return NULL;
+    }
+
+    if(brk && proc_stack_set_brk(owner->entry, (unsigned int)brk) != 0) {
+        return NULL;
+    }
+
+    return kproc_local_addr(proc, (void *)proc_stack_get_brk(owner->entry));
+}
+
+/**
+ * Translates an address in a process' stack to the one valid on every CPU
+ * A forked process sees its stack where its parent's was; the kernel
+ * addresses it in its own region.
+ * @param proc - process entry
+ * @param addr - address as the process sees it
+ * @return address in the kernel's view
+ */
+void *kproc_global_addr(proc_t *proc, void *addr) {
+    proc_t *owner = proc->owner;
+
+    if(owner->home != owner->entry && proc_stack_entry((unsigned int)addr) == owner->home) {
+        return (unsigned char *)addr + (owner->entry - owner->home) * PROC_STACK_REGION;
+    }
+
+    return addr;
+}
+
+/**
+ * Translates an address in the kernel's view to the one a process sees
+ * @param proc - process entry
+ * @param addr - address in the kernel's view
+ * @return address as the process sees it
+ */
+void *kproc_local_addr(proc_t *proc, void *addr) {
+    proc_t *owner = proc->owner;
+
+    if(owner->home != owner->entry && proc_stack_entry((unsigned int)addr) == owner->entry) {
+        return (unsigned char *)addr - (owner->entry - owner->home) * PROC_STACK_REGION;
+    }
+
+    return addr;
+}
+
+/**
+ * Switches this CPU to the kernel's view of memory on entry to the kernel
+ * @param proc - process entry of the interrupted process
+ * @param trapframe - trapframe as the process saw it
+ * @return trapframe in the kernel's view
+ */
+trapframe_t *kproc_enter(proc_t *proc, trapframe_t *trapframe) {
+    kpaging_alias(PROC_STACK_AREA, PROC_STACK_AREA);
+    return kproc_global_addr(proc, trapframe);
+}
+
+/**
+ * Switches this CPU to a process' view of memory before running it
+ * @param proc - process entry
+ * @return trapframe as the process sees it
+ */
+trapframe_t *kproc_resume(proc_t *proc) {
+    proc_t *owner = proc->owner;
+
+    kpaging_alias(PROC_STACK_AREA + owner->home * PROC_STACK_REGION,
+                  PROC_STACK_AREA + owner->entry * PROC_STACK_REGION);
+    return kproc_local_addr(proc, proc->trapframe);
+}
+
+/**
+ * Detaches the children of a process that is going away
+ * Children that already exited are destroyed, since nobody is left to
+ * collect them; the others will be destroyed when they exit.
+ * @param proc - process entry of the parent
+ */
+void kproc_orphan(proc_t *proc) {
+    proc_t *child;
+
+    for(int entry = 0; entry < proc_chunk_count * PROC_CHUNK; entry++) {
+        child = kproc_slot(entry);
+
+        if(child->pid < 0 || child->parent != proc->pid) {
+            continue;
+        }
+
+        child->parent = -1;
+        if(child->state == ZOMBIE) {
+            kproc_destroy(child);
+        }
+    }
+}
+
+/**
+ * Destroys the other threads of a process that is going away
+ * Threads running on another CPU are destroyed by that CPU when it next
+ * enters the kernel.
+ * @param proc - process entry of the process
+ */
+void kproc_end_threads(proc_t *proc) {
+    proc_t *thread;
+
+    if(proc->owner != proc) {
+        return;
+    }
+
+    for(int entry = 0; entry < proc_chunk_count * PROC_CHUNK; entry++) {
+        thread = kproc_slot(entry);
+
+        if(thread->pid >= 0 && thread != proc && thread->owner == proc) {
+            kproc_destroy(thread);
+        }
+    }
+}
+
+/**
+ * Collects a zombie, freeing its table entry and stack
+ * @param child - process entry of the zombie
+ * @param status - where to store its exit status, may be NULL
+ * @return pid of the collected process
+ */
+int kproc_reap(proc_t *child, int *status) {
+    int pid = child->pid;
+
+    if(status) {
+        *status = child->exit_status;
+    }
+
+    kproc_destroy(child);
+    return pid;
+}
+
 /**
  * Destroys a process
- * If the process is currently scheduled it must be unscheduled
+ * If the process is currently scheduled it must be unscheduled. A process
+ * running on another CPU is destroyed by that CPU when it next enters the
+ * kernel, and a process whose threads are still running elsewhere stays
+ * a zombie until the last of them is gone; its heap is theirs too.
  * @param proc - process control block
  * @return 0 on success, -1 on error
  */
 int kproc_destroy(proc_t *proc) {
+    proc_t *owner;
+
     if(!proc) {
         kernel_log_debug("Unable to destroy process. Process doesn't exist.");
         return -1;
     }
 
-    // Prevents destruction of kernel process.
-    if(proc->pid == 0) {
-        kernel_log_warn("Unable to destroy process with pid[0].");
+    // Prevents destruction of the idle tasks.
+    if(proc->type == PROC_TYPE_IDLE) {
+        kernel_log_warn("Unable to destroy idle process with pid[%d].", proc->pid);
         return -1;
     }
 
+    // Detached, the process is destroyed when its CPU exits it.
+    if(kproc_running_elsewhere(proc)) {
+        proc->parent = -1;
+        proc->exit_pending = 1;
+        return 0;
+    }
+    proc->exit_pending = 0;
+
+    // Leave any wait queues and give up held mutexes, so nothing is
+    // left waiting on a process that no longer exists.
+    kmutex_forget(proc);
+    ksem_forget(proc);
+
     // Remove the process from the scheduler
     scheduler_remove(proc);
 
+    // Nobody will be left to collect the process' children, and its
+    // threads can't outlive it.
+    kproc_orphan(proc);
+    kproc_end_threads(proc);
+
+    // Keep the heap until the threads still running elsewhere are gone;
+    // the last of them finishes the teardown.
+    if(proc->owner == proc && kproc_has_threads(proc)) {
+        proc->parent = -1;
+        proc->state  = ZOMBIE;
+        return 0;
+    }
+    owner = proc->owner;
+
     // Clear/Reset all process data (process control block, stack, etc) related to the process
     int entry = proc_to_entry(proc);
-    proc_table[entry].pid        = -1;
-    proc_table[entry].state      = NONE;
-    proc_table[entry].type       = PROC_TYPE_NONE;
-    strcpy(proc_table[entry].name, "NULL");
-    proc_table[entry].start_time = -1;
-    proc_table[entry].run_time   = -1;
-    proc_table[entry].cpu_time   = -1;
-    proc_table[entry].sleep_time = 0;
-    proc_table[entry].stack      = NULL;
-    proc_table[entry].trapframe  = NULL;
-
-    // Add the process entry/index value back into the process allocator
-    if(queue_in(&proc_allocator, entry) != 0) {
-        kernel_log_error("kproc: unable to queue proc entry back into process allocator.");
+    if(entry < 0) {
+        return -1;
+    }
+
+    // Retire the pid so it can't find whatever reuses the entry.
+    proc_generation[entry] = (proc_generation[entry] + 1) & PROC_PID_GEN_MASK;
+
+    // Free the process stack.
+    proc_stack_free(entry);
+
+    proc->pid        = -1;
+    proc->parent     = -1;
+    proc->owner      = NULL;
+    proc->state      = NONE;
+    proc->type       = PROC_TYPE_NONE;
+    strcpy(proc->name, "NULL");
+    proc->start_time = -1;
+    proc->run_time   = -1;
+    proc->cpu_time   = -1;
+    proc->sleep_time = 0;
+    proc->sleep_next = NULL;
+    proc->stack      = NULL;
+    proc->stack_size = 0;
+    proc->trapframe  = NULL;
+
+    // Add the process entry back into the free list
+    if(proc_list_append(&proc_free_list, proc) != 0) {
+        kernel_log_error("kproc: unable to return proc entry to the free list.");
+        return -1;
+    }
+
+    // Finish a process that was only waiting for this thread.
+    if(owner && owner != proc && owner->pid >= 0 && owner->state == ZOMBIE
+            && owner->parent < 0 && !kproc_has_threads(owner)) {
+        return kproc_destroy(owner);
+    }
+    return 0;
+}
+
+/**
+ * Exits a process
+ * A process with a parent becomes a zombie holding its exit status until
+ * the parent collects it with kproc_wait; any other process is destroyed.
+ * A process running on another CPU is exited by that CPU when it next
+ * enters the kernel; its other threads are ended right away.
+ * @param proc - process entry
+ * @param status - exit status
+ * @return 0 on success, -1 on error
+ */
+int kproc_exit(proc_t *proc, int status) {
+    proc_t *parent = NULL;
+
+    if(!proc) {
+        kernel_log_debug("Unable to exit process. Process doesn't exist.");
+        return -1;
+    }
+
+    if(proc->type == PROC_TYPE_IDLE) {
+        kernel_log_warn("Unable to exit idle process with pid[%d].", proc->pid);
+        return -1;
+    }
+
+    if(kproc_running_elsewhere(proc)) {
+        proc->exit_status  = status;
+        proc->exit_pending = 1;
+        kproc_end_threads(proc);
+        return 0;
+    }
+    proc->exit_pending = 0;
+
+    if(proc->parent >= 0) {
+        parent = pid_to_proc(proc->parent);
+    }
+
+    if(!parent) {
+        return kproc_destroy(proc);
+    }
+
+    // Keep the entry and stack until the parent collects the status;
+    // the rest of the teardown happens then. Wait queues and mutexes
+    // can't wait that long.
+    kmutex_forget(proc);
+    ksem_forget(proc);
+    scheduler_remove(proc);
+    kproc_orphan(proc);
+    kproc_end_threads(proc);
+    proc->exit_status = status;
+    proc->state = ZOMBIE;
+
+    // Hand the status straight to a parent that is already waiting.
+    if(parent->wait_child && (parent->wait_pid < 0 || parent->wait_pid == proc->pid)) {
+        parent->wait_child = 0;
+        parent->trapframe->eax = kproc_reap(proc, parent->wait_status);
+        scheduler_add(parent);
+    }
+
+    return 0;
+}
+
+/**
+ * Collects an exited child of a process
+ * If no matching child has exited yet, the process blocks; when a child
+ * exits, its pid is returned to the process by kproc_exit.
+ * @param proc - process entry of the parent
+ * @param pid - child to wait for, -1 for any child
+ * @param status - where to store the child's exit status, may be NULL
+ * @param threads - 1 to wait for threads, 0 for child processes
+ * @return pid of the collected child, 0 if the process blocked, -1 on error
+ */
+int kproc_wait(proc_t *proc, int pid, int *status, int threads) {
+    proc_t *child;
+    int found = 0;
+
+    if(!proc) {
+        return -1;
+    }
+
+    for(int entry = 0; entry < proc_chunk_count * PROC_CHUNK; entry++) {
+        child = kproc_slot(entry);
+
+        if(child->pid < 0 || child->parent != proc->pid) {
+            continue;
+        }
+
+        if(pid >= 0 && child->pid != pid) {
+            continue;
+        }
+
+        if((child->owner != child) != threads) {
+            continue;
+        }
+
+        if(child->state == ZOMBIE) {
+            return kproc_reap(child, status);
+        }
+        found = 1;
+    }
+
+    if(!found) {
+        kernel_log_debug("kproc: pid %d has no child %d to wait for.", proc->pid, pid);
         return -1;
     }
+
+    // Block until a matching child exits.
+    proc->wait_child  = 1;
+    proc->wait_pid    = pid;
+    proc->wait_status = status;
+    proc->state = WAITING;
+    scheduler_remove(proc);
     return 0;
 }
 
+/**
+ * Creates a thread in the process of the given thread
+ * The thread shares the process' identity and I/O bindings but runs on
+ * its own stack. It starts in spec->start(spec->entry, spec->arg).
+ * @param creator - process entry of the creating thread
+ * @param spec - pointer to the thread description
+ * @return thread id of the new thread, -1 on error
+ */
+int kproc_thread_create(proc_t *creator, thread_spec_t *spec) {
+    proc_t *owner;
+    proc_t *thread;
+    trapframe_t *trapframe;
+    trapframe_t initial;
+    unsigned int *frame;
+
+    if(!creator || !spec || !spec->start || !spec->entry) {
+        kernel_log_error("kproc: invalid thread.");
+        return -1;
+    }
+    owner = creator->owner;
+
+    thread = kproc_reserve(spec->stack_size);
+    if(!thread) {
+        return -1;
+    }
+
+    kproc_start(thread, spec->start, owner->name, owner->type);
+    thread->owner  = owner;
+    thread->parent = creator->pid;
+    kproc_set_info(thread);
+
+    // Move the trapframe down to make room for the call frame of the
+    // startup routine: a return address it never uses and its arguments.
+    initial = *thread->trapframe;
+    trapframe = (trapframe_t *)((unsigned char *)thread->trapframe - 3 * sizeof(unsigned int));
+    *trapframe = initial;
+    thread->trapframe = trapframe;
+
+    frame = (unsigned int *)(trapframe + 1);
+    frame[0] = 0;
+    frame[1] = (unsigned int)spec->entry;
+    frame[2] = (unsigned int)spec->arg;
+
+    return thread->pid;
+}
+
+/**
+ * Checks that a process hasn't overflowed its stack
+ * The guard page below the stack catches overflows as they happen; this
+ * checks that the saved trapframe lies within the stack.
+ * @param proc - process entry
+ * @return 0 if the stack is intact, -1 if it has overflowed
+ */
+int kproc_stack_check(proc_t *proc) {
+    if(!proc || !proc->stack) {
+        return -1;
+    }
+
+    if((unsigned char *)proc->trapframe < proc->stack
+            || (unsigned char *)proc->trapframe > proc->stack + proc->stack_size - sizeof(trapframe_t)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the most stack a process has used
+ * Stack pages are only mapped once touched and stay mapped until the
+ * process exits, so this is the mapped part of the stack.
+ * @param proc - process entry
+ * @return number of bytes used at the high-water mark, -1 on error
+ */
+int kproc_stack_peak(proc_t *proc) {
+    if(!proc || !proc->stack) {
+        return -1;
+    }
+
+    return proc_stack_resident(proc->entry);
+}
+
 /**
  * Idle Process
  */
@@ -260,8 +971,8 @@ int kproc_attach_tty(int pid, int tty_index) {
 
     if(proc && tty) {
         kernel_log_info("Attaching process with PID[%d] to TTY[%d].", pid, tty_index);
-        proc->io[PROC_IO_IN] = &tty->io_input;
-        proc->io[PROC_IO_OUT] = &tty->io_output;
+        proc->io[PROC_IO_IN] = tty->io_input;
+        proc->io[PROC_IO_OUT] = tty->io_output;
         return 0;
     }
     return -1;
@@ -276,52 +987,22 @@ void kproc_init(void) {
     kernel_log_info("Initializing process management");
 
     // Initialize all data structures and variables.
-    next_pid = 0;
-
-    // Initialize the process allocator queue.
-    queue_init(&proc_allocator);
+    memset(proc_generation, 0, sizeof(proc_generation));
 
-    // Populates items into the process allocator queue with the
-    // indexes to be used for the process table.
-    for(int ptable_entry = 0; ptable_entry < PROC_MAX; ptable_entry++) {
-        if(!queue_is_full(&proc_allocator)) {
-            queue_in(&proc_allocator, ptable_entry);
-        }
-        else {
-            break;
-        }
-    }
-
-    // Initialize the proc_table.
-    for(int i = 0; i < PROC_MAX; i++) {
-        proc_table[i].pid        = -1;
-        proc_table[i].state      = NONE;
-        proc_table[i].type       = PROC_TYPE_NONE;
-        strcpy(proc_table[i].name, "NULL");
-        proc_table[i].start_time = -1;
-        proc_table[i].run_time   = -1;
-        proc_table[i].cpu_time   = -1;
-        proc_table[i].sleep_time = 0;
-        proc_table[i].stack      = NULL;
-        proc_table[i].trapframe  = NULL;
-    }
-
-    // Initialize the process stack.
-    for(int i = 0; i < PROC_MAX; i++) {
-        for(int j = 0; j < PROC_STACK_SIZE; j++) {
-            proc_stack[i][j] = '\0';
-        }
-    }
+    // The process table starts empty and grows as processes are created.
+    proc_list_init(&proc_free_list);
+    proc_chunk_count = 0;
+    proc_stack_init();
 
     // Create the idle process (kproc_idle) as a kernel process.
-    kproc_create(&kproc_idle, "idle", PROC_TYPE_KERNEL);
+    kproc_create(&kproc_idle, "idle", PROC_TYPE_IDLE, 0);
 
     int pid = -1;
     // Creates the shell processes.
     for(int m = 1; m < 5; m++) {
         // Creates a shell process. If successful, it returns
         // the process' PID.
-        pid = kproc_create(&prog_shell, "shell", PROC_TYPE_USER);
+        pid = kproc_create(&prog_shell, "shell", PROC_TYPE_USER, 0);
 
         // If no errors occurred in the creation of the process,
         // inform the terminal.
@@ -331,13 +1012,13 @@ void kproc_init(void) {
     }
 
     for (int i = 0; i < 3; i++) {
-        pid = kproc_create(prog_ping, "ping", PROC_TYPE_USER);
+        pid = kproc_create(prog_ping, "ping", PROC_TYPE_USER, 0);
         kernel_log_debug("Created ping process %d", pid);
         kproc_attach_tty(pid, (TTY_MAX - (pid % 2) - 1));
     }
 
     for (int i = 0; i < 3; i++) {
-        pid = kproc_create(prog_pong, "pong", PROC_TYPE_USER);
+        pid = kproc_create(prog_pong, "pong", PROC_TYPE_USER, 0);
         kernel_log_debug("Created pong process %d", pid);
         kproc_attach_tty(pid, (TTY_MAX - (pid % 2) - 1));
     }
@@ -13,9 +13,13 @@
 #include "ksem.h"
 #include "queue.h"
 #include "scheduler.h"
+#include "kheap.h"
 
-// Table of all semephores
-sem_t semaphores[SEM_MAX];
+// Table of all semephores, NULL where the id is free
+sem_t *semaphores[SEM_MAX];
+
+// Cache the semaphores are allocated from
+kheap_cache_t sem_cache;
 
 // semaphore ids to be allocated
 queue_t sem_queue;
@@ -27,11 +31,13 @@ queue_t sem_queue;
 int ksemaphores_init() {
     kernel_log_info("Initializing kernel semaphores");
 
-    // Initialize the semaphore table
+    // Initialize the semaphore table; semaphores are allocated as they're used
     for (int i = 0; i < SEM_MAX; i++) {
-        semaphores[i].allocated = 0;
-        semaphores[i].count = 0;
-        queue_init(&semaphores[i].wait_queue);
+        semaphores[i] = NULL;
+    }
+
+    if (kheap_cache_init(&sem_cache, "semaphore", sizeof(sem_t)) != 0) {
+        return -1;
     }
 
     // Initialize the semaphore queue
@@ -72,7 +78,12 @@ int ksem_init(int value) {
     // Initialize the semaphore data structure
     // sempohare table + all members (wait queue, allocated, count)
     // set count to initial value
-    sem = &semaphores[sem_id];
+    sem = kheap_cache_alloc(&sem_cache);
+    if (!sem) {
+        queue_in(&sem_queue, sem_id);
+        return -1;
+    }
+    semaphores[sem_id] = sem;
     memset(sem, 0, sizeof(sem_t));
     sem->allocated = 1;
     sem->count = value;
@@ -95,9 +106,9 @@ int ksem_destroy(int id) {
     }
 
     // Look up the semaphore in the semaphore table.
-    sem = &semaphores[id];
+    sem = semaphores[id];
 
-    if (sem->allocated == 0) {
+    if (!sem || sem->allocated == 0) {
         kernel_log_error("ksem: Could not destroy semaphore. Semaphore not allocated.");
         return -1;
     }
@@ -114,8 +125,9 @@ int ksem_destroy(int id) {
         return -1;
     }
 
-    // Clear the memory for the data structure
-    free(sem);
+    // Return the memory for the data structure
+    semaphores[id] = NULL;
+    kheap_cache_free(&sem_cache, sem);
 
     return 0;
 }
@@ -134,9 +146,9 @@ int ksem_wait(int id) {
     }
 
     // Look up the semaphore in the semaphore table.
-    sem = &semaphores[id];
+    sem = semaphores[id];
 
-    if (sem->allocated == 0) {
+    if (!sem || sem->allocated == 0) {
         kernel_log_error("ksem: Could not wait on semaphore. Semaphore not allocated.");
         return -1;
     }
@@ -176,12 +188,18 @@ int ksem_wait(int id) {
  */
 int ksem_post(int id) {
     sem_t *sem;
+    proc_t *proc;
     int pid = -1;
 
+    if (id < 0 || id >= SEM_MAX) {
+        kernel_log_error("ksem: Unable to post semaphore ID outside the valid range.");
+        return -1;
+    }
+
     // Look up the semaphore in the semaphore table.
-    sem = &semaphores[id];
+    sem = semaphores[id];
 
-    if (sem->allocated == 0) {
+    if (!sem || sem->allocated == 0) {
         kernel_log_error("ksem: Unable to post semaphore. Semaphore not allocated.");
         return -1;
     }
@@ -192,15 +210,47 @@ int ksem_post(int id) {
     // Check if any processes are waiting on the semaphore (semaphore wait queue)
         // If so, queue out and add to the scheduler
         // Decrement the semaphore count
-    if (!queue_is_empty(&sem->wait_queue)) {
+    // Waiters that have gone away since are skipped.
+    while (!queue_is_empty(&sem->wait_queue)) {
         if(queue_out(&sem->wait_queue, &pid) != 0) {
             kernel_log_error("ksem: Unable to obtain process from the semaphore wait queue.");
             return -1;
         }
-        scheduler_add(pid_to_proc(pid));
+        proc = pid_to_proc(pid);
+        if (!proc) {
+            kernel_log_warn("ksem: Skipping pid %d, which no longer exists.", pid);
+            continue;
+        }
+        scheduler_add(proc);
         sem->count--;
         return sem->count;
     }
 
     return -1;
 }
+
+/**
+ * Removes a process that is going away from every semaphore wait queue
+ * @param proc - pointer to the process entry
+ */
+void ksem_forget(proc_t *proc) {
+    int pid;
+    int size;
+
+    for (int i = 0; i < SEM_MAX; i++) {
+        if (!semaphores[i]) {
+            continue;
+        }
+
+        size = semaphores[i]->wait_queue.size;
+        for (int j = 0; j < size; j++) {
+            if(queue_out(&semaphores[i]->wait_queue, &pid) != 0) {
+                break;
+            }
+
+            if(pid != proc->pid) {
+                queue_in(&semaphores[i]->wait_queue, pid);
+            }
+        }
+    }
+}
@@ -15,9 +15,12 @@
 #include "interrupts.h"
 #include "scheduler.h"
 #include "timer.h"
+#include "tsc.h"
 #include "ringbuf.h"
 #include "kmutex.h"
 #include "ksem.h"
+#include "kpaging.h"
+#include "proc_stack.h"
 
 /**
  * System call IRQ handler
@@ -35,6 +38,9 @@ void ksyscall_irq_handler(void) {
     unsigned int arg2;
     unsigned int arg3;
 
+    // Calling process.
+    proc_t *proc = active_proc;
+
     if (!active_proc) {
         kernel_panic("ksyscall: Invalid process.");
     }
@@ -50,6 +56,12 @@ void ksyscall_irq_handler(void) {
     arg2 = active_proc->trapframe->ecx;
     arg3 = active_proc->trapframe->edx;
 
+    // Pointers into a forked process' stack are where the process sees
+    // them, not where the kernel does.
+    arg1 = (unsigned int)kproc_global_addr(proc, (void *)arg1);
+    arg2 = (unsigned int)kproc_global_addr(proc, (void *)arg2);
+    arg3 = (unsigned int)kproc_global_addr(proc, (void *)arg3);
+
     // Based upon the system call identifier, call the respective system call handler.
     //
     // Ensure that the EAX register for the active process contains the return value.
@@ -105,9 +117,10 @@ void ksyscall_irq_handler(void) {
             rc = ksyscall_proc_sleep(arg1);
             break;
 
-        // This syscall has no parameters. It returns the success or failure of the task.
+        // The following parameter is stored in the respective register:
+        // trapframe->ebx = int exitcode - exit status for the parent process.
         case SYSCALL_PROC_EXIT:
-            rc = ksyscall_proc_exit();
+            rc = ksyscall_proc_exit(arg1);
             break;
 
         // This syscall has no parameters. It returns the current process' id.
@@ -122,6 +135,108 @@ void ksyscall_irq_handler(void) {
             rc = ksyscall_proc_get_name((char *)arg1);
             break;
 
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int pid      - the process to update.
+        // trapframe->ecx = int priority - the new priority level.
+        case SYSCALL_PROC_SET_PRIORITY:
+            rc = ksyscall_proc_set_priority(arg1, arg2);
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int pid     - the process to update.
+        // trapframe->ecx = int tickets - the new number of tickets.
+        case SYSCALL_PROC_SET_TICKETS:
+            rc = ksyscall_proc_set_tickets(arg1, arg2);
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int period - the release period in ticks.
+        // trapframe->ecx = int budget - the CPU budget per period in ticks.
+        case SYSCALL_PROC_SET_PERIODIC:
+            rc = ksyscall_proc_set_periodic(arg1, arg2);
+            break;
+
+        // This syscall has no parameters. It completes the current job.
+        case SYSCALL_PROC_WAIT_PERIOD:
+            rc = ksyscall_proc_wait_period();
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int pid              - the process to query.
+        // trapframe->ecx = proc_stats_t *stats - the structure to fill in.
+        case SYSCALL_PROC_GET_STATS:
+            rc = ksyscall_proc_get_stats(arg1, (proc_stats_t *)arg2);
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int pid            - the process to query, -1 for all.
+        // trapframe->ecx = unsigned int *hist - the histogram to fill in.
+        case SYSCALL_PROC_GET_LATENCY:
+            rc = ksyscall_proc_get_latency(arg1, (unsigned int *)arg2);
+            break;
+
+        // This syscall has no parameters. It gives up the CPU.
+        case SYSCALL_PROC_YIELD:
+            rc = ksyscall_proc_yield();
+            break;
+
+        // The following parameter is stored in the respective register:
+        // trapframe->ebx = int pid - the process to run next.
+        case SYSCALL_PROC_YIELD_TO:
+            rc = ksyscall_proc_yield_to(arg1);
+            break;
+
+        // The following parameter is stored in the respective register:
+        // trapframe->ebx = proc_spawn_t *spec - the process to create.
+        case SYSCALL_PROC_SPAWN:
+            rc = ksyscall_proc_spawn((proc_spawn_t *)arg1);
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = proc_spawn_t *specs - the processes to create.
+        // trapframe->ecx = int count           - the number of processes.
+        // trapframe->edx = int *pids           - receives the process ids.
+        case SYSCALL_PROC_SPAWN_BATCH:
+            rc = ksyscall_proc_spawn_batch((proc_spawn_t *)arg1, arg2, (int *)arg3);
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int pid     - the child to wait for, -1 for any.
+        // trapframe->ecx = int *status - receives the child's exit status.
+        case SYSCALL_PROC_WAIT:
+            rc = ksyscall_proc_wait(arg1, (int *)arg2);
+            break;
+
+        // The following parameter is stored in the respective register:
+        // trapframe->ebx = thread_spec_t *spec - the thread to create.
+        case SYSCALL_THREAD_CREATE:
+            rc = ksyscall_thread_create((thread_spec_t *)arg1);
+            break;
+
+        // The following parameter is stored in the respective register:
+        // trapframe->ebx = int status - exit status for the creating thread.
+        case SYSCALL_THREAD_EXIT:
+            rc = ksyscall_thread_exit(arg1);
+            break;
+
+        // The following parameters are stored in the respective registers:
+        // trapframe->ebx = int tid     - the thread to wait for, -1 for any.
+        // trapframe->ecx = int *status - receives the thread's exit status.
+        case SYSCALL_THREAD_JOIN:
+            rc = ksyscall_thread_join(arg1, (int *)arg2);
+            break;
+
+        // This syscall has no parameters. It copies the calling process.
+        case SYSCALL_PROC_FORK:
+            rc = ksyscall_proc_fork();
+            break;
+
+        // The following parameter is stored in the respective register:
+        // trapframe->ebx = void *brk - new end of the heap, NULL to leave it.
+        case SYSCALL_PROC_BRK:
+            rc = (int)ksyscall_proc_brk((void *)arg1);
+            break;
+
         // This syscall has no parameters. It allocates a mutex.
         case SYSCALL_MUTEX_INIT:
             rc = ksyscall_mutex_init();
@@ -172,9 +287,11 @@ void ksyscall_irq_handler(void) {
             kernel_panic("kysyscall: Invalid system call %d!", syscall);
     }
 
-    // Returns a value, if appropriate, into the EAX register.
-    if(active_proc) {
-        active_proc->trapframe->eax = (unsigned int)rc;
+    // Returns a value, if appropriate, into the EAX register of the calling
+    // process, which may no longer be active if the system call blocked it.
+    // A destroyed process has no trapframe left to return into.
+    if(proc && proc->trapframe) {
+        proc->trapframe->eax = (unsigned int)rc;
     }
 }
 
@@ -216,14 +333,14 @@ int ksyscall_io_write(int io, char *buf, int size) {
         return -1;
     }
 
-    if(!active_proc->io[io]) {
+    if(!active_proc->owner->io[io]) {
         kernel_log_error("ksyscall: Unable to write into null io buffer.");
         return -1;
     }
 
     int i;
     for(i = 0; i < size; i++) {
-        ringbuf_write(active_proc->io[io], buf[i]);
+        ringbuf_write(active_proc->owner->io[io], buf[i]);
     }
     return size;
 }
@@ -251,7 +368,7 @@ int ksyscall_io_read(int io, char *buf, int size) {
         return -1;
     }
 
-    if(!active_proc->io[io]) {
+    if(!active_proc->owner->io[io]) {
         kernel_log_error("ksyscall: Unable to read null io buffer.");
         return -1;
     }
@@ -261,7 +378,7 @@ int ksyscall_io_read(int io, char *buf, int size) {
     }
 
     // Limits the amount of characters read by the size of the buffer.
-    int s = active_proc->io[io]->size;
+    int s = active_proc->owner->io[io]->size;
     if(s > size) {
         s = size;
     }
@@ -270,7 +387,7 @@ int ksyscall_io_read(int io, char *buf, int size) {
     char c = '\0';
     // Read one character at a time from the io buffer.
     for(i = 0; i < size; i++) {
-        ringbuf_read(active_proc->io[io], &c);
+        ringbuf_read(active_proc->owner->io[io], &c);
         buf[i] = c;
     }
     // Ensure io buffer is empty and ready to take in the new inputs.
@@ -294,12 +411,12 @@ int ksyscall_io_flush(int io) {
         return -1;
     }
 
-    if(!active_proc->io[io]) {
+    if(!active_proc->owner->io[io]) {
         kernel_log_error("ksyscall: Unable to flush null io buffer.");
         return -1;
     }
 
-    ringbuf_flush(active_proc->io[io]);
+    ringbuf_flush(active_proc->owner->io[io]);
     return 0;
 }
 
@@ -342,14 +459,16 @@ int ksyscall_proc_sleep(int seconds) {
 
 /**
  * Exits the current process
+ * @param status - exit status for the parent process
  */
-int ksyscall_proc_exit(void) {
+int ksyscall_proc_exit(int status) {
     if(!active_proc) {
         kernel_log_error("ksyscall: No active process to exit.");
         return -1;
     }
 
-    return kproc_destroy(active_proc);
+    // Exiting ends the whole process, including its other threads.
+    return kproc_exit(active_proc->owner, status);
 }
 
 /**
@@ -362,7 +481,7 @@ int ksyscall_proc_get_pid(void) {
         return -1;
     }
 
-    return active_proc->pid;
+    return active_proc->owner->pid;
 }
 
 /**
@@ -381,10 +500,298 @@ int ksyscall_proc_get_name(char *name) {
         return -1;
     }
 
-    strncpy(name, active_proc->name, PROC_NAME_LEN);
+    strncpy(name, active_proc->owner->name, PROC_NAME_LEN);
     return 0;
 }
 
+/**
+ * Sets the scheduling priority of a process
+ * @param pid - process id
+ * @param priority - priority level (0 is the highest)
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_set_priority(int pid, int priority) {
+    proc_t *proc = pid_to_proc(pid);
+
+    if(!proc) {
+        kernel_log_error("ksyscall: Unable to set priority of invalid process.");
+        return -1;
+    }
+
+    if(priority < 0 || priority >= SCHEDULER_LEVELS) {
+        kernel_log_error("ksyscall: Priority %d out of bounds.", priority);
+        return -1;
+    }
+
+    return scheduler_set_priority(proc, priority);
+}
+
+/**
+ * Sets the CPU share of a process
+ * @param pid - process id
+ * @param tickets - number of tickets, 0 to return to priority scheduling
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_set_tickets(int pid, int tickets) {
+    proc_t *proc = pid_to_proc(pid);
+
+    if(!proc) {
+        kernel_log_error("ksyscall: Unable to set tickets of invalid process.");
+        return -1;
+    }
+
+    if(tickets < 0 || tickets > SCHEDULER_TICKETS_MAX) {
+        kernel_log_error("ksyscall: Ticket count %d out of bounds.", tickets);
+        return -1;
+    }
+
+    return scheduler_set_tickets(proc, tickets);
+}
+
+/**
+ * Makes the active process periodic
+ * @param period - release period in ticks, 0 to stop being periodic
+ * @param budget - CPU budget per period in ticks
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_set_periodic(int period, int budget) {
+    return scheduler_set_periodic(active_proc, period, budget);
+}
+
+/**
+ * Completes the active process' current job and waits for the next period
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_wait_period(void) {
+    return scheduler_wait_period(active_proc);
+}
+
+/**
+ * Gets the statistics of a process
+ * @param pid - process id
+ * @param stats - pointer to the statistics structure to fill in
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_get_stats(int pid, proc_stats_t *stats) {
+    proc_t *proc = pid_to_proc(pid);
+    kpaging_stats_t paging;
+    proc_stack_stats_t stacks;
+
+    if(!proc) {
+        kernel_log_error("ksyscall: Unable to get statistics of invalid process.");
+        return -1;
+    }
+
+    if(!stats) {
+        kernel_log_error("ksyscall: Invalid statistics buffer.");
+        return -1;
+    }
+
+    stats->pid             = proc->pid;
+    stats->period          = proc->period;
+    stats->budget          = proc->budget;
+    stats->deadline_misses = proc->deadline_misses;
+    stats->jitter_last     = proc->jitter_last;
+    stats->jitter_max      = proc->jitter_max;
+    stats->user_cycles     = proc->user_cycles;
+    stats->kernel_cycles   = proc->kernel_cycles;
+    stats->irq_cycles      = proc->irq_cycles;
+    stats->tsc_hz          = tsc_get_hz();
+    stats->stack_size      = proc->stack_size;
+    stats->stack_peak      = kproc_stack_peak(proc);
+
+    kpaging_get_stats(&paging);
+    stats->pages_shared    = paging.shared;
+    stats->pages_copied    = paging.copied;
+    stats->heap_size       = proc_stack_get_brk(proc->owner->entry) - proc_stack_heap(proc->owner->entry);
+
+    proc_stack_get_stats(&stacks);
+    stats->stack_pages      = stacks.resident;
+    stats->stack_pages_peak = stacks.peak;
+    stats->stack_faults     = stacks.faults;
+    return 0;
+}
+
+/**
+ * Gets a wakeup-to-run latency histogram
+ * @param pid - process id, -1 for the system-wide histogram
+ * @param hist - buffer of SCHED_LATENCY_BUCKETS counters to fill in
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_get_latency(int pid, unsigned int *hist) {
+    proc_t *proc = NULL;
+
+    if(pid != -1) {
+        proc = pid_to_proc(pid);
+
+        if(!proc) {
+            kernel_log_error("ksyscall: Unable to get latency of invalid process.");
+            return -1;
+        }
+    }
+
+    return scheduler_get_latency(proc, hist);
+}
+
+/**
+ * Gives up the CPU to the next process waiting to run
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_yield(void) {
+    return scheduler_yield(active_proc);
+}
+
+/**
+ * Gives up the CPU to the specified process
+ * @param pid - id of a process waiting to run
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_proc_yield_to(int pid) {
+    proc_t *proc = pid_to_proc(pid);
+
+    if(!proc) {
+        kernel_log_error("ksyscall: Unable to yield to invalid process.");
+        return -1;
+    }
+
+    return scheduler_yield_to(active_proc, proc);
+}
+
+/**
+ * Creates a new process
+ * @param spec - pointer to the process description
+ * @return process id of the new process, -1 on error
+ */
+int ksyscall_proc_spawn(proc_spawn_t *spec) {
+    int pid;
+
+    if(ksyscall_proc_spawn_batch(spec, 1, &pid) != 1) {
+        return -1;
+    }
+
+    return pid;
+}
+
+/**
+ * Creates a batch of processes
+ * @param specs - array of process descriptions
+ * @param count - number of processes
+ * @param pids - array to receive the process id of each process
+ * @return number of processes created, -1 on error
+ */
+int ksyscall_proc_spawn_batch(proc_spawn_t *specs, int count, int *pids) {
+    proc_t *caller = active_proc;
+    proc_t *proc;
+
+    if(kproc_create_batch(specs, count, PROC_TYPE_USER, pids) != count) {
+        kernel_log_error("ksyscall: Unable to spawn %d processes.", count);
+        return -1;
+    }
+
+    // The caller is the parent of each process, and processes without a
+    // TTY of their own share the caller's.
+    for(int i = 0; i < count; i++) {
+        proc = pid_to_proc(pids[i]);
+
+        if(proc && caller) {
+            proc->parent = caller->pid;
+        }
+
+        if(specs[i].tty < 0 && proc && caller) {
+            for(int io = 0; io < PROC_IO_MAX; io++) {
+                proc->io[io] = caller->owner->io[io];
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Waits for a child of the current process to exit
+ * @param pid - child to wait for, -1 for any child
+ * @param status - where to store the child's exit status, may be NULL
+ * @return pid of the child that exited, -1 on error
+ */
+int ksyscall_proc_wait(int pid, int *status) {
+    if(!active_proc) {
+        kernel_log_error("ksyscall: No active process to wait.");
+        return -1;
+    }
+
+    return kproc_wait(active_proc, pid, status, 0);
+}
+
+/**
+ * Creates a thread in the current process
+ * @param spec - pointer to the thread description
+ * @return thread id of the new thread, -1 on error
+ */
+int ksyscall_thread_create(thread_spec_t *spec) {
+    if(!active_proc) {
+        kernel_log_error("ksyscall: No active process to create a thread in.");
+        return -1;
+    }
+
+    return kproc_thread_create(active_proc, spec);
+}
+
+/**
+ * Exits the current thread
+ * @param status - exit status for the thread that created it
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_thread_exit(int status) {
+    if(!active_proc) {
+        kernel_log_error("ksyscall: No active thread to exit.");
+        return -1;
+    }
+
+    return kproc_exit(active_proc, status);
+}
+
+/**
+ * Waits for a thread created by the current thread to exit
+ * @param tid - thread to wait for, -1 for any
+ * @param status - where to store the thread's exit status, may be NULL
+ * @return thread id of the thread that exited, -1 on error
+ */
+int ksyscall_thread_join(int tid, int *status) {
+    if(!active_proc) {
+        kernel_log_error("ksyscall: No active thread to join with.");
+        return -1;
+    }
+
+    return kproc_wait(active_proc, tid, status, 1);
+}
+
+/**
+ * Creates a copy-on-write copy of the current process
+ * @return process id of the child to the parent, 0 to the child, -1 on error
+ */
+int ksyscall_proc_fork(void) {
+    if(!active_proc) {
+        kernel_log_error("ksyscall: No active process to fork.");
+        return -1;
+    }
+
+    return kproc_fork(active_proc);
+}
+
+/**
+ * Moves the end of the current process' heap
+ * @param brk - new end of the heap, NULL to leave it
+ * @return end of the heap, NULL on error
+ */
+void *ksyscall_proc_brk(void *brk) {
+    if(!active_proc) {
+        kernel_log_error("ksyscall: No active process to move the heap of.");
+        return NULL;
+    }
+
+    return kproc_brk(active_proc, brk);
+}
+
 /**
  * Allocates a mutex from the kernel
  * @return -1 on error, all other values indicate the mutex id
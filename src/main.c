@@ -10,7 +10,12 @@
 #include "kernel.h"
 #include "keyboard.h"
 #include "kproc.h"
+#include "kmem.h"
+#include "kheap.h"
+#include "kpaging.h"
 #include "timer.h"
+#include "tsc.h"
+#include "cpu.h"
 #include "tty.h"
 #include "scheduler.h"
 #include "vga.h"
@@ -24,12 +29,27 @@ int main(void) {
     // Always iniialize the kernel
     kernel_init();
 
+    // Initialize the kernel memory allocator
+    kmem_init();
+
+    // Initialize the kernel heap
+    kheap_init();
+
     // Initialize interrupts
     interrupts_init();
 
     // Initialize timers
     timer_init();
 
+    // Calibrate the time stamp counter
+    tsc_init();
+
+    // Initialize the bootstrap processor's local APIC
+    cpu_init();
+
+    // Enable paging
+    kpaging_init();
+
     // Initialize the TTY
     tty_init();
 
@@ -67,6 +87,9 @@ int main(void) {
     // Clear the screen
     vga_clear();
 
+    // Start the other processors
+    cpu_start();
+
     // Enable interrupts
     interrupts_enable();
 
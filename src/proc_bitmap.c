@@ -0,0 +1,86 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process ready bitmaps
+ */
+
+#include <spede/stddef.h>
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "proc_bitmap.h"
+
+/**
+ * Initializes an empty set
+ * @param set - pointer to the set
+ */
+void proc_bitmap_init(proc_bitmap_t *set) {
+    memset(set->bits, 0, sizeof(set->bits));
+    set->cursor = 0;
+    set->size = 0;
+}
+
+/**
+ * Adds a process to the set
+ * @param set - pointer to the set
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int proc_bitmap_add(proc_bitmap_t *set, proc_t *proc) {
+    if(proc->ready_set) {
+        kernel_log_error("proc_bitmap: pid %d is already in a set.", proc->pid);
+        return -1;
+    }
+
+    bitmap_set(set->bits, proc->entry + 1);
+    set->size++;
+    proc->ready_set = set;
+    return 0;
+}
+
+/**
+ * Removes a process from the set it is in
+ * @param proc - pointer to the process entry
+ */
+void proc_bitmap_remove(proc_t *proc) {
+    proc_bitmap_t *set = proc->ready_set;
+
+    if(!set) {
+        return;
+    }
+
+    bitmap_clear(set->bits, proc->entry + 1);
+    set->size--;
+    proc->ready_set = NULL;
+}
+
+/**
+ * Removes and returns the next process after the cursor
+ * @param set - pointer to the set
+ * @return pointer to the process entry, NULL if the set is empty
+ */
+proc_t *proc_bitmap_pop(proc_bitmap_t *set) {
+    proc_t *proc;
+    int bit;
+
+    // Scan past the cursor first and wrap around to the lowest entry.
+    bit = bitmap_find_next(set->bits, BITMAP_WORDS(PROC_MAX), set->cursor);
+    if(!bit) {
+        bit = bitmap_find_first(set->bits, BITMAP_WORDS(PROC_MAX));
+    }
+
+    if(!bit) {
+        return NULL;
+    }
+
+    proc = entry_to_proc(bit - 1);
+    if(!proc) {
+        kernel_panic("proc_bitmap: Entry %d is set but holds no process.", bit - 1);
+    }
+
+    set->cursor = bit;
+    proc_bitmap_remove(proc);
+    return proc;
+}
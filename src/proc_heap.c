@@ -0,0 +1,172 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process priority heap
+ */
+
+#include <spede/stddef.h>
+
+#include "kernel.h"
+#include "proc_heap.h"
+
+/**
+ * Compares the keys of two processes
+ * Keys are compared by their difference so that ordering survives the
+ * keys wrapping around.
+ * @param a - pointer to the first process entry
+ * @param b - pointer to the second process entry
+ * @return 1 if a orders before b, 0 otherwise
+ */
+int proc_heap_before(proc_t *a, proc_t *b) {
+    return (int)(a->heap_key - b->heap_key) < 0;
+}
+
+/**
+ * Stores a process at the given position in the heap
+ * @param heap - pointer to the heap
+ * @param index - position in the heap
+ * @param proc - pointer to the process entry
+ */
+void proc_heap_place(proc_heap_t *heap, int index, proc_t *proc) {
+    heap->items[index] = proc;
+    proc->heap_index = index;
+}
+
+/**
+ * Moves the process at the given position up until its parent is smaller
+ * @param heap - pointer to the heap
+ * @param index - position in the heap
+ */
+void proc_heap_sift_up(proc_heap_t *heap, int index) {
+    proc_t *proc = heap->items[index];
+    int parent;
+
+    while(index > 0) {
+        parent = (index - 1) / 2;
+
+        if(!proc_heap_before(proc, heap->items[parent])) {
+            break;
+        }
+
+        proc_heap_place(heap, index, heap->items[parent]);
+        index = parent;
+    }
+
+    proc_heap_place(heap, index, proc);
+}
+
+/**
+ * Moves the process at the given position down until its children are larger
+ * @param heap - pointer to the heap
+ * @param index - position in the heap
+ */
+void proc_heap_sift_down(proc_heap_t *heap, int index) {
+    proc_t *proc = heap->items[index];
+    int child;
+
+    while((child = 2 * index + 1) < heap->size) {
+        // Pick the smaller of the two children.
+        if(child + 1 < heap->size
+                && proc_heap_before(heap->items[child + 1], heap->items[child])) {
+            child++;
+        }
+
+        if(!proc_heap_before(heap->items[child], proc)) {
+            break;
+        }
+
+        proc_heap_place(heap, index, heap->items[child]);
+        index = child;
+    }
+
+    proc_heap_place(heap, index, proc);
+}
+
+/**
+ * Initializes an empty heap
+ * @param heap - pointer to the heap
+ */
+void proc_heap_init(proc_heap_t *heap) {
+    heap->size = 0;
+
+    for(int i = 0; i < PROC_MAX; i++) {
+        heap->items[i] = NULL;
+    }
+}
+
+/**
+ * Adds a process to the heap using its current heap key
+ * @param heap - pointer to the heap
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int proc_heap_insert(proc_heap_t *heap, proc_t *proc) {
+    if(!proc) {
+        kernel_log_error("proc_heap: Unable to insert invalid process.");
+        return -1;
+    }
+
+    if(heap->size >= PROC_MAX) {
+        kernel_log_error("proc_heap: Heap is full, process not added.");
+        return -1;
+    }
+
+    heap->items[heap->size] = proc;
+    heap->size++;
+    proc_heap_sift_up(heap, heap->size - 1);
+    return 0;
+}
+
+/**
+ * Removes a process from the heap
+ * @param heap - pointer to the heap
+ * @param proc - pointer to the process entry
+ */
+void proc_heap_remove(proc_heap_t *heap, proc_t *proc) {
+    int index = proc->heap_index;
+
+    if(index < 0 || index >= heap->size || heap->items[index] != proc) {
+        return;
+    }
+
+    heap->size--;
+    proc->heap_index = -1;
+
+    // Fill the hole with the last process and restore the heap order.
+    if(index < heap->size) {
+        proc_heap_place(heap, index, heap->items[heap->size]);
+        proc_heap_sift_down(heap, index);
+        proc_heap_sift_up(heap, index);
+    }
+    heap->items[heap->size] = NULL;
+}
+
+/**
+ * Returns the process with the lowest key without removing it
+ * @param heap - pointer to the heap
+ * @return pointer to the process entry, NULL if the heap is empty
+ */
+proc_t *proc_heap_peek(proc_heap_t *heap) {
+    if(heap->size == 0) {
+        return NULL;
+    }
+
+    return heap->items[0];
+}
+
+/**
+ * Removes and returns the process with the lowest key
+ * @param heap - pointer to the heap
+ * @return pointer to the process entry, NULL if the heap is empty
+ */
+proc_t *proc_heap_pop(proc_heap_t *heap) {
+    proc_t *proc = proc_heap_peek(heap);
+
+    if(proc) {
+        proc_heap_remove(heap, proc);
+    }
+
+    return proc;
+}
@@ -0,0 +1,96 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process run lists
+ */
+
+#include <spede/stddef.h>
+
+#include "kernel.h"
+#include "proc_list.h"
+
+/**
+ * Initializes an empty list
+ * @param list - pointer to the list
+ */
+void proc_list_init(proc_list_t *list) {
+    list->size = 0;
+    list->head = NULL;
+    list->tail = NULL;
+}
+
+/**
+ * Adds a process to the end of the list
+ * @param list - pointer to the list
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int proc_list_append(proc_list_t *list, proc_t *proc) {
+    if(proc->scheduler_queue) {
+        kernel_log_error("proc_list: pid %d is already on a list.", proc->pid);
+        return -1;
+    }
+
+    proc->list_prev = list->tail;
+    proc->list_next = NULL;
+
+    if(list->tail) {
+        list->tail->list_next = proc;
+    }
+    else {
+        list->head = proc;
+    }
+
+    list->tail = proc;
+    list->size++;
+    proc->scheduler_queue = list;
+    return 0;
+}
+
+/**
+ * Removes a process from the list it is on
+ * @param proc - pointer to the process entry
+ */
+void proc_list_remove(proc_t *proc) {
+    proc_list_t *list = proc->scheduler_queue;
+
+    if(!list) {
+        return;
+    }
+
+    if(proc->list_prev) {
+        proc->list_prev->list_next = proc->list_next;
+    }
+    else {
+        list->head = proc->list_next;
+    }
+
+    if(proc->list_next) {
+        proc->list_next->list_prev = proc->list_prev;
+    }
+    else {
+        list->tail = proc->list_prev;
+    }
+
+    list->size--;
+    proc->list_next = NULL;
+    proc->list_prev = NULL;
+    proc->scheduler_queue = NULL;
+}
+
+/**
+ * Removes and returns the process at the front of the list
+ * @param list - pointer to the list
+ * @return pointer to the process entry, NULL if the list is empty
+ */
+proc_t *proc_list_pop(proc_list_t *list) {
+    proc_t *proc = list->head;
+
+    if(proc) {
+        proc_list_remove(proc);
+    }
+
+    return proc;
+}
@@ -0,0 +1,409 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Process stacks
+ */
+
+#include <spede/stddef.h>
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "kmem.h"
+#include "kpaging.h"
+#include "kproc.h"
+#include "proc_stack.h"
+
+#define PROC_STACK_AREA_SIZE    0x40000000  // Size of the stack area (1GB)
+
+// Top and bottom of the region of a process table entry
+#define PROC_STACK_TOP(entry)   (PROC_STACK_AREA + ((entry) + 1) * PROC_STACK_REGION)
+#define PROC_STACK_BOTTOM(entry) (PROC_STACK_AREA + (entry) * PROC_STACK_REGION)
+
+// Rounds an address up to a page boundary
+#define PROC_STACK_PAGE_UP(addr) (((addr) + KMEM_PAGE_SIZE - 1) & ~(KMEM_PAGE_SIZE - 1))
+
+#if PROC_MAX > PROC_STACK_AREA_SIZE / PROC_STACK_REGION
+#error "PROC_MAX stack regions don't fit in the stack area"
+#endif
+
+#if PROC_STACK_REGION != PROC_REGION_SIZE
+#error "User programs find their stack region with PROC_REGION_SIZE"
+#endif
+
+// Stack of a process table entry
+typedef struct proc_stack_slot_t {
+    unsigned int base;          // Lowest address the stack may grow to, 0 if unused
+    unsigned int low;           // Lowest mapped address
+    unsigned int brk;           // End of the heap at the bottom of the region
+} proc_stack_slot_t;
+
+// Stack of each process table entry
+proc_stack_slot_t proc_stack_slots[PROC_MAX];
+
+// Usage of the process stacks
+proc_stack_stats_t proc_stack_stats;
+
+/**
+ * Maps one more page at the bottom of the mapped part of a stack
+ * @param slot - stack
+ * @return 0 on success, -1 if out of memory
+ */
+int proc_stack_map(proc_stack_slot_t *slot) {
+    void *page = kmem_page_alloc(1);
+
+    if(!page) {
+        return -1;
+    }
+
+    if(kpaging_map(slot->low - KMEM_PAGE_SIZE, page) != 0) {
+        kmem_page_free(page, 1);
+        return -1;
+    }
+
+    slot->low -= KMEM_PAGE_SIZE;
+
+    proc_stack_stats.resident++;
+    if(proc_stack_stats.resident > proc_stack_stats.peak) {
+        proc_stack_stats.peak = proc_stack_stats.resident;
+    }
+
+    return 0;
+}
+
+/**
+ * Maps a zeroed page into a heap
+ * @param vaddr - page aligned address below the break
+ * @return 0 on success, -1 if out of memory
+ */
+int proc_stack_map_heap(unsigned int vaddr) {
+    void *page = kmem_page_alloc(1);
+
+    if(!page) {
+        return -1;
+    }
+
+    memset(page, 0, KMEM_PAGE_SIZE);
+    if(kpaging_map(vaddr, page) != 0) {
+        kmem_page_free(page, 1);
+        return -1;
+    }
+
+    proc_stack_stats.heap++;
+    return 0;
+}
+
+/**
+ * Unmaps and frees the heap pages of a region from an address up
+ * @param entry - process table entry
+ * @param from - page aligned address of the first page to free
+ */
+void proc_stack_unmap_heap(int entry, unsigned int from) {
+    unsigned int end = PROC_STACK_PAGE_UP(proc_stack_slots[entry].brk);
+    void *page;
+
+    for(unsigned int addr = from; addr < end; addr += KMEM_PAGE_SIZE) {
+        page = kpaging_unmap(addr);
+        if(page) {
+            kmem_page_free(page, 1);
+            proc_stack_stats.heap--;
+        }
+    }
+}
+
+/**
+ * Initializes the process stacks
+ */
+void proc_stack_init(void) {
+    kernel_log_info("Initializing process stacks");
+
+    memset(proc_stack_slots, 0, sizeof(proc_stack_slots));
+    memset(&proc_stack_stats, 0, sizeof(proc_stack_stats));
+}
+
+/**
+ * Rounds a stack size up to whole pages
+ * @param size - requested stack size in bytes
+ * @return stack size in bytes, -1 if the request is too large
+ */
+int proc_stack_size(int size) {
+    if(size <= 0 || size > PROC_STACK_MAX) {
+        return -1;
+    }
+
+    return (size + KMEM_PAGE_SIZE - 1) & ~(KMEM_PAGE_SIZE - 1);
+}
+
+/**
+ * Allocates the stack of a process table entry
+ * Only the top page is mapped. The heap starts out one page long.
+ * @param entry - process table entry
+ * @param size - stack size in bytes; must be a whole number of pages
+ * @return pointer to the base of the stack, NULL on error
+ */
+unsigned char *proc_stack_alloc(int entry, int size) {
+    proc_stack_slot_t *slot;
+
+    if(entry < 0 || entry >= PROC_MAX || proc_stack_size(size) != size) {
+        kernel_log_error("proc_stack: invalid %d byte stack for entry %d.", size, entry);
+        return NULL;
+    }
+
+    slot = &proc_stack_slots[entry];
+    slot->low = PROC_STACK_TOP(entry);
+
+    if(proc_stack_map(slot) != 0) {
+        kernel_log_warn("proc_stack: out of memory for a stack.");
+        slot->low = 0;
+        return NULL;
+    }
+
+    slot->base = PROC_STACK_TOP(entry) - size;
+    slot->brk  = PROC_STACK_BOTTOM(entry) + KMEM_PAGE_SIZE;
+    proc_stack_stats.stacks++;
+
+    return (unsigned char *)slot->base;
+}
+
+/**
+ * Allocates the stack of a process table entry as a copy-on-write copy of
+ * another entry's stack
+ * The copy is as large as the original and placed as far below the top of
+ * its region, so offsets into the stack carry over. The heap is copied
+ * the same way. Every page mapped in the original is shared until either
+ * side writes to it.
+ * @param entry - process table entry of the copy
+ * @param from - process table entry whose stack is copied
+ * @return pointer to the base of the copy, NULL on error
+ */
+unsigned char *proc_stack_fork(int entry, int from) {
+    proc_stack_slot_t *slot;
+    proc_stack_slot_t *parent;
+
+    if(entry < 0 || entry >= PROC_MAX || from < 0 || from >= PROC_MAX || !proc_stack_slots[from].base) {
+        kernel_log_error("proc_stack: unable to copy the stack of entry %d to entry %d.", from, entry);
+        return NULL;
+    }
+
+    slot   = &proc_stack_slots[entry];
+    parent = &proc_stack_slots[from];
+
+    slot->base = PROC_STACK_TOP(entry) - (PROC_STACK_TOP(from) - parent->base);
+    slot->low  = PROC_STACK_TOP(entry);
+    slot->brk  = PROC_STACK_BOTTOM(entry);
+    proc_stack_stats.stacks++;
+
+    for(unsigned int addr = PROC_STACK_TOP(from) - KMEM_PAGE_SIZE; addr >= parent->low; addr -= KMEM_PAGE_SIZE) {
+        if(kpaging_share(addr, slot->low - KMEM_PAGE_SIZE) != 0) {
+            kpaging_shootdown();
+            proc_stack_free(entry);
+            kernel_log_warn("proc_stack: out of memory copying the stack of entry %d.", from);
+            return NULL;
+        }
+
+        slot->low -= KMEM_PAGE_SIZE;
+
+        proc_stack_stats.resident++;
+        if(proc_stack_stats.resident > proc_stack_stats.peak) {
+            proc_stack_stats.peak = proc_stack_stats.resident;
+        }
+    }
+
+    // Heap pages not touched yet stay unmapped in both.
+    for(unsigned int addr = 0; addr < parent->brk - PROC_STACK_BOTTOM(from); addr += KMEM_PAGE_SIZE) {
+        if(kpaging_present(PROC_STACK_BOTTOM(from) + addr)) {
+            if(kpaging_share(PROC_STACK_BOTTOM(from) + addr, PROC_STACK_BOTTOM(entry) + addr) != 0) {
+                kpaging_shootdown();
+                proc_stack_free(entry);
+                kernel_log_warn("proc_stack: out of memory copying the heap of entry %d.", from);
+                return NULL;
+            }
+            proc_stack_stats.heap++;
+        }
+
+        slot->brk = PROC_STACK_BOTTOM(entry) + addr + KMEM_PAGE_SIZE;
+    }
+    slot->brk = PROC_STACK_BOTTOM(entry) + (parent->brk - PROC_STACK_BOTTOM(from));
+
+    // The original's pages were made read-only.
+    kpaging_shootdown();
+
+    return (unsigned char *)slot->base;
+}
+
+/**
+ * Frees the stack and heap of a process table entry and every page
+ * mapped into them
+ * @param entry - process table entry
+ */
+void proc_stack_free(int entry) {
+    proc_stack_slot_t *slot;
+    void *page;
+
+    if(entry < 0 || entry >= PROC_MAX || !proc_stack_slots[entry].base) {
+        return;
+    }
+
+    slot = &proc_stack_slots[entry];
+
+    // The heap shares the stack's page table.
+    proc_stack_unmap_heap(entry, PROC_STACK_BOTTOM(entry));
+
+    for(unsigned int addr = slot->low; addr < PROC_STACK_TOP(entry); addr += KMEM_PAGE_SIZE) {
+        page = kpaging_unmap(addr);
+        if(page) {
+            kmem_page_free(page, 1);
+            proc_stack_stats.resident--;
+        }
+    }
+    kpaging_table_free(slot->low);
+
+    slot->base = 0;
+    slot->low  = 0;
+    slot->brk  = 0;
+    proc_stack_stats.stacks--;
+}
+
+/**
+ * Maps the memory a faulting access needs
+ * Below the break, the heap page holding the address is mapped. In the
+ * stack, every page from the one holding the address up to the part of
+ * the stack already mapped is, plus a spare page below.
+ * @param addr - faulting address
+ * @return 0 on success, -1 if the address isn't in a stack or heap or out of memory
+ */
+int proc_stack_fault(unsigned int addr) {
+    int entry = proc_stack_entry(addr);
+    proc_stack_slot_t *slot;
+    unsigned int low;
+
+    if(entry < 0 || entry >= PROC_MAX) {
+        return -1;
+    }
+
+    slot = &proc_stack_slots[entry];
+    if(!slot->base) {
+        return -1;
+    }
+
+    if(addr < slot->brk) {
+        if(proc_stack_map_heap(addr & ~(KMEM_PAGE_SIZE - 1)) != 0) {
+            kernel_log_warn("proc_stack: out of memory for the heap of entry %d.", entry);
+            return -1;
+        }
+        return 0;
+    }
+
+    if(addr < slot->base) {
+        return -1;
+    }
+
+    // The CPU pushes an interrupt's frame before any handler runs, and a
+    // frame landing on an unmapped page would lose the interrupt, so stay
+    // a page ahead of the deepest page touched.
+    low = addr & ~(KMEM_PAGE_SIZE - 1);
+    if(low - KMEM_PAGE_SIZE >= slot->base) {
+        low -= KMEM_PAGE_SIZE;
+    }
+
+    while(slot->low > low) {
+        if(proc_stack_map(slot) != 0) {
+            kernel_log_warn("proc_stack: out of memory growing the stack of entry %d.", entry);
+            return -1;
+        }
+    }
+
+    proc_stack_stats.faults++;
+    return 0;
+}
+
+/**
+ * Moves the break of a process table entry's heap
+ * Pages above a lowered break are unmapped and freed.
+ * @param entry - process table entry
+ * @param brk - new end of the heap; at most a guard page below the stack
+ * @return 0 on success, -1 on error
+ */
+int proc_stack_set_brk(int entry, unsigned int brk) {
+    proc_stack_slot_t *slot;
+
+    if(entry < 0 || entry >= PROC_MAX || !proc_stack_slots[entry].base) {
+        return -1;
+    }
+
+    slot = &proc_stack_slots[entry];
+    if(brk < PROC_STACK_BOTTOM(entry) || brk > slot->base - KMEM_PAGE_SIZE) {
+        kernel_log_warn("proc_stack: break 0x%08x is outside the heap of entry %d.", brk, entry);
+        return -1;
+    }
+
+    if(brk < slot->brk) {
+        proc_stack_unmap_heap(entry, PROC_STACK_PAGE_UP(brk));
+    }
+
+    slot->brk = brk;
+    return 0;
+}
+
+/**
+ * Returns the break of a process table entry's heap
+ * @param entry - process table entry
+ * @return end of the heap, 0 if the entry has no stack
+ */
+unsigned int proc_stack_get_brk(int entry) {
+    if(entry < 0 || entry >= PROC_MAX) {
+        return 0;
+    }
+
+    return proc_stack_slots[entry].brk;
+}
+
+/**
+ * Returns the start of a process table entry's heap
+ * @param entry - process table entry
+ * @return start of the heap, the bottom of the entry's region
+ */
+unsigned int proc_stack_heap(int entry) {
+    return PROC_STACK_BOTTOM(entry);
+}
+
+/**
+ * Returns the process table entry whose region holds an address
+ * @param addr - address
+ * @return process table entry, -1 if the address isn't in the stack area
+ */
+int proc_stack_entry(unsigned int addr) {
+    if(addr < PROC_STACK_AREA || addr - PROC_STACK_AREA >= PROC_STACK_AREA_SIZE) {
+        return -1;
+    }
+
+    return (addr - PROC_STACK_AREA) / PROC_STACK_REGION;
+}
+
+/**
+ * Returns how much of a stack is mapped
+ * @param entry - process table entry
+ * @return number of bytes mapped, 0 if the entry has no stack
+ */
+int proc_stack_resident(int entry) {
+    if(entry < 0 || entry >= PROC_MAX || !proc_stack_slots[entry].base) {
+        return 0;
+    }
+
+    return PROC_STACK_TOP(entry) - proc_stack_slots[entry].low;
+}
+
+/**
+ * Retrieves the usage of the process stacks
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int proc_stack_get_stats(proc_stack_stats_t *stats) {
+    if(!stats) {
+        return -1;
+    }
+
+    *stats = proc_stack_stats;
+    return 0;
+}
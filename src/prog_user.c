@@ -9,6 +9,7 @@
 #include <spede/stdio.h>
 #include <spede/string.h>
 #include "syscall.h"
+#include "umalloc.h"
 
 #define BUF_SIZE 128
 
@@ -25,6 +26,9 @@
 #define CMD_SLEEP "sleep"
 #define CMD_TIME "time"
 #define CMD_LOCK "lock"
+#define CMD_FORK "fork"
+#define CMD_HEAP "heap"
+#define CMD_MEM "mem"
 
 /*
  * Mutexes for the lock
@@ -97,7 +101,10 @@ void prog_shell(void) {
             if (strncmp(input, CMD_HELP, strlen(CMD_HELP)) == 0) {
                 pprintf("Enter one of the following commands:\n");
                 pprintf("\texit\t  exits the process\n");
+                pprintf("\tfork\t  runs a copy of this shell until it exits\n");
+                pprintf("\theap\t  allocates and frees memory from the process heap\n");
                 pprintf("\tlock\t  takes a lock that may block other shells\n");
+                pprintf("\tmem\t  displays stack and heap memory usage\n");
                 pprintf("\tsleep\t  puts the process to sleep for %d seconds\n", sleep_seconds);
                 pprintf("\ttime\t  displays the current system time\n");
                 pprintf("\n");
@@ -115,6 +122,65 @@ void prog_shell(void) {
                 mutex_lock(shell_mutex[pid % 2]);
                 proc_sleep(sleep_seconds);
                 mutex_unlock(shell_mutex[pid % 2]);
+            } else if (strncmp(input, CMD_FORK, strlen(CMD_FORK)) == 0) {
+                proc_stats_t before;
+                proc_stats_t after;
+                int status;
+
+                proc_get_stats(pid, &before);
+                int child = proc_fork();
+
+                if (child == 0) {
+                    // The child carries on as a shell of its own.
+                    pid = proc_get_pid();
+                    if (shell_mutex[pid % 2] < 0) {
+                        shell_mutex[pid % 2] = mutex_init();
+                    }
+                    pprintf("Forked process id %d\n", pid);
+                } else if (child < 0) {
+                    pprintf("Unable to fork process id %d\n", pid);
+                } else {
+                    proc_get_stats(pid, &after);
+                    pprintf("Forked process id %d in %d cycles, %d pages shared\n", child,
+                            (int)(after.kernel_cycles - before.kernel_cycles),
+                            after.pages_shared - before.pages_shared);
+                    proc_wait(child, &status);
+                    proc_get_stats(pid, &after);
+                    pprintf("Process id %d exited with status %d, %d pages copied\n", child,
+                            status, after.pages_copied - before.pages_copied);
+                }
+            } else if (strncmp(input, CMD_HEAP, strlen(CMD_HEAP)) == 0) {
+                umalloc_stats_t heap_stats;
+                char *blocks[8];
+
+                // Sizes are only known at run time: 64 bytes to 8KB.
+                for (int i = 0; i < 8; i++) {
+                    blocks[i] = umalloc(64 << i);
+                    if (blocks[i]) {
+                        memset(blocks[i], 'a' + i, 64 << i);
+                    }
+                }
+
+                umalloc_get_stats(&heap_stats);
+                pprintf("Heap is %d bytes, %d used by %d blocks\n",
+                        heap_stats.size, heap_stats.used, heap_stats.in_use);
+
+                for (int i = 0; i < 8; i++) {
+                    ufree(blocks[i]);
+                }
+
+                umalloc_get_stats(&heap_stats);
+                pprintf("%u allocations, %u frees, %d blocks in use\n",
+                        heap_stats.allocs, heap_stats.frees, heap_stats.in_use);
+            } else if (strncmp(input, CMD_MEM, strlen(CMD_MEM)) == 0) {
+                proc_stats_t stats;
+
+                if (proc_get_stats(pid, &stats) == 0) {
+                    pprintf("Stack is %d bytes, %d used at most; heap is %d bytes\n",
+                            stats.stack_size, stats.stack_peak, stats.heap_size);
+                    pprintf("All stacks: %d pages mapped, %d at most, grown by %d faults\n",
+                            stats.stack_pages, stats.stack_pages_peak, stats.stack_faults);
+                }
             } else {
                 pprintf("You entered the following:\n%s\n", input);
             }
@@ -16,111 +16,665 @@
 #include "kproc.h"
 #include "scheduler.h"
 #include "timer.h"
+#include "tsc.h"
+#include "bit_util.h"
+#include "proc_heap.h"
+#include "proc_list.h"
+#include "proc_bitmap.h"
 
-#include "queue.h"
+// Run queue of a CPU
+typedef struct run_queue_t {
+    // Runnable processes, one set per priority level: FIFO lists, or
+    // ready bitmaps picked round-robin by process table entry
+#if SCHEDULER_BITMAP
+    proc_bitmap_t levels[SCHEDULER_LEVELS];
+#else
+    proc_list_t levels[SCHEDULER_LEVELS];
+#endif
 
-// Process Queues
-queue_t run_queue;
-queue_t sleep_queue;
+    // Bitmap of non-empty run lists; bit (level + 1) is set when
+    // levels[level] has a process in it
+    int run_levels;
+
+    // Runnable stride class processes ordered by pass
+    proc_heap_t stride_heap;
+
+    // Pass of the most recently scheduled stride process; processes
+    // joining the stride class start from here so they can't claim time
+    // they missed
+    unsigned int stride_pass;
+
+    // Runnable EDF class processes ordered by absolute deadline
+    proc_heap_t edf_heap;
+
+    // Number of processes waiting to run
+    int size;
+} run_queue_t;
+
+// Run queues, one per CPU
+run_queue_t run_queues[CPU_MAX];
+
+// System-wide wakeup-to-run latency histogram
+unsigned int scheduler_latency[SCHED_LATENCY_BUCKETS];
+
+// Scheduler activity counters
+scheduler_stats_t scheduler_stats;
+
+// 1 when timeslices are sized from each process' bursts
+int scheduler_adaptive = 1;
+
+// Sleeping processes ordered by wake time (delta list). Each entry's
+// sleep_time is relative to the entry in front of it, so only the head
+// needs to be decremented on a tick.
+proc_t *sleep_list;
+
+// Tick count when the scheduler timer last ran
+int scheduler_last_tick;
+
+/**
+ * Removes a process from the sleep list
+ * The remaining sleep time is handed to the process behind it so
+ * later sleepers keep their absolute wake times.
+ * @param proc - pointer to the process entry
+ */
+void scheduler_sleep_unlink(proc_t *proc) {
+    proc_t **link = &sleep_list;
+
+    while(*link && *link != proc) {
+        link = &(*link)->sleep_next;
+    }
+
+    if(!*link) {
+        return;
+    }
+
+    if(proc->sleep_next) {
+        proc->sleep_next->sleep_time += proc->sleep_time;
+    }
+
+    *link = proc->sleep_next;
+    proc->sleep_next = NULL;
+    proc->sleep_time = 0;
+}
+
+/**
+ * Returns the priority level a process is scheduled at
+ * This is the higher of its own priority and any inherited priority.
+ * Stride class processes form a band at SCHEDULER_STRIDE_LEVEL, which
+ * runs ahead of the MLFQ processes on that level and behind the levels
+ * above it. EDF class processes run ahead of every level and pass on
+ * the highest one (0) when blocked.
+ * @param proc - pointer to the process entry
+ * @return priority level (0 is the highest)
+ */
+int scheduler_priority(proc_t *proc) {
+    int priority = proc->priority;
+
+    if(proc->sched_class == SCHED_CLASS_STRIDE) {
+        priority = SCHEDULER_STRIDE_LEVEL;
+    }
+    else if(proc->sched_class == SCHED_CLASS_EDF) {
+        priority = 0;
+    }
+
+    if(proc->inherited_priority < priority) {
+        return proc->inherited_priority;
+    }
+
+    return priority;
+}
+
+/**
+ * Indicates if a process is waiting to run in a run queue or heap
+ * @param proc - pointer to the process entry
+ * @return 1 if queued, 0 otherwise
+ */
+int scheduler_queued(proc_t *proc) {
+    return proc->state == IDLE
+        && (proc->scheduler_queue || proc->ready_set || proc->heap_index >= 0);
+}
+
+/**
+ * Adds a process to a priority level of a run queue
+ * @param rq - pointer to the run queue
+ * @param level - priority level
+ * @param proc - pointer to the process entry
+ * @return -1 on error; 0 on success
+ */
+int scheduler_level_add(run_queue_t *rq, int level, proc_t *proc) {
+#if SCHEDULER_BITMAP
+    if(proc_bitmap_add(&rq->levels[level], proc) != 0) {
+        return -1;
+    }
+#else
+    if(proc_list_append(&rq->levels[level], proc) != 0) {
+        return -1;
+    }
+#endif
+
+    rq->run_levels = bit_set(rq->run_levels, level + 1);
+    return 0;
+}
+
+/**
+ * Removes and returns the next process from a priority level of a run queue
+ * @param rq - pointer to the run queue
+ * @param level - priority level
+ * @return pointer to the process entry, NULL if the level is empty
+ */
+proc_t *scheduler_level_pop(run_queue_t *rq, int level) {
+#if SCHEDULER_BITMAP
+    proc_t *proc = proc_bitmap_pop(&rq->levels[level]);
+#else
+    proc_t *proc = proc_list_pop(&rq->levels[level]);
+#endif
+
+    if(rq->levels[level].size == 0) {
+        rq->run_levels = bit_clear(rq->run_levels, level + 1);
+    }
+
+    return proc;
+}
+
+/**
+ * Removes a process from the priority level of the run queue it is on
+ * @param rq - pointer to the run queue
+ * @param proc - pointer to the process entry
+ * @return 1 if the process was on a level, 0 otherwise
+ */
+int scheduler_level_remove(run_queue_t *rq, proc_t *proc) {
+#if SCHEDULER_BITMAP
+    proc_bitmap_t *level = proc->ready_set;
+
+    if(!level) {
+        return 0;
+    }
+    proc_bitmap_remove(proc);
+#else
+    proc_list_t *level = proc->scheduler_queue;
+
+    if(!level) {
+        return 0;
+    }
+    proc_list_remove(proc);
+#endif
+
+    if(level->size == 0) {
+        rq->run_levels = bit_clear(rq->run_levels, (level - rq->levels) + 1);
+    }
+
+    return 1;
+}
+
+/**
+ * Picks the CPU with the fewest processes waiting to run
+ * @return CPU id
+ */
+int scheduler_least_loaded(void) {
+    int best = cpu_id();
+    cpu_t *cpu;
+
+    for(int i = 0; i < CPU_MAX; i++) {
+        cpu = cpu_entry(i);
+
+        if(cpu->started && run_queues[i].size < run_queues[best].size) {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Removes and returns the next process to run from a run queue
+ * EDF processes run first, then the highest non-empty priority level.
+ * The stride process with the lowest pass runs instead when no level
+ * above the stride band has a process.
+ * @param rq - pointer to the run queue
+ * @param edf - 1 to consider EDF processes, 0 to skip them
+ * @return pointer to the process entry, NULL if none can run
+ */
+proc_t *scheduler_pop(run_queue_t *rq, int edf) {
+    proc_t *proc = NULL;
+    int level = bit_find_first(rq->run_levels) - 1;
+
+    if(edf) {
+        proc = proc_heap_pop(&rq->edf_heap);
+    }
+
+    if(!proc && rq->stride_heap.size > 0 && (level < 0 || level >= SCHEDULER_STRIDE_LEVEL)) {
+        proc = proc_heap_pop(&rq->stride_heap);
+        rq->stride_pass = proc->pass;
+    }
+    else if(!proc && level >= 0) {
+        proc = scheduler_level_pop(rq, level);
+    }
+
+    if(proc) {
+        rq->size--;
+    }
+
+    return proc;
+}
+
+/**
+ * Steals a waiting process from the busiest other CPU
+ * EDF processes stay on their CPU so its admission control holds.
+ * @param id - id of the CPU that is out of work
+ * @return pointer to the process entry, NULL if there is nothing to steal
+ */
+proc_t *scheduler_steal(int id) {
+    int busiest = -1;
+    proc_t *proc;
+
+    for(int i = 0; i < CPU_MAX; i++) {
+        if(i == id || !cpu_entry(i)->started) {
+            continue;
+        }
+
+        if(run_queues[i].size > run_queues[i].edf_heap.size
+                && (busiest < 0 || run_queues[i].size > run_queues[busiest].size)) {
+            busiest = i;
+        }
+    }
+
+    if(busiest < 0) {
+        return NULL;
+    }
+
+    proc = scheduler_pop(&run_queues[busiest], 0);
+    if(proc) {
+        kernel_log_trace("scheduler: CPU %d stole pid %d from CPU %d", id, proc->pid, busiest);
+        proc->cpu = id;
+    }
+
+    return proc;
+}
+
+/**
+ * Returns the timeslice for a process
+ * The slice is twice the average CPU burst, so processes that block
+ * quickly are preempted quickly if they start spinning, while CPU-bound
+ * processes switch less often. Every process gets SCHEDULER_TIMESLICE
+ * while adaptive slices are turned off.
+ * @param proc - pointer to the process entry
+ * @return number of ticks in the timeslice
+ */
+int scheduler_timeslice(proc_t *proc) {
+    int slice = (2 * proc->burst_avg + (1 << SCHEDULER_BURST_SHIFT) - 1) >> SCHEDULER_BURST_SHIFT;
+
+    if(!scheduler_adaptive) {
+        return SCHEDULER_TIMESLICE;
+    }
+
+    if(slice < SCHEDULER_TIMESLICE_MIN) {
+        return SCHEDULER_TIMESLICE_MIN;
+    }
+
+    if(slice > SCHEDULER_TIMESLICE_MAX) {
+        return SCHEDULER_TIMESLICE_MAX;
+    }
+
+    return slice;
+}
+
+/**
+ * Folds the CPU burst that just ended into a process' average
+ * The burst is the CPU time used since the process was last added to
+ * the scheduler, and is weighted by 1/2^SCHEDULER_BURST_WEIGHT.
+ * @param proc - pointer to the process entry
+ */
+void scheduler_burst(proc_t *proc) {
+    int burst = proc->cpu_time << SCHEDULER_BURST_SHIFT;
+
+    proc->burst_avg += (burst - proc->burst_avg) >> SCHEDULER_BURST_WEIGHT;
+}
+
+/**
+ * Aging pass
+ * Returns every process to its base priority so that processes which
+ * have been demoted are not starved by higher priority levels.
+ */
+void scheduler_age(void) {
+    proc_t *proc;
+
+    for(int i = 0; i < PROC_MAX; i++) {
+        proc = entry_to_proc(i);
+
+        if(!proc || proc->priority == proc->base_priority) {
+            continue;
+        }
+
+        // Processes waiting in a run queue are moved to their new level.
+        if(scheduler_queued(proc)) {
+            scheduler_remove(proc);
+            proc->priority = proc->base_priority;
+            scheduler_add(proc);
+        }
+        else {
+            proc->priority = proc->base_priority;
+        }
+    }
+}
+
+/**
+ * Records the wakeup-to-run latency of a process being dispatched
+ * Latencies are counted in log2 buckets of TSC cycles.
+ * @param proc - pointer to the process entry
+ */
+void scheduler_latency_record(proc_t *proc) {
+    unsigned long long latency = tsc_read() - proc->wakeup_tsc;
+    int bucket = SCHED_LATENCY_BUCKETS - 1;
+
+    if(!(latency >> 32)) {
+        bucket = bit_find_last((unsigned int)latency) - 1;
+
+        if(bucket < 0) {
+            bucket = 0;
+        }
+        else if(bucket >= SCHED_LATENCY_BUCKETS) {
+            bucket = SCHED_LATENCY_BUCKETS - 1;
+        }
+    }
+
+    proc->latency[bucket]++;
+    scheduler_latency[bucket]++;
+    scheduler_stats.wakeups++;
+    scheduler_stats.wakeup_cycles += latency;
+    proc->wakeup_tsc = 0;
+}
+
+/**
+ * Releases the next job of an EDF process
+ * A job that was not completed before the next release has missed its
+ * deadline. Periods that passed entirely while the process was throttled
+ * are skipped.
+ * @param proc - pointer to the process entry
+ */
+void scheduler_edf_release(proc_t *proc) {
+    int now = timer_get_ticks();
+
+    if(!proc->job_done) {
+        proc->deadline_misses++;
+        kernel_log_debug("scheduler: pid %d missed its deadline at %d", proc->pid, proc->deadline);
+    }
+
+    proc->release_time += proc->period;
+    if(now - proc->release_time >= proc->period) {
+        proc->release_time = now - (now - proc->release_time) % proc->period;
+    }
+
+    proc->deadline        = proc->release_time + proc->period;
+    proc->budget_left     = proc->budget;
+    proc->job_done        = 0;
+    proc->job_started     = 0;
+    proc->release_pending = 0;
+}
+
+/**
+ * Suspends an EDF process until its next job is released
+ * If the release time has already passed, the job is released now.
+ * @param proc - pointer to the process entry
+ */
+void scheduler_edf_wait_release(proc_t *proc) {
+    int next = proc->release_time + proc->period - timer_get_ticks();
+
+    proc->release_pending = 1;
+
+    if(next <= 0) {
+        scheduler_edf_release(proc);
+    }
+    else {
+        scheduler_sleep(proc, next);
+    }
+}
+
+/**
+ * Indicates if a process should give up the CPU to a waiting process
+ * EDF processes are preempted by an earlier deadline, every other process
+ * by a runnable EDF process or a higher priority level. MLFQ processes
+ * at or below the stride band are also preempted by a runnable stride
+ * process. The idle task is preempted by any runnable process.
+ * @param proc - pointer to the active process entry
+ * @return 1 if the process should be preempted, 0 otherwise
+ */
+int scheduler_preempt(proc_t *proc) {
+    run_queue_t *rq = &run_queues[cpu_id()];
+    proc_t *edf = proc_heap_peek(&rq->edf_heap);
+    int priority;
+
+    if(proc->type == PROC_TYPE_IDLE) {
+        return rq->size > 0;
+    }
+
+    if(proc->sched_class == SCHED_CLASS_EDF) {
+        return edf && edf->deadline < proc->deadline;
+    }
+
+    if(edf) {
+        return 1;
+    }
+
+    priority = scheduler_priority(proc);
+
+    // The stride band runs ahead of the MLFQ processes on its level.
+    if(rq->stride_heap.size > 0 && priority >= SCHEDULER_STRIDE_LEVEL
+            && proc->sched_class != SCHED_CLASS_STRIDE) {
+        return 1;
+    }
+
+    return (rq->run_levels & ((1 << priority) - 1)) != 0;
+}
 
 /**
  * Scheduler timer callback
+ * Charges the ticks since it last ran to the running processes and wakes
+ * the sleepers that are due.
  */
 void scheduler_timer(void) {
-    // Update active processes' cpu time and total run time.
-    if(active_proc) {
-        active_proc->run_time++;
-        active_proc->cpu_time++;
-    }
-
-    // Decrement sleep_time for processes in sleep_queue, add back to run_queue
-    // if necessary.
-    if(!queue_is_empty(&sleep_queue)) {
-        int pid;
-        proc_t *proc;
-
-        for(int i = 0; i < sleep_queue.size; i++) {
-            // Queues out process from sleep queue and temporarily hold its pid.
-            if(queue_out(&sleep_queue, &pid) != 0) {
-                kernel_log_warn("scheduler: Unable to queue out id from sleep queue.");
-                continue;
-            }
+    proc_t *proc;
+    int now = timer_get_ticks();
 
-            // Get the process' pointer by using the pid provided by the dequeue.
-            proc = pid_to_proc(pid);
-            if(!proc) {
-                kernel_log_warn("scheduler: Unable to search process id %d", pid);
-                continue;
-            }
+    // More than one tick may have passed if the tick was stopped while idle.
+    int ticks = now - scheduler_last_tick;
+    scheduler_last_tick = now;
 
-            // Wake the process and queue it back into the run queue.
-            if(proc->sleep_time == 1) {
-                proc->sleep_time = 0;
-                scheduler_add(proc);
-                //proc->state = IDLE;
-                //queue_in(&run_queue, pid);
-            }
-            else {
-                // Reduce the timer by one and queue it back into the sleep queue.
-                proc->sleep_time--;
-                queue_in(&sleep_queue, pid);
+    // Update the active processes' cpu time and total run time on every CPU.
+    for(int i = 0; i < CPU_MAX; i++) {
+        proc = cpu_entry(i)->current;
+
+        if(!proc) {
+            continue;
+        }
+
+        proc->run_time += ticks;
+        proc->cpu_time += ticks;
+
+        // Stride processes advance their pass by the time they used.
+        if(proc->sched_class == SCHED_CLASS_STRIDE) {
+            proc->pass += proc->stride * ticks;
+        }
+    }
+
+    // Only the head of the sleep list is decremented. Every process whose
+    // delta has run out is woken and added back to the run queue.
+    if(sleep_list) {
+        sleep_list->sleep_time -= ticks;
+
+        while(sleep_list && sleep_list->sleep_time <= 0) {
+            proc = sleep_list;
+            sleep_list = proc->sleep_next;
+
+            // Carry any overshoot to the next sleeper.
+            if(sleep_list) {
+                sleep_list->sleep_time += proc->sleep_time;
             }
+
+            proc->sleep_next = NULL;
+            proc->sleep_time = 0;
+            scheduler_add(proc);
+        }
+    }
+
+    // Periodically age all processes to prevent starvation.
+    if(now / SCHEDULER_BOOST_INTERVAL != (now - ticks) / SCHEDULER_BOOST_INTERVAL) {
+        scheduler_age();
+    }
+
+    // EDF processes that overrun their budget are throttled until their
+    // next release. A process may be running on another CPU right now, so
+    // it is only marked here; its own CPU takes it off when it next runs
+    // the scheduler.
+    for(int i = 0; i < CPU_MAX; i++) {
+        proc = cpu_entry(i)->current;
+
+        if(!proc || proc->sched_class != SCHED_CLASS_EDF) {
+            continue;
+        }
+
+        proc->budget_left -= ticks;
+
+        if(proc->budget_left <= 0) {
+            proc->throttle_pending = 1;
         }
     }
 }
 
+/**
+ * Returns the number of ticks until the next sleeping process wakes
+ * @return number of ticks, -1 if no process is sleeping
+ */
+int scheduler_next_wakeup(void) {
+    if(!sleep_list) {
+        return -1;
+    }
+
+    return sleep_list->sleep_time;
+}
+
+/**
+ * Makes a process the active process of a CPU
+ * @param cpu - pointer to the CPU entry
+ * @param proc - pointer to the process entry
+ */
+void scheduler_dispatch(cpu_t *cpu, proc_t *proc) {
+    // Update the active proc pointer.
+    if(cpu->current != proc) {
+        scheduler_stats.switches++;
+    }
+    cpu->current = proc;
+
+    // Record how long after its release an EDF job first ran.
+    if(proc->sched_class == SCHED_CLASS_EDF && !proc->job_started) {
+        proc->job_started = 1;
+        proc->jitter_last = timer_get_ticks() - proc->release_time;
+
+        if(proc->jitter_last > proc->jitter_max) {
+            proc->jitter_max = proc->jitter_last;
+        }
+    }
+
+    // Record how long the process waited to run after being woken.
+    if(proc->wakeup_tsc) {
+        scheduler_latency_record(proc);
+    }
+
+    // Ensure that the process state is set.
+    proc->state = ACTIVE;
+}
+
 /**
  * Executes the scheduler
  * Should ensure that `active_proc` is set to a valid process entry
  */
 void scheduler_run(void) {
-    int pid;
+    cpu_t *cpu = cpu_get();
+    proc_t *proc = cpu->current;
 
     // Ensure that processes not in the active state aren't still scheduled.
-    if(active_proc && active_proc->state != ACTIVE) {
-        active_proc = NULL;
+    if(proc && proc->state != ACTIVE) {
+        proc = NULL;
+    }
+
+    // Throttle an EDF process that overran its budget on the last tick.
+    // It keeps running if its next job is already due.
+    if(proc && proc->throttle_pending) {
+        kernel_log_debug("scheduler: pid %d throttled at %d", proc->pid, timer_get_ticks());
+        proc->throttle_pending = 0;
+        scheduler_edf_wait_release(proc);
+
+        if(cpu->current != proc) {
+            proc = NULL;
+        }
     }
 
     // Check if we have an active process.
-    if(active_proc) {
+    if(proc) {
         // Check if the current process has exceeded it's time slice.
-        if(active_proc->cpu_time >= SCHEDULER_TIMESLICE) {
-            // Reset the active time.
-            active_proc->cpu_time = 0;
+        if(proc->cpu_time >= scheduler_timeslice(proc)) {
+            // Count the whole slice as a burst so CPU-bound processes
+            // earn longer slices.
+            scheduler_burst(proc);
+
+            // The process burned its whole slice; demote it one level.
+            if(proc->sched_class == SCHED_CLASS_MLFQ
+                    && proc->priority < SCHEDULER_LEVELS - 1) {
+                proc->priority++;
+            }
 
             // If the process is not the idle task, add it back to the scheduler.
-            if(active_proc->pid != 0) {
-                scheduler_add(active_proc);
+            if(proc->type != PROC_TYPE_IDLE) {
+                scheduler_add(proc);
             }
             else {
                 // Otherwise, simply set the state to IDLE.
-                active_proc->state = IDLE;
+                proc->cpu_time = 0;
+                proc->state = IDLE;
             }
 
             // Unschedule the active process.
-            active_proc = NULL;
+            proc = NULL;
+        }
+        // A process that was just handed the CPU keeps it for this pass.
+        else if(proc->handoff) {
+            proc->handoff = 0;
+        }
+        // Preempt the process if a more urgent process has become runnable.
+        else if(scheduler_preempt(proc)) {
+            if(proc->type != PROC_TYPE_IDLE) {
+                scheduler_add(proc);
+            }
+            else {
+                proc->state = IDLE;
+            }
+
+            proc = NULL;
         }
     }
 
     // Check if we have a process scheduled or not.
-    if(!active_proc) {
-        // Get the proces id from the run queue.
-        if(queue_out(&run_queue, &pid) != 0) {
-            // Default to process id 0 (idle task) if a process can't be scheduled.
-            pid = 0;
+    if(!proc) {
+        // Pick from this CPU's run queue, then take work from the busiest
+        // CPU, and only then fall back to the idle task.
+        proc = scheduler_pop(&run_queues[cpu->id], 1);
+
+        if(!proc) {
+            proc = scheduler_steal(cpu->id);
+        }
+
+        if(!proc) {
+            proc = cpu->idle_proc;
         }
-        // Update the active proc pointer.
-        active_proc = pid_to_proc(pid);
-        kernel_log_trace("Active proc set to proc pid[%d]", pid);
+
+        kernel_log_trace("Active proc set to proc pid[%d]", proc ? proc->pid : -1);
     }
 
     // Make sure we have a valid process at this point
-    if(!active_proc) {
+    if(!proc) {
         kernel_panic("scheduler: There is no active valid process!");
     }
 
-    // Ensure that the process state is set.
-    active_proc->state = ACTIVE;
+    scheduler_dispatch(cpu, proc);
 }
 
 /**
@@ -128,23 +682,81 @@ void scheduler_run(void) {
  * @param proc - pointer to the process entry
  */
 void scheduler_add(proc_t *proc) {
+    int level;
+    run_queue_t *rq;
+
     if(!proc) {
         kernel_panic("scheduler: Unable to add invalid process to scheduler.");
     }
 
-    // Prevents kernel process to be placed into the run queue.
-    if(proc->pid == 0) {
+    // Prevents the idle tasks from being placed into a run queue.
+    if(proc->type == PROC_TYPE_IDLE) {
         return;
     }
 
-    // Add the process to the run queue.
-    if(queue_in(&run_queue, proc->pid) != 0) {
-        kernel_panic("scheduler: Unable to add the process to the scheduler.");
+    // Processes stay on the CPU they last ran on; new processes go to
+    // the CPU with the least work.
+    if(proc->cpu < 0) {
+        proc->cpu = scheduler_least_loaded();
+    }
+    rq = &run_queues[proc->cpu];
+
+    if(proc->state == SLEEPING || proc->state == WAITING) {
+        // The process blocked, ending its CPU burst.
+        scheduler_burst(proc);
+
+        // A process waking up after blocking is boosted one level.
+        if(proc->priority > proc->base_priority) {
+            proc->priority--;
+        }
+
+        // Time stamp the wakeup to measure how long it waits to run.
+        proc->wakeup_tsc = tsc_read();
     }
 
+    level = scheduler_priority(proc);
+
+    // EDF processes are ordered by deadline. A process waking up for its
+    // next period has a new job released.
+    if(proc->sched_class == SCHED_CLASS_EDF) {
+        if(proc->release_pending) {
+            scheduler_edf_release(proc);
+        }
+
+        proc->heap_key = proc->deadline;
+        if(proc_heap_insert(&rq->edf_heap, proc) != 0) {
+            kernel_panic("scheduler: Unable to add the process to the scheduler.");
+        }
+    }
+    // Stride processes are ordered by pass in their band, unless they
+    // inherited a higher level. A process joining late starts at the
+    // current pass so it can't claim time it missed.
+    else if(proc->sched_class == SCHED_CLASS_STRIDE && level == SCHEDULER_STRIDE_LEVEL) {
+        if((int)(proc->pass - rq->stride_pass) < 0) {
+            proc->pass = rq->stride_pass;
+        }
+
+        proc->heap_key = proc->pass;
+        if(proc_heap_insert(&rq->stride_heap, proc) != 0) {
+            kernel_panic("scheduler: Unable to add the process to the scheduler.");
+        }
+    }
+    // Add the process to the run queue for its priority level.
+    else {
+        if(scheduler_level_add(rq, level, proc) != 0) {
+            kernel_panic("scheduler: Unable to add the process to the scheduler.");
+        }
+    }
+    rq->size++;
+
     // Set the process state.
     proc->state = IDLE;
     proc->cpu_time = 0;
+    proc->handoff = 0;
+
+    // A process that left the CPU before it could be throttled is marked
+    // again on the next tick it runs, as its budget is still spent.
+    proc->throttle_pending = 0;
 }
 
 /**
@@ -152,67 +764,412 @@ void scheduler_add(proc_t *proc) {
  * @param proc - pointer to the process entry
  */
 void scheduler_remove(proc_t *proc) {
-    int pid;
+    run_queue_t *rq;
+    cpu_t *cpu;
 
     if(!proc) {
         kernel_log_debug("scheduler: Invalid process; no process was removed.");
         return;
     }
 
-    // Iterate through each process in the queue.
-    for(int i = 0; i < run_queue.size; i++) {
+    // Sleeping processes are only on the sleep list.
+    if(proc->state == SLEEPING) {
+        scheduler_sleep_unlink(proc);
+        return;
+    }
 
-        // Dequeue each process, then check if its a match. If it matches, do not add
-        // back into queue, otherwise, add it back in.
-        if(queue_out(&run_queue, &pid) != 0) {
-            kernel_log_warn("scheduler: Unable to queue out the process entry");
-        }
+    // Processes that were never added aren't on any CPU.
+    cpu = cpu_entry(proc->cpu);
+    if(!cpu) {
+        return;
+    }
+    rq = &run_queues[proc->cpu];
 
-        if(proc->pid == pid) {
-            // The process is found.
-            continue;
+    // Remove the process from the run list it resides in.
+    if(scheduler_level_remove(rq, proc)) {
+        rq->size--;
+    }
+    else if(proc->heap_index >= 0) {
+        if(proc->sched_class == SCHED_CLASS_EDF) {
+            proc_heap_remove(&rq->edf_heap, proc);
+        }
+        else {
+            proc_heap_remove(&rq->stride_heap, proc);
         }
+        rq->size--;
+    }
 
-        if(queue_in(&run_queue, pid) != 0) {
-            kernel_panic("scheduler: Unable to queue process back to the run queue.");
+    // If the process is running, ensure that the active process of its
+    // CPU is cleared so when the scheduler runs again, it will select a
+    // new process to run. Only its own CPU can do that: another CPU is
+    // still executing it and would lose its next trapframe.
+    if(cpu->current == proc) {
+        if(cpu != cpu_get()) {
+            kernel_panic("scheduler: pid %d removed while running on CPU %d.", proc->pid, cpu->id);
         }
+
+        cpu->current = NULL;
     }
+}
 
-    if(!active_proc) {
-        return;
+/**
+ * Gives up the CPU
+ * The process goes to the back of its run queue without being demoted.
+ * @param proc - pointer to the active process entry
+ * @return 0 on success, -1 on error
+ */
+int scheduler_yield(proc_t *proc) {
+    if(!proc || proc != active_proc) {
+        kernel_log_error("scheduler: Only the active process can yield.");
+        return -1;
+    }
+
+    if(proc->type != PROC_TYPE_IDLE) {
+        scheduler_add(proc);
+    }
+    else {
+        proc->state = IDLE;
+    }
+
+    active_proc = NULL;
+    return 0;
+}
+
+/**
+ * Hands the CPU directly to another runnable process
+ * The target runs next on this CPU for the rest of the caller's
+ * timeslice, and the caller goes to the back of its run queue. The
+ * target isn't preempted on the way out of the kernel, even by
+ * processes that would have preempted it otherwise.
+ * @param proc - pointer to the active process entry
+ * @param target - pointer to the process entry to run
+ * @return 0 on success, -1 on error
+ */
+int scheduler_yield_to(proc_t *proc, proc_t *target) {
+    int remaining;
+
+    if(!proc || proc != active_proc) {
+        kernel_log_error("scheduler: Only the active process can yield.");
+        return -1;
+    }
+
+    if(!target || target == proc || !scheduler_queued(target)) {
+        kernel_log_debug("scheduler: Unable to yield to a process that isn't waiting to run.");
+        return -1;
+    }
+
+    remaining = scheduler_timeslice(proc) - proc->cpu_time;
+
+    // Take the target off its run queue and bring it to this CPU.
+    scheduler_remove(target);
+    target->cpu = cpu_id();
+
+    if(proc->type != PROC_TYPE_IDLE) {
+        scheduler_add(proc);
+    }
+    else {
+        proc->cpu_time = 0;
+        proc->state = IDLE;
     }
 
-    // If the process is the active process, ensure that the active process is
-    // cleared so when the scheduler runs again, it will select a new process to run.
-    if(proc->pid == active_proc->pid) {
-        active_proc = NULL;
+    // Donate the rest of the slice; the scheduler keeps running the
+    // target as the active process on the way out of the kernel.
+    target->cpu_time = scheduler_timeslice(target) - remaining;
+    if(target->cpu_time < 0) {
+        target->cpu_time = 0;
     }
+    target->handoff = 1;
+    scheduler_dispatch(cpu_get(), target);
+    return 0;
 }
 
 /**
  * Puts a process to sleep.
- * @param proc    - pointer to the process entry.
- * @param seconds - number of seconds to sleep.
+ * @param proc  - pointer to the process entry.
+ * @param ticks - number of ticks to sleep.
  */
-void scheduler_sleep(proc_t *proc, int seconds) {
+void scheduler_sleep(proc_t *proc, int ticks) {
+    proc_t **link = &sleep_list;
+
     if(!proc) {
         kernel_panic("scheduler: Unable to put invalid process to sleep.");
         return;
     }
 
-    proc->sleep_time = seconds;
+    // A negative delta would wake every later sleeper early.
+    if(ticks < 0) {
+        ticks = 0;
+    }
 
-    // Check if already in the sleeping queue.
+    // A process that is already sleeping is moved to its new wake time.
     if(proc->state == SLEEPING) {
+        scheduler_sleep_unlink(proc);
+    }
+    else {
+        scheduler_remove(proc);
+        proc->state = SLEEPING;
+    }
+
+    // Walk the list, converting the sleep time into a delta relative to
+    // the process in front of it.
+    while(*link && (*link)->sleep_time <= ticks) {
+        ticks -= (*link)->sleep_time;
+        link = &(*link)->sleep_next;
+    }
+
+    proc->sleep_time = ticks;
+    proc->sleep_next = *link;
+
+    // The process behind us now wakes relative to this one.
+    if(proc->sleep_next) {
+        proc->sleep_next->sleep_time -= ticks;
+    }
+
+    *link = proc;
+}
+
+/**
+ * Sets the base priority of a process
+ * The process is moved to the new priority level immediately.
+ * @param proc - pointer to the process entry
+ * @param priority - priority level (0 is the highest)
+ * @return 0 on success, -1 on error
+ */
+int scheduler_set_priority(proc_t *proc, int priority) {
+    if(!proc) {
+        kernel_log_error("scheduler: Unable to set priority of invalid process.");
+        return -1;
+    }
+
+    if(priority < 0 || priority >= SCHEDULER_LEVELS) {
+        kernel_log_error("scheduler: Priority %d is outside the valid range.", priority);
+        return -1;
+    }
+
+    proc->base_priority = priority;
+
+    // Processes waiting in a run queue are moved to their new level.
+    if(scheduler_queued(proc)) {
+        scheduler_remove(proc);
+        proc->priority = priority;
+        scheduler_add(proc);
+    }
+    else {
+        proc->priority = priority;
+    }
+
+    return 0;
+}
+
+/**
+ * Sets the priority a process inherits from the processes it blocks
+ * The process is moved to its new effective priority level immediately.
+ * @param proc - pointer to the process entry
+ * @param priority - inherited priority level, SCHEDULER_LEVELS for none
+ */
+void scheduler_inherit_priority(proc_t *proc, int priority) {
+    if(!proc) {
+        kernel_log_error("scheduler: Unable to set inherited priority of invalid process.");
         return;
     }
 
-    scheduler_remove(proc);
-    proc->state = SLEEPING;
+    // Processes waiting in a run queue are moved to their new level.
+    if(scheduler_queued(proc)) {
+        scheduler_remove(proc);
+        proc->inherited_priority = priority;
+        scheduler_add(proc);
+    }
+    else {
+        proc->inherited_priority = priority;
+    }
+}
+
+/**
+ * Sets the number of tickets held by a process
+ * A process with tickets is scheduled by the stride class and receives
+ * a share of the stride band's CPU time proportional to its tickets.
+ * Zero tickets moves the process back to the multilevel feedback queue.
+ * @param proc - pointer to the process entry
+ * @param tickets - number of tickets, 0 for none
+ * @return 0 on success, -1 on error
+ */
+int scheduler_set_tickets(proc_t *proc, int tickets) {
+    int queued;
+
+    if(!proc) {
+        kernel_log_error("scheduler: Unable to set tickets of invalid process.");
+        return -1;
+    }
+
+    if(tickets < 0 || tickets > SCHEDULER_TICKETS_MAX) {
+        kernel_log_error("scheduler: Ticket count %d is outside the valid range.", tickets);
+        return -1;
+    }
 
-    if(queue_in(&sleep_queue, proc->pid) != 0) {
-        kernel_log_warn("scheduler: Unable to queue in process into sleep queue.");
+    // Processes waiting to run are moved to their new class.
+    queued = scheduler_queued(proc);
+    if(queued) {
+        scheduler_remove(proc);
     }
+
+    if(tickets == 0) {
+        proc->sched_class = SCHED_CLASS_MLFQ;
+    }
+    else {
+        proc->sched_class = SCHED_CLASS_STRIDE;
+        proc->tickets = tickets;
+        proc->stride = SCHEDULER_STRIDE1 / tickets;
+    }
+
+    if(queued) {
+        scheduler_add(proc);
+    }
+
+    return 0;
+}
+
+/**
+ * Makes a process periodic under the EDF class
+ * Admission fails if the total utilization (budget / period) of all
+ * periodic processes would exceed 100%. The first job is released
+ * immediately. A period of 0 returns the process to the multilevel
+ * feedback queue.
+ * @param proc - pointer to the process entry
+ * @param period - release period in ticks, 0 for none
+ * @param budget - CPU budget per period in ticks
+ * @return 0 on success, -1 on error
+ */
+int scheduler_set_periodic(proc_t *proc, int period, int budget) {
+    int queued;
+    int utilization = 0;
+    proc_t *other;
+
+    if(!proc) {
+        kernel_log_error("scheduler: Unable to make invalid process periodic.");
+        return -1;
+    }
+
+    if(period < 0 || (period > 0 && (budget <= 0 || budget > period))) {
+        kernel_log_error("scheduler: Invalid period %d / budget %d.", period, budget);
+        return -1;
+    }
+
+    if(period > 0) {
+        // Sum the utilization of every other periodic process, rounding up.
+        for(int i = 0; i < PROC_MAX; i++) {
+            other = entry_to_proc(i);
+
+            if(other && other != proc && other->sched_class == SCHED_CLASS_EDF) {
+                utilization += (other->budget * SCHEDULER_EDF_UTIL_SCALE + other->period - 1) / other->period;
+            }
+        }
+        utilization += (budget * SCHEDULER_EDF_UTIL_SCALE + period - 1) / period;
+
+        if(utilization > SCHEDULER_EDF_UTIL_SCALE) {
+            kernel_log_warn("scheduler: pid %d rejected, utilization would be %d/%d.",
+                            proc->pid, utilization, SCHEDULER_EDF_UTIL_SCALE);
+            return -1;
+        }
+    }
+
+    // Processes waiting to run are moved to their new class.
+    queued = scheduler_queued(proc);
+    if(queued) {
+        scheduler_remove(proc);
+    }
+
+    if(period == 0) {
+        proc->sched_class = SCHED_CLASS_MLFQ;
+        proc->period = 0;
+        proc->budget = 0;
+        proc->release_pending = 0;
+        proc->throttle_pending = 0;
+    }
+    else {
+        proc->sched_class     = SCHED_CLASS_EDF;
+        proc->period          = period;
+        proc->budget          = budget;
+        proc->budget_left     = budget;
+        proc->release_time    = timer_get_ticks();
+        proc->deadline        = proc->release_time + period;
+        proc->job_done        = 0;
+        proc->job_started     = 0;
+        proc->release_pending = 0;
+    }
+
+    if(queued) {
+        scheduler_add(proc);
+    }
+
+    return 0;
+}
+
+/**
+ * Completes the current job of an EDF process
+ * The process waits until its next job is released.
+ * @param proc - pointer to the process entry
+ * @return 0 on success, -1 on error
+ */
+int scheduler_wait_period(proc_t *proc) {
+    if(!proc || proc->sched_class != SCHED_CLASS_EDF) {
+        kernel_log_error("scheduler: Unable to wait for the period of a non-periodic process.");
+        return -1;
+    }
+
+    // A job that completes after its deadline has missed it.
+    if(timer_get_ticks() > proc->deadline) {
+        proc->deadline_misses++;
+        kernel_log_debug("scheduler: pid %d missed its deadline at %d", proc->pid, proc->deadline);
+    }
+
+    proc->job_done = 1;
+    scheduler_edf_wait_release(proc);
+    return 0;
+}
+
+/**
+ * Copies a wakeup-to-run latency histogram
+ * @param proc - pointer to the process entry, NULL for the system-wide histogram
+ * @param hist - buffer of SCHED_LATENCY_BUCKETS counters to copy to
+ * @return 0 on success, -1 on error
+ */
+int scheduler_get_latency(proc_t *proc, unsigned int *hist) {
+    unsigned int *src = proc ? proc->latency : scheduler_latency;
+
+    if(!hist) {
+        kernel_log_error("scheduler: Invalid latency histogram buffer.");
+        return -1;
+    }
+
+    for(int i = 0; i < SCHED_LATENCY_BUCKETS; i++) {
+        hist[i] = src[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Copies the scheduler's activity counters
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int scheduler_get_stats(scheduler_stats_t *stats) {
+    if(!stats) {
+        kernel_log_error("scheduler: Invalid stats buffer.");
+        return -1;
+    }
+
+    *stats = scheduler_stats;
+    return 0;
+}
+
+/**
+ * Selects adaptive or fixed timeslices
+ * @param adaptive - 1 to size slices from each process' bursts, 0 to give
+ *                   every process SCHEDULER_TIMESLICE
+ */
+void scheduler_set_adaptive(int adaptive) {
+    scheduler_adaptive = adaptive;
 }
 
 /**
@@ -222,10 +1179,26 @@ void scheduler_init(void) {
     kernel_log_info("Initializing scheduler");
 
     // Initialize any data structures or variables
-    queue_init(&run_queue);
-    queue_init(&sleep_queue);
+    for(int i = 0; i < CPU_MAX; i++) {
+        for(int j = 0; j < SCHEDULER_LEVELS; j++) {
+#if SCHEDULER_BITMAP
+            proc_bitmap_init(&run_queues[i].levels[j]);
+#else
+            proc_list_init(&run_queues[i].levels[j]);
+#endif
+        }
+        run_queues[i].run_levels = 0;
+        proc_heap_init(&run_queues[i].stride_heap);
+        run_queues[i].stride_pass = 0;
+        proc_heap_init(&run_queues[i].edf_heap);
+        run_queues[i].size = 0;
+    }
+    sleep_list = NULL;
+    scheduler_last_tick = timer_get_ticks();
 
     // Register the timer callback (scheduler_timer) to run every tick.
-    timer_callback_register(&scheduler_timer, 1, -1);
+    // It doesn't need to wake an idle CPU; the sleep list provides its
+    // own wakeup through scheduler_next_wakeup().
+    timer_callback_deferrable(timer_callback_register(&scheduler_timer, 1, -1));
 }
 
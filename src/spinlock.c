@@ -0,0 +1,61 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Spinlock Implementation
+ */
+#include "kernel.h"
+#include "spinlock.h"
+
+/**
+ * Initializes a spinlock in the unlocked state
+ * @param lock - pointer to the spinlock
+ */
+void spin_init(spinlock_t *lock) {
+    lock->locked = 0;
+    lock->cpu = -1;
+}
+
+/**
+ * Acquires a spinlock, waiting until it is free
+ * @param lock - pointer to the spinlock
+ */
+void spin_lock(spinlock_t *lock) {
+    int locked = 1;
+
+    // Exchange (XCHG) with memory is atomic across CPUs. While the lock is
+    // held, spin on plain reads so the cache line isn't bounced around.
+    while(1) {
+        asm volatile("xchgl %0, %1" : "+r"(locked), "+m"(lock->locked) : : "memory");
+
+        if(!locked) {
+            break;
+        }
+
+        while(lock->locked) {
+            asm volatile("pause");
+        }
+
+        locked = 1;
+    }
+
+    lock->cpu = cpu_id();
+}
+
+/**
+ * Releases a spinlock
+ * @param lock - pointer to the spinlock
+ */
+void spin_unlock(spinlock_t *lock) {
+    if(!lock->locked) {
+        kernel_log_warn("spinlock: Releasing a lock that isn't held.");
+    }
+
+    lock->cpu = -1;
+
+    // Stores are not reordered with older stores on x86, so a compiler
+    // barrier is enough to publish the protected data first.
+    asm volatile("" : : : "memory");
+    lock->locked = 0;
+}
@@ -198,6 +198,199 @@ int proc_get_name(char *name) {
     return _syscall1(SYSCALL_PROC_GET_NAME, (int)name);
 }
 
+/**
+ * Sets the scheduling priority of a process
+ * @param pid - process id
+ * @param priority - priority level (0 is the highest)
+ * @return 0 on success, -1 on error
+ */
+int proc_set_priority(int pid, int priority) {
+    return _syscall2(SYSCALL_PROC_SET_PRIORITY, pid, priority);
+}
+
+/**
+ * Sets the CPU share of a process
+ * A process with tickets receives CPU time in proportion to its tickets
+ * relative to the other processes holding tickets.
+ * @param pid - process id
+ * @param tickets - number of tickets, 0 to return to priority scheduling
+ * @return 0 on success, -1 on error
+ */
+int proc_set_tickets(int pid, int tickets) {
+    return _syscall2(SYSCALL_PROC_SET_TICKETS, pid, tickets);
+}
+
+/**
+ * Makes the current process periodic
+ * A new job is released every period and scheduled by its deadline (the
+ * next release) ahead of other processes. A job that runs for longer
+ * than its budget is suspended until the next release.
+ * @param period - release period in ticks, 0 to stop being periodic
+ * @param budget - CPU budget per period in ticks
+ * @return 0 on success, -1 on error or if the budget can't be guaranteed
+ */
+int proc_set_periodic(int period, int budget) {
+    return _syscall2(SYSCALL_PROC_SET_PERIODIC, period, budget);
+}
+
+/**
+ * Completes the current job and waits for the next period
+ * @return 0 on success, -1 on error
+ */
+int proc_wait_period(void) {
+    return _syscall0(SYSCALL_PROC_WAIT_PERIOD);
+}
+
+/**
+ * Gets the statistics of a process
+ * @param pid - process id
+ * @param stats - pointer to the statistics structure to fill in
+ * @return 0 on success, -1 on error
+ */
+int proc_get_stats(int pid, proc_stats_t *stats) {
+    return _syscall2(SYSCALL_PROC_GET_STATS, pid, (int)stats);
+}
+
+/**
+ * Gets a wakeup-to-run latency histogram
+ * @param pid - process id, -1 for the system-wide histogram
+ * @param hist - buffer of SCHED_LATENCY_BUCKETS counters to fill in
+ * @return 0 on success, -1 on error
+ */
+int proc_get_latency(int pid, unsigned int *hist) {
+    return _syscall2(SYSCALL_PROC_GET_LATENCY, pid, (int)hist);
+}
+
+/**
+ * Gives up the CPU to the next process waiting to run
+ * @return 0 on success, -1 on error
+ */
+int proc_yield(void) {
+    return _syscall0(SYSCALL_PROC_YIELD);
+}
+
+/**
+ * Gives up the CPU to the specified process
+ * The process runs immediately for the rest of the caller's timeslice.
+ * @param pid - id of a process waiting to run
+ * @return 0 on success, -1 if the process isn't waiting to run
+ */
+int proc_yield_to(int pid) {
+    return _syscall1(SYSCALL_PROC_YIELD_TO, pid);
+}
+
+/**
+ * Creates a new process
+ * @param entry - function the process starts in
+ * @param name - process name
+ * @param stack_size - stack size needed in bytes, 0 for the default
+ * @param tty - TTY to attach the process to, -1 to share the caller's
+ * @return process id of the new process, -1 on error
+ */
+int proc_spawn(void *entry, char *name, int stack_size, int tty) {
+    proc_spawn_t spec;
+
+    spec.entry = entry;
+    spec.name = name;
+    spec.stack_size = stack_size;
+    spec.tty = tty;
+
+    return _syscall1(SYSCALL_PROC_SPAWN, (int)&spec);
+}
+
+/**
+ * Creates a batch of processes in a single system call
+ * Either every process is created or none are.
+ * @param specs - array of process descriptions
+ * @param count - number of processes, up to PROC_SPAWN_MAX
+ * @param pids - array to receive the process id of each process
+ * @return number of processes created, -1 on error
+ */
+int proc_spawn_batch(proc_spawn_t *specs, int count, int *pids) {
+    return _syscall3(SYSCALL_PROC_SPAWN_BATCH, (int)specs, count, (int)pids);
+}
+
+/**
+ * Waits for a child process to exit
+ * Blocks until the child exits unless it already has.
+ * @param pid - child to wait for, -1 for any child
+ * @param status - where to store the child's exit code, may be NULL
+ * @return pid of the child that exited, -1 if there is no such child
+ */
+int proc_wait(int pid, int *status) {
+    return _syscall2(SYSCALL_PROC_WAIT, pid, (int)status);
+}
+
+/**
+ * Creates a copy of the current process
+ * The child resumes here with a copy-on-write copy of the stack and the
+ * same TTY. Only the main thread of a process can fork.
+ * @return process id of the child to the parent, 0 to the child, -1 on error
+ */
+int proc_fork(void) {
+    return _syscall0(SYSCALL_PROC_FORK);
+}
+
+/**
+ * Moves the end of the process heap
+ * The heap grows up from the bottom of the process' address space and
+ * may reach to a guard page below the stack. Pages are mapped when first
+ * touched; pages above a lowered end are freed. Threads share the heap
+ * of their process, and it can't be lowered while the process has them.
+ * @param brk - new end of the heap, NULL to leave it
+ * @return end of the heap, NULL on error
+ */
+void *proc_brk(void *brk) {
+    return (void *)_syscall1(SYSCALL_PROC_BRK, (int)brk);
+}
+
+/**
+ * Runs in a new thread: calls the thread function, then exits the thread
+ * @param entry - function the thread runs
+ * @param arg - argument passed to the function
+ */
+void thread_start(int (*entry)(void *), void *arg) {
+    thread_exit(entry(arg));
+}
+
+/**
+ * Creates a thread in the current process
+ * The thread shares the process' id, name and I/O buffers. Returning
+ * from the thread function exits the thread with the returned value.
+ * @param entry - function the thread runs
+ * @param arg - argument passed to the function
+ * @param stack_size - stack size needed in bytes, 0 for the default
+ * @return thread id of the new thread, -1 on error
+ */
+int thread_create(int (*entry)(void *), void *arg, int stack_size) {
+    thread_spec_t spec;
+
+    spec.start = thread_start;
+    spec.entry = entry;
+    spec.arg = arg;
+    spec.stack_size = stack_size;
+
+    return _syscall1(SYSCALL_THREAD_CREATE, (int)&spec);
+}
+
+/**
+ * Exits the current thread
+ * @param status - exit status for the thread that created it
+ */
+void thread_exit(int status) {
+    _syscall1(SYSCALL_THREAD_EXIT, status);
+}
+
+/**
+ * Waits for a thread created by the current thread to exit
+ * @param tid - thread to wait for, -1 for any
+ * @param status - where to store the thread's exit status, may be NULL
+ * @return thread id of the thread that exited, -1 if there is no such thread
+ */
+int thread_join(int tid, int *status) {
+    return _syscall2(SYSCALL_THREAD_JOIN, tid, (int)status);
+}
+
 /**
  * Writes up to n bytes to the process' specified IO buffer
  * @param io - the IO buffer to write to
@@ -6,11 +6,27 @@
  * Timer Implementation
  */
 #include <spede/string.h>
+#include <spede/machine/io.h>
 
 #include "interrupts.h"
 #include "kernel.h"
 #include "queue.h"
 #include "timer.h"
+#include "kheap.h"
+
+// PIT Definitions
+#define PIT_PORT_CH0        0x40            // Channel 0 data port
+#define PIT_PORT_CMD        0x43            // Mode/command port
+#define PIT_CMD_LATCH       0x00            // Latch channel 0 count
+#define PIT_CMD_ONESHOT     0x30            // Channel 0, lo/hi byte, mode 0
+#define PIT_CMD_PERIODIC    0x34            // Channel 0, lo/hi byte, mode 2
+#define PIT_COUNT_MAX       0xffff          // Largest programmable count
+
+// PIT count for a single tick
+#define PIT_TICK_COUNT      (PIT_FREQUENCY / TIMER_HZ)
+
+// Longest one-shot period that fits in the PIT counter (in ticks)
+#define TIMER_TICKLESS_MAX  (PIT_COUNT_MAX / PIT_TICK_COUNT)
 
 /**
  * Data structures
@@ -20,6 +36,7 @@ typedef struct timer_t {
     void (*callback)();    // Function to call when the interval occurs
     int interval;          // Interval in which the timer will be called
     int repeat;            // Indicate how many intervals to repeat (-1 repeats forever)
+    int deferrable;        // Callback does not need to wake an idle CPU
 } timer_t;
 
 /**
@@ -29,12 +46,22 @@ typedef struct timer_t {
 // Number of timer ticks that have occured
 int timer_ticks;
 
-// Timers table; each item in the array is a timer_t struct
-timer_t timers[TIMERS_MAX];
+// Timers table, NULL where the id is free
+timer_t *timers[TIMERS_MAX];
+
+// Cache the timers are allocated from
+kheap_cache_t timer_cache;
 
 // Timer allocator; used to allocate indexes into the timers table
 queue_t timer_allocator;
 
+// Number of ticks the PIT is programmed for while the tick is stopped,
+// 0 when running periodically
+int timer_tickless_ticks;
+
+// 1 once the one-shot has expired and until its interrupt is handled
+int timer_tickless_expired;
+
 
 /**
  * Registers a new callback to be called at the specified interval
@@ -59,7 +86,12 @@ int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
         return -1;
     }
 
-    timer = &timers[timer_id];
+    timer = kheap_cache_alloc(&timer_cache);
+    if (!timer) {
+        queue_in(&timer_allocator, timer_id);
+        return -1;
+    }
+    timers[timer_id] = timer;
 
     // Set the callback function for the timer.
     timer->callback = func_ptr;
@@ -70,6 +102,9 @@ int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
     // Set the repeat value for the timer.
     timer->repeat = repeat;
 
+    // Callbacks wake an idle CPU unless marked otherwise.
+    timer->deferrable = 0;
+
     kernel_log_info("Timer callback registered timers[%d].", timer_id);
     return timer_id;
 }
@@ -88,8 +123,14 @@ int timer_callback_unregister(int id) {
         return -1;
     }
 
-    timer = &timers[id];
-    memset(timer, 0, sizeof(timer_t));
+    timer = timers[id];
+    if (!timer) {
+        kernel_log_error("timer: callback id %d is not registered", id);
+        return -1;
+    }
+
+    timers[id] = NULL;
+    kheap_cache_free(&timer_cache, timer);
 
     if (queue_in(&timer_allocator, id) != 0) {
         kernel_log_error("timer: unable to queue timer entry back to allocator");
@@ -99,6 +140,27 @@ int timer_callback_unregister(int id) {
     return 0;
 }
 
+/**
+ * Marks the specified callback as deferrable
+ * @param id - timer id
+ *
+ * @return 0 on success, -1 on error
+ */
+int timer_callback_deferrable(int id) {
+    if (id < 0 || id >= TIMERS_MAX) {
+        kernel_log_error("timer: callback id out of range: %d", id);
+        return -1;
+    }
+
+    if (!timers[id]) {
+        kernel_log_error("timer: callback id %d is not registered", id);
+        return -1;
+    }
+
+    timers[id]->deferrable = 1;
+    return 0;
+}
+
 /**
  * Returns the number of ticks that have occured since startup
  *
@@ -109,35 +171,84 @@ int timer_get_ticks() {
 }
 
 /**
- * Timer IRQ Handler
+ * Programs the PIT to interrupt every tick
+ */
+void timer_pit_periodic(void) {
+    outportb(PIT_PORT_CMD, PIT_CMD_PERIODIC);
+    outportb(PIT_PORT_CH0, PIT_TICK_COUNT & 0xff);
+    outportb(PIT_PORT_CH0, PIT_TICK_COUNT >> 8);
+}
+
+/**
+ * Programs the PIT to interrupt once after the given count
+ * @param count - number of PIT input clocks
+ */
+void timer_pit_oneshot(int count) {
+    outportb(PIT_PORT_CMD, PIT_CMD_ONESHOT);
+    outportb(PIT_PORT_CH0, count & 0xff);
+    outportb(PIT_PORT_CH0, count >> 8);
+}
+
+/**
+ * Reads the PIT's current count
+ * @return number of PIT input clocks left until the counter expires
+ */
+int timer_pit_count(void) {
+    int count;
+
+    outportb(PIT_PORT_CMD, PIT_CMD_LATCH);
+    count = inportb(PIT_PORT_CH0);
+    count |= inportb(PIT_PORT_CH0) << 8;
+
+    return count;
+}
+
+/**
+ * Advances the timer by the given number of ticks
  *
  * Should perform the following:
- *   - Increment the timer ticks every time the timer occurs
+ *   - Increment the timer ticks
  *   - Handle each registered timer
- *     - If the interval is hit, run the callback function
+ *     - If an interval boundary was crossed, run the callback function
  *     - Handle timer repeats
+ * @param ticks - number of ticks that have elapsed
  */
-void timer_irq_handler(void) {
+void timer_advance(int ticks) {
+    int previous = timer_ticks;
+    timer_t *timer;
+
     // Increment the timer_ticks value
-    timer_ticks++;
+    timer_ticks += ticks;
 
     // Iterate through the timers table
     for(int i = 0; i < TIMERS_MAX; i++) {
 
         // If we have a valid callback, check if it needs to be called
-        if(timers[i].callback) {
-
-            // If the timer interval is hit, run the callback function
-            if(timer_ticks % timers[i].interval == 0) {
-                (*timers[i].callback)();
+        timer = timers[i];
+        if(timer) {
+
+            // If the timer interval is hit, run the callback function.
+            // Callbacks whose interval passed more than once while the
+            // tick was stopped only run once.
+            if(timer_ticks / timer->interval != previous / timer->interval) {
+                (*timer->callback)();
+
+                // The callback may have unregistered its own timer.
+                if(timers[i] != timer) {
+                    continue;
+                }
             }
 
             // If the timer repeat is greater than 0, decrement
-            if(timers[i].repeat > 0) {
-                timers[i].repeat--;
+            if(timer->repeat > 0) {
+                timer->repeat -= ticks;
+
+                if(timer->repeat < 0) {
+                    timer->repeat = 0;
+                }
             }
             // If the timer repeat is equal to 0, unregister the timer
-            else if(timers[i].repeat == 0) {
+            else if(timer->repeat == 0) {
                 timer_callback_unregister(i);
             }
             // If the timer repeat is less than 0, do nothing
@@ -145,6 +256,111 @@ void timer_irq_handler(void) {
     }
 }
 
+/**
+ * Stops the periodic tick while the CPU is idle
+ * The timer is programmed one-shot for the nearest of the given expiry
+ * or the next non-deferrable callback. The one-shot ends on a tick
+ * boundary, so the tick keeps its phase.
+ * @param ticks - number of ticks until the next wakeup, -1 if none
+ */
+void timer_tickless_enter(int ticks) {
+    int remaining;
+    int next;
+
+    // The pending interrupt accounts for the expired one-shot's ticks;
+    // programming another now would lose them.
+    if(timer_tickless_expired) {
+        return;
+    }
+
+    if(ticks < 0 || ticks > TIMER_TICKLESS_MAX) {
+        ticks = TIMER_TICKLESS_MAX;
+    }
+
+    // Find the nearest callback that must not be deferred.
+    for(int i = 0; i < TIMERS_MAX; i++) {
+        if(timers[i] && !timers[i]->deferrable) {
+            next = timers[i]->interval - (timer_ticks % timers[i]->interval);
+
+            if(next < ticks) {
+                ticks = next;
+            }
+        }
+    }
+
+    // Nothing is gained unless at least one tick can be skipped.
+    if(ticks <= 1) {
+        return;
+    }
+
+    // Finish the current tick, then skip whole ticks.
+    remaining = timer_pit_count();
+    if(remaining <= 0 || remaining > PIT_TICK_COUNT) {
+        remaining = PIT_TICK_COUNT;
+    }
+
+    timer_pit_oneshot(remaining + (ticks - 1) * PIT_TICK_COUNT);
+    timer_tickless_ticks = ticks;
+}
+
+/**
+ * Restarts the tick after an early wakeup
+ * Whole ticks that elapsed while the tick was stopped are caught up, and
+ * the interrupted tick is finished with a one-shot whose interrupt
+ * restarts the periodic tick, so the tick keeps its phase.
+ */
+void timer_tickless_exit(void) {
+    int period;
+    int passed;
+    int elapsed;
+
+    if(!timer_tickless_ticks || timer_tickless_expired) {
+        return;
+    }
+
+    // The one-shot started a whole number of ticks before it expires.
+    period = timer_tickless_ticks * PIT_TICK_COUNT;
+    passed = period - timer_pit_count();
+
+    // The counter wraps once the one-shot has expired; its interrupt is
+    // pending and accounts for every tick. Keep the tick from being
+    // stopped again until it has.
+    if(passed < 0 || passed >= period) {
+        timer_tickless_expired = 1;
+        return;
+    }
+
+    elapsed = passed / PIT_TICK_COUNT;
+
+    timer_pit_oneshot(PIT_TICK_COUNT - passed % PIT_TICK_COUNT);
+    timer_tickless_ticks = 1;
+
+    if(elapsed > 0) {
+        timer_advance(elapsed);
+    }
+}
+
+/**
+ * Timer IRQ Handler
+ *
+ * Should perform the following:
+ *   - Account for every tick that has occurred since the last interrupt
+ *   - Restart the periodic tick if it was stopped
+ */
+void timer_irq_handler(void) {
+    int ticks = 1;
+
+    // A one-shot period covers every tick that was skipped.
+    if(timer_tickless_ticks) {
+        ticks = timer_tickless_ticks;
+        timer_tickless_ticks = 0;
+        timer_tickless_expired = 0;
+        timer_pit_periodic();
+    }
+
+    timer_advance(ticks);
+}
+
 /**
  * Initializes timer related data structures and variables
  */
@@ -154,11 +370,13 @@ void timer_init(void) {
     // Set the starting tick value
     timer_ticks = 0;
 
-    // Initialize the timers data structures
+    // Initialize the timers table; timers are allocated as they're registered
     for(int i = 0; i < TIMERS_MAX; i++) {
-        timers[i].callback          = NULL;
-        timers[i].interval          = 0;
-        timers[i].repeat            = 0;
+        timers[i] = NULL;
+    }
+
+    if(kheap_cache_init(&timer_cache, "timer", sizeof(timer_t)) != 0) {
+        kernel_panic("timer: Unable to create the timer cache.");
     }
 
     // Initialize the timer callback allocator queue
@@ -171,6 +389,11 @@ void timer_init(void) {
         }
     }
 
+    // Run the tick periodically
+    timer_tickless_ticks = 0;
+    timer_tickless_expired = 0;
+    timer_pit_periodic();
+
     // Register the Timer IRQ with the isr_entry_timer and timer_irq_handler
     interrupts_irq_register(IRQ_TIMER, isr_entry_timer, timer_irq_handler);
 }
@@ -0,0 +1,93 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * Time Stamp Counter Implementation
+ */
+#include <spede/machine/io.h>
+
+#include "kernel.h"
+#include "timer.h"
+#include "tsc.h"
+
+// PIT channel 2 definitions used for calibration
+#define PIT_PORT_CH2        0x42            // Channel 2 data port
+#define PIT_PORT_CMD        0x43            // Mode/command port
+#define PIT_CMD_CH2_ONESHOT 0xb0            // Channel 2, lo/hi byte, mode 0
+#define PIT_PORT_GATE       0x61            // Channel 2 gate/speaker port
+#define PIT_GATE_CH2        0x01            // Channel 2 gate enable
+#define PIT_GATE_SPEAKER    0x02            // Speaker data enable
+#define PIT_GATE_OUT2       0x20            // Channel 2 output status
+
+// PIT count for the calibration period
+#define TSC_CALIBRATE_COUNT (PIT_FREQUENCY / TSC_CALIBRATE_HZ)
+
+// Time stamp counter frequency (cycles per second)
+unsigned int tsc_hz;
+
+/**
+ * Reads the CPU time stamp counter
+ * @return number of cycles since the CPU was reset
+ */
+unsigned long long tsc_read(void) {
+    unsigned int lo;
+    unsigned int hi;
+
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/**
+ * Returns the calibrated time stamp counter frequency
+ * @return cycles per second
+ */
+unsigned int tsc_get_hz(void) {
+    return tsc_hz;
+}
+
+/**
+ * Converts a number of cycles to milliseconds
+ * @param cycles - number of cycles
+ * @return number of milliseconds
+ */
+unsigned int tsc_to_ms(unsigned long long cycles) {
+    if(tsc_hz < 1000) {
+        return 0;
+    }
+
+    return cycles / (tsc_hz / 1000);
+}
+
+/**
+ * Calibrates the time stamp counter frequency against the PIT
+ * Channel 2 counts down once from a known count while the time stamp
+ * counter is sampled, leaving channel 0 (the timer tick) untouched.
+ * Must be called with interrupts disabled.
+ */
+void tsc_init(void) {
+    unsigned long long start;
+    unsigned long long end;
+    unsigned char gate;
+
+    kernel_log_info("Calibrating TSC");
+
+    // Enable the channel 2 gate with the speaker disconnected.
+    gate = inportb(PIT_PORT_GATE);
+    outportb(PIT_PORT_GATE, (gate & ~PIT_GATE_SPEAKER) | PIT_GATE_CH2);
+
+    // Start a one-shot count; the output goes high when it reaches zero.
+    outportb(PIT_PORT_CMD, PIT_CMD_CH2_ONESHOT);
+    outportb(PIT_PORT_CH2, TSC_CALIBRATE_COUNT & 0xff);
+    outportb(PIT_PORT_CH2, (TSC_CALIBRATE_COUNT >> 8) & 0xff);
+
+    start = tsc_read();
+    while(!(inportb(PIT_PORT_GATE) & PIT_GATE_OUT2));
+    end = tsc_read();
+
+    // Restore the gate and speaker state.
+    outportb(PIT_PORT_GATE, gate);
+
+    tsc_hz = (end - start) * PIT_FREQUENCY / TSC_CALIBRATE_COUNT;
+    kernel_log_info("TSC running at %d kHz", tsc_hz / 1000);
+}
@@ -15,6 +15,7 @@
 #include "syscall.h"
 #include "syscall_common.h"
 #include "ringbuf.h"
+#include "kheap.h"
 
 // Function Declarations.
 void tty_refresh(void);
@@ -25,6 +26,9 @@ struct tty_t tty_table[TTY_MAX];
 // Current Active TTY
 struct tty_t *active_tty;
 
+// Cache the TTY input/output buffers are allocated from
+kheap_cache_t tty_ringbuf_cache;
+
 
 /**
  * Returns the TTY structure for the given TTY number.
@@ -50,11 +54,11 @@ void tty_input(char c) {
         kernel_log_debug("No active tty. Unable to write character into input buffer.");
     }
     // Writes into the input buffer.
-    ringbuf_write(&active_tty->io_input, c);
+    ringbuf_write(active_tty->io_input, c);
 
     // Writes into output buffer if echo is set.
     if(active_tty->echo == 1) {
-        ringbuf_write(&active_tty->io_output, c);
+        ringbuf_write(active_tty->io_output, c);
     }
 }
 
@@ -96,12 +100,12 @@ void tty_refresh(void) {
 
     // Handles input through echo.
     char output_c = '\0';
-    while(!ringbuf_is_empty(&active_tty->io_output)) {
-        if(ringbuf_read(&active_tty->io_output, &output_c) == 0) {
+    while(!ringbuf_is_empty(active_tty->io_output)) {
+        if(ringbuf_read(active_tty->io_output, &output_c) == 0) {
             tty_update(output_c);
         }
     }
-    ringbuf_flush(&active_tty->io_output);
+    ringbuf_flush(active_tty->io_output);
 
     // Checks if there are new characters in the buffer that need to be written
     // on the screen.
@@ -272,6 +276,10 @@ void tty_update(char c) {
 void tty_init(void) {
     kernel_log_info("tty: Initializing TTY driver");
 
+    if(kheap_cache_init(&tty_ringbuf_cache, "ringbuf", sizeof(ringbuf_t)) != 0) {
+        kernel_panic("tty: Unable to create the buffer cache.");
+    }
+
     // Initialize the tty_table
     for(int i = 0; i < TTY_MAX; i++) {
         tty_table[i].id = i;
@@ -289,13 +297,21 @@ void tty_init(void) {
         tty_table[i].pos_y      = 0;
         tty_table[i].pos_scroll = 0;
 
-        ringbuf_init(&tty_table[i].io_input);
-        ringbuf_init(&tty_table[i].io_output);
+        tty_table[i].io_input  = kheap_cache_alloc(&tty_ringbuf_cache);
+        tty_table[i].io_output = kheap_cache_alloc(&tty_ringbuf_cache);
+        if(!tty_table[i].io_input || !tty_table[i].io_output) {
+            kernel_panic("tty: Unable to allocate the buffers of TTY %d.", i);
+        }
+
+        ringbuf_init(tty_table[i].io_input);
+        ringbuf_init(tty_table[i].io_output);
     }
 
     // Select tty 0 to start with
     tty_select(0);
 
     // Register a timer callback to update the screen on a regular interval
-    timer_callback_register(&tty_refresh, 1, -1);
+    // Output is only produced by running processes, so the refresh
+    // doesn't need to wake an idle CPU.
+    timer_callback_deferrable(timer_callback_register(&tty_refresh, 1, -1));
 }
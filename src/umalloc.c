@@ -0,0 +1,259 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2022
+ *
+ * User Heap
+ *
+ * Runs in the calling process on top of proc_brk. Globals are shared by
+ * every process, so the allocator keeps its state at the start of the
+ * process heap, which it finds through the process information the
+ * kernel leaves at the top of every stack. A forked child gets a copy of
+ * that state along with the rest of the heap; a process can't fork while
+ * it has threads, so the copy is never caught mid-allocation.
+ */
+
+#include <spede/stddef.h>
+
+#include "syscall.h"
+#include "umalloc.h"
+#include "bit_util.h"
+
+#define UMALLOC_MAGIC       0x0ba11ec0  // Marks an allocated block
+
+// Number of size classes
+#define UMALLOC_CLASSES     (UMALLOC_MAX_SHIFT - UMALLOC_MIN_SHIFT + 1)
+
+// Header in front of every block
+// A free block links to the next free block of its class through its
+// first word after the header.
+typedef struct umalloc_block_t {
+    unsigned int magic;         // UMALLOC_MAGIC while allocated
+    int shift;                  // Size class; the block is 2^shift bytes
+} umalloc_block_t;
+
+// Allocator state at the start of the heap
+// The heap's first page is zero when first touched, so a zero top means
+// the heap hasn't been set up yet.
+typedef struct umalloc_heap_t {
+    volatile int lock;          // 1 while a thread is in the allocator
+    unsigned char *top;         // End of the memory carved into blocks, NULL until set up
+    unsigned char *end;         // End of the heap
+    umalloc_block_t *free[UMALLOC_CLASSES]; // Free blocks of each size class
+    int in_use;                 // Blocks allocated
+    unsigned int allocs;        // Number of allocations
+    unsigned int frees;         // Number of frees
+} umalloc_heap_t;
+
+// Bytes reserved at the start of the heap for its state, kept 8-byte aligned
+#define UMALLOC_HEADER_SIZE ((sizeof(umalloc_heap_t) + 7) & ~7)
+
+/**
+ * Finds the current process' heap
+ * @return pointer to the allocator state at the start of the heap
+ */
+umalloc_heap_t *umalloc_heap(void) {
+    unsigned int here = (unsigned int)&here;
+    proc_info_t *info;
+
+    // The stack ends at the top of its region, so the process
+    // information can be found from any local variable.
+    info = (proc_info_t *)((here | (PROC_REGION_SIZE - 1)) + 1 - sizeof(proc_info_t));
+    return (umalloc_heap_t *)info->heap;
+}
+
+/**
+ * Takes the heap lock
+ * A thread holding it may have been preempted on this CPU, so give up
+ * the CPU rather than spin.
+ * @param heap - pointer to the allocator state
+ */
+void umalloc_lock(umalloc_heap_t *heap) {
+    int locked = 1;
+
+    while(1) {
+        asm volatile("xchgl %0, %1" : "+r"(locked), "+m"(heap->lock) : : "memory");
+
+        if(!locked) {
+            break;
+        }
+
+        proc_yield();
+        locked = 1;
+    }
+}
+
+/**
+ * Releases the heap lock
+ * @param heap - pointer to the allocator state
+ */
+void umalloc_unlock(umalloc_heap_t *heap) {
+    asm volatile("" : : : "memory");
+    heap->lock = 0;
+}
+
+/**
+ * Sets up the heap on first use
+ * @param heap - pointer to the allocator state, with the lock held
+ * @return 0 on success, -1 on error
+ */
+int umalloc_setup(umalloc_heap_t *heap) {
+    if(heap->top) {
+        return 0;
+    }
+
+    heap->end = proc_brk(NULL);
+    if(!heap->end) {
+        return -1;
+    }
+
+    heap->top = (unsigned char *)heap + UMALLOC_HEADER_SIZE;
+    return 0;
+}
+
+/**
+ * Carves a block off the unused end of the heap, growing it if needed
+ * @param heap - pointer to the allocator state, with the lock held
+ * @param shift - size class
+ * @return pointer to the block, NULL if the heap is full
+ */
+umalloc_block_t *umalloc_carve(umalloc_heap_t *heap, int shift) {
+    umalloc_block_t *block;
+    unsigned int need;
+    unsigned int end;
+
+    need = (unsigned int)heap->top + (1 << shift);
+    if(need > (unsigned int)heap->end) {
+        // Grow by at least UMALLOC_GROW to keep system calls rare, or by
+        // exactly what is needed when that is all that is left.
+        end = (need + UMALLOC_GROW - 1) & ~(UMALLOC_GROW - 1);
+
+        if(!proc_brk((void *)end)) {
+            end = need;
+            if(!proc_brk((void *)end)) {
+                return NULL;
+            }
+        }
+
+        heap->end = (unsigned char *)end;
+    }
+
+    block = (umalloc_block_t *)heap->top;
+    heap->top += 1 << shift;
+    return block;
+}
+
+/**
+ * Allocates memory from the process heap
+ * Requests are rounded up to a power-of-two size class, and each class
+ * keeps a list of freed blocks to reuse. The heap is shared by the
+ * threads of a process.
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if the heap is full
+ */
+void *umalloc(int size) {
+    umalloc_heap_t *heap;
+    umalloc_block_t *block;
+    int shift;
+
+    if(size <= 0 || size > (1 << UMALLOC_MAX_SHIFT) - (int)sizeof(umalloc_block_t)) {
+        return NULL;
+    }
+
+    // The class is the next power of two that holds the request and its
+    // header.
+    shift = bit_find_last(size + sizeof(umalloc_block_t) - 1);
+    if(shift < UMALLOC_MIN_SHIFT) {
+        shift = UMALLOC_MIN_SHIFT;
+    }
+
+    heap = umalloc_heap();
+    umalloc_lock(heap);
+
+    if(umalloc_setup(heap) != 0) {
+        umalloc_unlock(heap);
+        return NULL;
+    }
+
+    block = heap->free[shift - UMALLOC_MIN_SHIFT];
+    if(block) {
+        heap->free[shift - UMALLOC_MIN_SHIFT] = *(umalloc_block_t **)(block + 1);
+    }
+    else {
+        block = umalloc_carve(heap, shift);
+        if(!block) {
+            umalloc_unlock(heap);
+            return NULL;
+        }
+    }
+
+    block->magic = UMALLOC_MAGIC;
+    block->shift = shift;
+    heap->in_use++;
+    heap->allocs++;
+
+    umalloc_unlock(heap);
+    return block + 1;
+}
+
+/**
+ * Frees memory allocated by umalloc
+ * The block is kept for reuse by its size class, not returned to the
+ * kernel; the process' heap is freed when it exits.
+ * @param ptr - pointer to the memory, may be NULL
+ */
+void ufree(void *ptr) {
+    umalloc_heap_t *heap;
+    umalloc_block_t *block;
+
+    if(!ptr) {
+        return;
+    }
+
+    // Ignore pointers that weren't allocated, or were already freed.
+    block = (umalloc_block_t *)ptr - 1;
+    if(block->magic != UMALLOC_MAGIC) {
+        return;
+    }
+
+    heap = umalloc_heap();
+    umalloc_lock(heap);
+
+    block->magic = 0;
+    *(umalloc_block_t **)(block + 1) = heap->free[block->shift - UMALLOC_MIN_SHIFT];
+    heap->free[block->shift - UMALLOC_MIN_SHIFT] = block;
+    heap->in_use--;
+    heap->frees++;
+
+    umalloc_unlock(heap);
+}
+
+/**
+ * Retrieves the usage of the process heap
+ * @param stats - pointer to the stats to fill in
+ * @return 0 on success, -1 on error
+ */
+int umalloc_get_stats(umalloc_stats_t *stats) {
+    umalloc_heap_t *heap;
+
+    if(!stats) {
+        return -1;
+    }
+
+    heap = umalloc_heap();
+    umalloc_lock(heap);
+
+    if(umalloc_setup(heap) != 0) {
+        umalloc_unlock(heap);
+        return -1;
+    }
+
+    stats->size   = heap->end - (unsigned char *)heap;
+    stats->used   = heap->top - (unsigned char *)heap;
+    stats->in_use = heap->in_use;
+    stats->allocs = heap->allocs;
+    stats->frees  = heap->frees;
+
+    umalloc_unlock(heap);
+    return 0;
+}